@@ -0,0 +1,134 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "buf_pools.h"
+#include "exceptions/pool_exists_exception.h"
+#include "exceptions/pool_not_found_exception.h"
+
+namespace badgerdb {
+
+    const char *const BufPools::DEFAULT_POOL = "default";
+
+    BufPools::BufPools(std::uint32_t defaultBufs) {
+        addPool(DEFAULT_POOL, defaultBufs);
+    }
+
+    BufPools::~BufPools() {
+        for (std::map<std::string, Pool>::iterator it = pools.begin(); it != pools.end(); ++it) {
+            delete it->second.mgr;
+        }
+    }
+
+    void BufPools::addPool(const std::string &name, std::uint32_t bufs, BufHint hint) {
+        std::lock_guard<std::mutex> lock(poolsLock);
+        if (pools.find(name) != pools.end()) {
+            throw PoolExistsException(name);
+        }
+        Pool &pool = pools[name];
+        pool.mgr = new BufMgr(bufs);
+        pool.hint = hint;
+    }
+
+    BufPools::Pool &BufPools::find(const std::string &name) {
+        std::map<std::string, Pool>::iterator found = pools.find(name);
+        if (found == pools.end()) {
+            throw PoolNotFoundException(name);
+        }
+        return found->second;
+    }
+
+    BufPools::Pool &BufPools::route(const File *file) {
+        std::lock_guard<std::mutex> lock(poolsLock);
+        std::map<const File *, Pool *>::iterator assigned = assignments.find(file);
+        return assigned != assignments.end() ? *assigned->second : pools[DEFAULT_POOL];
+    }
+
+    void BufPools::assignFile(const File *file, const std::string &name) {
+        Pool *previous = &route(file);
+        Pool *next;
+        {
+            std::lock_guard<std::mutex> lock(poolsLock);
+            next = &find(name);
+        }
+        if (next == previous) {
+            return;
+        }
+        // The file's pages must not be cached in two pools at once
+        previous->mgr->flushFile(file);
+        std::lock_guard<std::mutex> lock(poolsLock);
+        if (name == DEFAULT_POOL) {
+            assignments.erase(file);
+        } else {
+            assignments[file] = next;
+        }
+    }
+
+    BufMgr &BufPools::pool(const std::string &name) {
+        std::lock_guard<std::mutex> lock(poolsLock);
+        return *find(name).mgr;
+    }
+
+    BufMgr &BufPools::poolOf(const File *file) {
+        return *route(file).mgr;
+    }
+
+    std::vector<std::string> BufPools::poolNames() {
+        std::lock_guard<std::mutex> lock(poolsLock);
+        std::vector<std::string> names;
+        for (std::map<std::string, Pool>::iterator it = pools.begin(); it != pools.end(); ++it) {
+            names.push_back(it->first);
+        }
+        return names;
+    }
+
+    void BufPools::readPage(File *file, const PageId pageNo, Page *&page, BufHint hint) {
+        Pool &pool = route(file);
+        pool.mgr->readPage(file, pageNo, page, hint == BufHint::NORMAL ? pool.hint : hint);
+    }
+
+    void BufPools::unPinPage(File *file, const PageId pageNo, const bool dirty) {
+        route(file).mgr->unPinPage(file, pageNo, dirty);
+    }
+
+    void BufPools::allocPage(File *file, PageId &pageNo, Page *&page, BufHint hint) {
+        Pool &pool = route(file);
+        pool.mgr->allocPage(file, pageNo, page, hint == BufHint::NORMAL ? pool.hint : hint);
+    }
+
+    void BufPools::flushFile(const File *file) {
+        route(file).mgr->flushFile(file);
+    }
+
+    void BufPools::disposePage(File *file, const PageId pageNo) {
+        route(file).mgr->disposePage(file, pageNo);
+    }
+
+    FlushStats BufPools::flushAll() {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::vector<BufMgr *> mgrs;
+        {
+            std::lock_guard<std::mutex> lock(poolsLock);
+            for (std::map<std::string, Pool>::iterator it = pools.begin(); it != pools.end(); ++it) {
+                mgrs.push_back(it->second.mgr);
+            }
+        }
+        FlushStats total;
+        for (std::size_t i = 0; i < mgrs.size(); i++) {
+            FlushStats flushed = mgrs[i]->flushAll();
+            total.pages += flushed.pages;
+            total.files += flushed.files;
+        }
+        total.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start);
+        return total;
+    }
+
+    BufStats BufPools::getBufStats(const std::string &name) {
+        return pool(name).getBufStats();
+    }
+
+}
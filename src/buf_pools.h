@@ -0,0 +1,191 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "file.h"
+#include "buffer.h"
+
+namespace badgerdb {
+
+/**
+* @brief Several named buffer pools, each with its own frames, and a mapping that assigns every file to one of them.
+*
+* Pages of a file only ever compete for frames with pages of the files in the same pool, so that, for example,
+* small hot metadata files can be kept in a "keep" pool that a scan of a large file in a "recycle" pool cannot
+* flush.  Each pool has a default access hint that is used when a caller passes BufHint::NORMAL, and is a full
+* BufMgr, so tiers, the prefetcher and the other options can be enabled per pool through pool().
+*
+* A pool named "default" always exists; files not assigned to any pool use it.
+*/
+class BufPools
+{
+ public:
+	/**
+   * Name of the pool files use unless assigned to another one
+	 */
+  static const char* const DEFAULT_POOL;
+
+	/**
+	 * Constructor of BufPools class, creating the default pool.
+	 *
+	 * @param defaultBufs 	Number of frames in the default pool
+	 */
+  BufPools(std::uint32_t defaultBufs);
+
+	/**
+   * Destructor of BufPools class, destroying every pool
+	 */
+  ~BufPools();
+
+	/**
+	 * Add a pool.
+	 *
+	 * @param name   	Name of the pool
+	 * @param bufs  	Number of frames in the pool
+	 * @param hint  	Hint applied to requests for pages of this pool that come with BufHint::NORMAL
+	 * @throws  PoolExistsException If a pool of that name already exists
+	 */
+  void addPool(const std::string& name, std::uint32_t bufs, BufHint hint = BufHint::NORMAL);
+
+	/**
+	 * Assign a file to a pool.  Pages of the file cached in its previous pool are written back and dropped
+	 * from there first.
+	 *
+	 * @param file   	File object
+	 * @param name   	Name of the pool
+	 * @throws  PoolNotFoundException If there is no pool of that name
+	 * @throws  PagePinnedException If a page of the file is pinned in its previous pool
+	 */
+  void assignFile(const File* file, const std::string& name);
+
+	/**
+	 * Return a pool by name, e.g. to enable options on it.
+	 *
+	 * @param name   	Name of the pool
+	 * @throws  PoolNotFoundException If there is no pool of that name
+	 */
+  BufMgr& pool(const std::string& name);
+
+	/**
+	 * Return the pool a file is assigned to.
+	 *
+	 * @param file   	File object
+	 */
+  BufMgr& poolOf(const File* file);
+
+	/**
+   * Return the names of all pools
+	 */
+  std::vector<std::string> poolNames();
+
+	/**
+	 * Reads the given page from the file through the file's pool.  See BufMgr::readPage().
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file to be read
+	 * @param page  	Reference to page pointer, set to the frame holding the page
+	 * @param hint  	Access hint; BufHint::NORMAL means the pool's default hint
+	 */
+  void readPage(File* file, const PageId PageNo, Page*& page, BufHint hint = BufHint::NORMAL);
+
+	/**
+	 * Unpin a page in the file's pool.  See BufMgr::unPinPage().
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number
+	 * @param dirty		True if the page to be unpinned needs to be marked dirty
+	 */
+  void unPinPage(File* file, const PageId PageNo, const bool dirty);
+
+	/**
+	 * Allocates a new page in the file and assigns it a frame in the file's pool.  See BufMgr::allocPage().
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number assigned to the new page, returned via this reference
+	 * @param page  	Reference to page pointer, set to the frame holding the page
+	 * @param hint  	Access hint; BufHint::NORMAL means the pool's default hint
+	 */
+  void allocPage(File* file, PageId &PageNo, Page*& page, BufHint hint = BufHint::NORMAL);
+
+	/**
+	 * Write back and drop all pages of the file from its pool.  See BufMgr::flushFile().
+	 *
+	 * @param file   	File object
+	 */
+  void flushFile(const File* file);
+
+	/**
+	 * Delete a page from the file and from its pool.  See BufMgr::disposePage().
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number
+	 */
+  void disposePage(File* file, const PageId PageNo);
+
+	/**
+	 * Write back the dirty pages of every pool.  See BufMgr::flushAll().
+	 *
+	 * @return  			Pages and files written, summed over the pools, and the total time taken
+	 */
+  FlushStats flushAll();
+
+	/**
+	 * Get the usage statistics of one pool.
+	 *
+	 * @param name   	Name of the pool
+	 * @throws  PoolNotFoundException If there is no pool of that name
+	 */
+  BufStats getBufStats(const std::string& name);
+
+ private:
+	/**
+   * @brief A pool and its default hint
+	 */
+  struct Pool {
+    BufMgr* mgr;
+    BufHint hint;
+  };
+
+	/**
+   * Pools by name
+	 */
+  std::map<std::string, Pool> pools;
+
+	/**
+   * Pool of each file assigned to one other than the default pool
+	 */
+  std::map<const File*, Pool*> assignments;
+
+	/**
+   * Guards pools and assignments; the pools themselves do their own locking
+	 */
+  std::mutex poolsLock;
+
+	/**
+	 * Return the pool a file is assigned to.
+	 *
+	 * @param file   	File object
+	 */
+  Pool& route(const File* file);
+
+	/**
+	 * Return a pool by name.
+	 *
+	 * @param name   	Name of the pool
+	 * @throws  PoolNotFoundException If there is no pool of that name
+	 */
+  Pool& find(const std::string& name);
+};
+
+}
@@ -7,7 +7,17 @@
 
 #include <memory>
 #include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <atomic>
+#include <exception>
+#include <map>
+#include <new>
+#include <sys/mman.h>
 #include "buffer.h"
+#include "exceptions/file_io_exception.h"
 #include "exceptions/buffer_exceeded_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
@@ -18,34 +28,118 @@
 
 namespace badgerdb {
 
-    BufMgr::BufMgr(std::uint32_t bufs)
-            : numBufs(bufs) {
-        bufDescTable = new BufDesc[bufs];
+    namespace {
+        /**
+         * Reserve zero-filled memory without committing it; pages are faulted in when first touched.
+         */
+        void *reserveZeroed(std::size_t bytes) {
+            void *addr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (addr == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+            return addr;
+        }
+
+        /**
+         * Frame a thread last found a page in, and the frame's generation at that time.
+         */
+        struct FrameHint {
+            std::uint64_t mgr;
+            const File *file;
+            PageId pageNo;
+            FrameId frame;
+            std::uint32_t gen;
+        };
+
+        /**
+         * Number of frame hints each thread keeps; a power of two.
+         */
+        const std::size_t HINT_SLOTS = 64;
+
+        /**
+         * Frame hints of the calling thread, direct-mapped on (file, page) and shared by all buffer managers.
+         * Slots with mgr 0 are empty.
+         */
+        thread_local FrameHint frameHints[HINT_SLOTS];
 
-        for (FrameId i = 0; i < bufs; i++) {
-            bufDescTable[i].frameNo = i;
-            bufDescTable[i].valid = false;
+        std::atomic<std::uint64_t> nextInstanceId(1);
+
+        FrameHint &hintSlot(const File *file, PageId pageNo) {
+            const std::size_t h = (reinterpret_cast<std::uintptr_t>(file) >> 4) * 31 + pageNo;
+            return frameHints[h & (HINT_SLOTS - 1)];
         }
+    }
 
-        bufPool = new Page[bufs];
+    BufMgr::BufMgr(std::uint32_t bufs)
+            : instanceId(nextInstanceId++), numBufs(bufs), residentFrames(0), compressedTier(NULL), l2Cache(NULL), prefetcher(NULL), ioEngine(NULL),
+              allocTimeout(0), nextTicket(0), warmInterval(0), warmSaverStop(false), warmLoaderStop(false),
+              prefetchStop(false), prefetchReading(false) {
+        // Neither table is touched here, so startup does not depend on the pool size
+        bufDescTable = static_cast<BufDesc *>(reserveZeroed(sizeof(BufDesc) * bufs));
+        // Frames are whole pages from a page-aligned base, so each one is aligned for direct I/O
+        bufPool = static_cast<Page *>(reserveZeroed(sizeof(Page) * bufs));
+        // The bitmaps and per-frame counters start out zero, so they are reserved the same way
+        const std::size_t bitmapWords = FrameBitmap::wordsFor(bufs);
+        FrameBitmap *const bitmaps[] = {&validBits, &dirtyBits, &refBits, &pinnedBits, &holdBits};
+        const std::size_t numBitmaps = sizeof(bitmaps) / sizeof(bitmaps[0]);
+        frameStateBytes = sizeof(std::uint64_t) * bitmapWords * numBitmaps + sizeof(std::uint32_t) * bufs * 4;
+        frameState = reserveZeroed(frameStateBytes);
+        std::uint64_t *words = static_cast<std::uint64_t *>(frameState);
+        for (std::size_t b = 0; b < numBitmaps; b++) {
+            bitmaps[b]->place(words + b * bitmapWords);
+        }
+        std::uint32_t *counters = reinterpret_cast<std::uint32_t *>(words + numBitmaps * bitmapWords);
+        pinCounts = counters;
+        frameGens = counters + bufs;
+        nextFrames = counters + 2 * (std::size_t) bufs;
+        nextGens = counters + 3 * (std::size_t) bufs;
 
         int htsize = ((((int) (bufs * 1.2)) * 2) / 2) + 1;
-        hashTable = new BufHashTbl(htsize);  // allocate the buffer hash table
+        hashTable = new PageTable(htsize);  // allocate the buffer hash table
 
         clockHand = bufs - 1;
+
+        setResidentShare(0.25);
     }
 
 
     BufMgr::~BufMgr() {
-        // Clear the buf desc table
-        for (std::uint32_t i = 0; i < numBufs; i++) {
-            if (bufDescTable[i].dirty) {
-                bufDescTable[i].file->writePage(bufPool[i]);
-            }
+        stopWarmSaver();
+        {
+            std::lock_guard<std::mutex> lock(bufLock);
+            warmLoaderStop = true;
+        }
+        if (warmLoader.joinable()) {
+            warmLoader.join();
+        }
+        {
+            std::lock_guard<std::mutex> lock(bufLock);
+            prefetchStop = true;
+        }
+        prefetchWake.notify_all();
+        if (prefetchThread.joinable()) {
+            prefetchThread.join();
+        }
+        try {
+            saveResidentSet();
+        } catch (FileIOException &e) {
+            std::cout << e.message() << std::endl;
+        }
+
+        try {
+            std::lock_guard<std::mutex> lock(bufLock);
+            writeDirtyPages(FlushProgress(), true);
+        } catch (BadgerDbException &e) {
+            std::cout << e.message() << std::endl;
         }
-        delete[] bufDescTable;
-        delete[] bufPool;
+        munmap(bufDescTable, sizeof(BufDesc) * numBufs);
+        munmap(bufPool, sizeof(Page) * numBufs);
+        munmap(frameState, frameStateBytes);
         delete hashTable;
+        delete compressedTier;
+        delete l2Cache;
+        delete prefetcher;
+        delete ioEngine;
     }
 
     void BufMgr::advanceClock() {
@@ -53,100 +147,676 @@ namespace badgerdb {
     }
 
 
-    void BufMgr::allocBuf(FrameId &frame) {
-        // While page not found, keep looking for it
+    void BufMgr::allocBuf(FrameId &frame, const File *file) {
+        const std::uint32_t tenant = tenantOf(file);
+        std::map<std::uint32_t, TenantStats>::iterator quota = tenants.find(tenant);
+        // A tenant at its maximum makes room among its own pages
+        const bool ownOnly = quota != tenants.end() && quota->second.frames >= quota->second.maxFrames;
+        // Other tenants keep their minimum
+        auto atMinimum = [this](std::uint32_t other) {
+            std::map<std::uint32_t, TenantStats>::const_iterator found = tenants.find(other);
+            return found != tenants.end() && found->second.frames <= found->second.minFrames;
+        };
+        bool restricted = ownOnly;
+        for (std::map<std::uint32_t, TenantStats>::const_iterator it = tenants.begin();
+             !restricted && it != tenants.end(); ++it) {
+            restricted = it->first != tenant && it->second.minFrames > 0 && it->second.frames <= it->second.minFrames;
+        }
+
+        // Released USE_ONCE pages are first in line, ahead of the clock
+        while (!ownOnly && !useOnceQueue.empty()) {
+            FrameId candidate = useOnceQueue.front();
+            useOnceQueue.pop_front();
+            BufDesc *desc = &bufDescTable[candidate];
+            desc->queued = false;
+            // The entry may be stale if the frame was reused or re-pinned since it was queued
+            if (validBits.test(candidate) && desc->hint == BufHint::USE_ONCE && pinCounts[candidate] == 0 &&
+                !desc->resident && (desc->tenant == tenant || !atMinimum(desc->tenant))) {
+                evictFrame(candidate);
+                frame = candidate;
+                return;
+            }
+        }
+
+        // The hand moves up to the end of a 64-frame word at a time.  In each word the victim is the first
+        // free frame, or the first unpinned, unreferenced frame with no hold on it; every frame the hand passes
+        // before that has its reference bit cleared, as in a frame-by-frame clock.  Frames that are held
+        // resident or have KEEP_HOT sweeps left are few and looked at one by one.
+        // Pinned and resident frames are counted once per sweep, the count starting over each time the hand
+        // wraps to frame 0, so the search only gives up after a whole sweep in which nothing could be taken.
+        // Frames out of reach because of quotas are not counted as pinned; the step limit covers them, since
+        // any evictable frame is taken within that many sweeps.
         std::uint32_t countPinnLargerThan0 = 0;
-        while (countPinnLargerThan0 < numBufs) {
+        const std::uint64_t maxSteps = (std::uint64_t) numBufs * (KEEP_HOT_SWEEPS + 3);
+        std::uint64_t steps = 0;
+        while (countPinnLargerThan0 < numBufs && steps < maxSteps) {
+            const FrameId start = (clockHand + 1) % numBufs;
+            if (start == 0) {
+                countPinnLargerThan0 = 0;
+            }
+            const std::size_t w = start / 64;
+            const FrameId base = w * 64;
+            const FrameId end = std::min<FrameId>(base + 64, numBufs);
+            const std::uint64_t span = (end - base == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << (end - base)) - 1) &
+                                       (~std::uint64_t(0) << (start - base));
+
+            // Frames the hand may act on; with quotas in force, those of protected tenants are left alone
+            std::uint64_t reach = span;
+            if (restricted) {
+                for (FrameId f = start; f < end; f++) {
+                    const bool outOfReach = validBits.test(f) ?
+                                            bufDescTable[f].tenant != tenant && (ownOnly || atMinimum(bufDescTable[f].tenant)) :
+                                            ownOnly;
+                    if (outOfReach) {
+                        reach &= ~(std::uint64_t(1) << (f - base));
+                    }
+                }
+            }
 
-            // Advance clock pointer
-            advanceClock();
+            const std::uint64_t valid = validBits.word(w);
+            const std::uint64_t ref = refBits.word(w);
+            const std::uint64_t pinned = pinnedBits.word(w);
+            const std::uint64_t hold = holdBits.word(w);
+            const std::uint64_t victims = reach & (~valid | (~ref & ~pinned & ~hold));
+            const std::uint64_t victimBit = victims & (~victims + 1);
+            // Frames passed on the way to the victim, or the whole span if there is none
+            const std::uint64_t passed = reach & (victimBit - 1) & valid;
 
-            //Check if the current frame is valid set
-            //If no
-            // then use the frame
-            BufDesc *cur = &bufDescTable[clockHand];
-            if (!cur->valid) {
+            refBits.word(w) &= ~(passed & ~hold);
+            countPinnLargerThan0 += __builtin_popcountll(passed & ~hold & ~ref & pinned);
+            for (std::uint64_t held = passed & hold; held != 0; held &= held - 1) {
+                const FrameId f = base + __builtin_ctzll(held);
+                BufDesc *cur = &bufDescTable[f];
+                // Resident frames are never evicted, treat them like pinned ones
+                if (cur->resident) {
+                    countPinnLargerThan0++;
+                } else if (refBits.test(f)) {
+                    refBits.reset(f);
+                } else if (pinnedBits.test(f)) {
+                    countPinnLargerThan0++;
+                } else {
+                    // KEEP_HOT pages get a few more sweeps before they become victims
+                    cur->retain--;
+                    updateHold(f);
+                }
+            }
+
+            if (victimBit != 0) {
+                clockHand = base + __builtin_ctzll(victimBit);
+                steps += clockHand - start + 1;
                 frame = clockHand;
+                if (validBits.test(frame)) {
+                    evictFrame(frame);
+                }
                 return;
             }
+            clockHand = end - 1;
+            steps += end - start;
+        }
+        //If all the buffer frames are pinned, throw bufferExceededException
+        throw BufferExceededException();
+    }
 
-            //if valid, check if refbit is set
-            if (cur->refbit) {
-                //if so, clear refbit
-                cur->refbit = false;
-                // go back to advance clock
-                continue;
+    void BufMgr::evictFrame(FrameId frame) {
+        BufDesc *cur = &bufDescTable[frame];
+        if (dirtyBits.test(frame)) { //If the dirty bit is set, flush page to disk first
+            cur->file->writePage(bufPool[frame]);
+            bufStats.diskwrites++;
+        }
+        hashTable->remove(cur->file, cur->pageNo);
+        unchargeTenant(frame);
+        // The page on disk is now current, keep a compressed copy around
+        if (compressedTier) {
+            compressedTier->insert(cur->file, cur->pageNo, bufPool[frame]);
+        }
+        if (l2Cache) {
+            l2Cache->insert(cur->file, cur->pageNo, bufPool[frame]);
+        }
+    }
+
+    void BufMgr::setFrame(FrameId frame, File *file, PageId pageNo) {
+        bufDescTable[frame].Set(file, pageNo);
+        validBits.set(frame);
+        refBits.set(frame);
+        dirtyBits.reset(frame);
+        holdBits.reset(frame);
+        pinCounts[frame] = 1;
+        pinnedBits.set(frame);
+        frameGens[frame]++;
+    }
+
+    void BufMgr::clearFrame(FrameId frame) {
+        bufDescTable[frame].Clear();
+        validBits.reset(frame);
+        refBits.reset(frame);
+        dirtyBits.reset(frame);
+        holdBits.reset(frame);
+        pinCounts[frame] = 0;
+        pinnedBits.reset(frame);
+        frameGens[frame]++;
+    }
+
+    void BufMgr::updateHold(FrameId frame) {
+        holdBits.assign(frame, bufDescTable[frame].resident || bufDescTable[frame].retain > 0);
+    }
+
+    bool BufMgr::lookupFrame(const File *file, const PageId pageNo, FrameId &frame) {
+        FrameHint &hint = hintSlot(file, pageNo);
+        if (hint.mgr == instanceId && hint.file == file && hint.pageNo == pageNo &&
+            frameGens[hint.frame] == hint.gen) {
+            bufStats.hintHits++;
+            frame = hint.frame;
+            return true;
+        }
+        bufStats.hintMisses++;
+        try {
+            hashTable->lookup(file, pageNo, frame);
+        } catch (HashNotFoundException &e) {
+            return false;
+        }
+        rememberFrame(file, pageNo, frame);
+        return true;
+    }
+
+    void BufMgr::rememberFrame(const File *file, const PageId pageNo, FrameId frame) {
+        FrameHint &hint = hintSlot(file, pageNo);
+        hint.mgr = instanceId;
+        hint.file = file;
+        hint.pageNo = pageNo;
+        hint.frame = frame;
+        hint.gen = frameGens[frame];
+    }
+
+    void BufMgr::applyHint(FrameId frame, BufHint hint, bool newPage) {
+        BufDesc *desc = &bufDescTable[frame];
+        // A USE_ONCE page touched again without the hint turned out to be reused
+        if (!newPage && desc->hint == BufHint::USE_ONCE && hint != BufHint::USE_ONCE) {
+            desc->hint = BufHint::NORMAL;
+        }
+
+        switch (hint) {
+            case BufHint::NORMAL:
+                break;
+            case BufHint::USE_ONCE:
+                // Only demote pages we brought in; a page others are using stays as it is
+                if (newPage) {
+                    desc->hint = BufHint::USE_ONCE;
+                    refBits.reset(frame);
+                }
+                break;
+            case BufHint::RESIDENT:
+                if (desc->resident) {
+                    break;
+                }
+                if (residentFrames < maxResident) {
+                    desc->resident = true;
+                    desc->hint = BufHint::RESIDENT;
+                    residentFrames++;
+                    holdBits.set(frame);
+                    break;
+                }
+                // Out of resident share, fall back to the strongest evictable treatment
+                bufStats.residentDenied++;
+                // fall through
+            case BufHint::KEEP_HOT:
+                if (!desc->resident) {
+                    desc->hint = BufHint::KEEP_HOT;
+                }
+                desc->retain = KEEP_HOT_SWEEPS;
+                holdBits.set(frame);
+                break;
+        }
+    }
+
+    void BufMgr::dropResident(FrameId frame) {
+        BufDesc *desc = &bufDescTable[frame];
+        if (desc->resident) {
+            desc->resident = false;
+            desc->hint = BufHint::NORMAL;
+            residentFrames--;
+            updateHold(frame);
+        }
+    }
+
+
+    bool BufMgr::acquireFrame(std::unique_lock<std::mutex> &lock, FrameId &frame, const File *file) {
+        if (allocTimeout.count() == 0) {
+            allocBuf(frame, file);
+            return false;
+        }
+
+        // Waiters are served in arrival order, so a newcomer only tries directly when nobody is queued
+        if (waitQueue.empty()) {
+            try {
+                allocBuf(frame, file);
+                return false;
+            } catch (BufferExceededException &e) {
+            }
+        }
+
+        const std::uint64_t ticket = nextTicket++;
+        waitQueue.push_back(ticket);
+        bufStats.waits++;
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        const std::chrono::steady_clock::time_point deadline = start + allocTimeout;
+        bool acquired = false;
+        while (!acquired) {
+            if (frameFreed.wait_until(lock, deadline) == std::cv_status::timeout) {
+                break;
             }
-            if (cur->pinCnt >
-                0) { //If refbit not set, check if the page is pinned
-                // if pinned, advance clock, increment count of pinned frames
-                countPinnLargerThan0++;
+            if (waitQueue.front() != ticket) {
                 continue;
             }
-            if (cur->dirty) { //If not, check if the dirty bit is set
-                //If yes, flush page to disk and use the page
-                cur->file->writePage(bufPool[cur->frameNo]);
+            try {
+                allocBuf(frame, file);
+                acquired = true;
+            } catch (BufferExceededException &e) {
             }
-            // if it is not dirty,  use the frame
-            hashTable->remove(cur->file, cur->pageNo);
-            frame = clockHand;
+        }
 
-            return;
+        waitQueue.erase(std::find(waitQueue.begin(), waitQueue.end(), ticket));
+        // Let the next in line have a go
+        frameFreed.notify_all();
+        bufStats.waitMicros += std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        if (!acquired) {
+            bufStats.waitTimeouts++;
+            throw BufferExceededException();
         }
-        //If all the buffer frames are pinned, throw bufferExceededException
-        throw BufferExceededException();
+        return true;
+    }
+
+    void BufMgr::pinFrame(FrameId frame, BufHint hint) {
+        // Set the refbit, unless the caller says it will not come back
+        if (hint != BufHint::USE_ONCE) {
+            refBits.set(frame);
+        }
+        // Increment the pin count
+        pinCounts[frame]++;
+        pinnedBits.set(frame);
+        applyHint(frame, hint, false);
     }
 
+    void BufMgr::pinHit(File *file, const PageId pageNo, FrameId frame, BufHint hint, Page *&page) {
+        pinFrame(frame, hint);
+        page = &bufPool[frame];
+        // First use of a prefetched page, it would have been a miss
+        if (bufDescTable[frame].prefetched) {
+            bufDescTable[frame].prefetched = false;
+            prefetcher->stats().useful++;
+            prefetchAfter(file, pageNo);
+        }
+    }
 
-    void BufMgr::readPage(File *file, const PageId pageNo, Page *&page) {
+    void BufMgr::readPage(File *file, const PageId pageNo, Page *&page, BufHint hint) {
+        std::unique_lock<std::mutex> lock(bufLock);
+        bufStats.accesses++;
+        TenantStats &usage = tenants[tenantOf(file)];
+        usage.accesses++;
         // Case 1: page is in the buffer pool
         FrameId frameId;
+        if (lookupFrame(file, pageNo, frameId)) {
+            usage.hits++;
+            pinHit(file, pageNo, frameId, hint, page);
+            return;
+        }
+
+        // Case2: the page is not in the buffer
+        Page curPage;
+        const Page *contents = &curPage;
+        if (!fetchCached(file, pageNo, curPage)) {
+            if (file->mode() == FileMode::DIRECT) {
+                // Read into the frame itself; with no kernel copy there is no point in making one of our own
+                contents = NULL;
+            } else {
+                file->readPage(pageNo, curPage);
+                bufStats.diskreads++;
+            }
+        }
+        if (!installPage(lock, file, pageNo, contents, hint, page)) {
+            return;
+        }
+
+        if (prefetcher && prefetcher->enabled(file)) {
+            prefetcher->stats().misses++;
+            prefetchAfter(file, pageNo);
+        }
+    }
+
+    bool BufMgr::installPage(std::unique_lock<std::mutex> &lock, File *file, const PageId pageNo,
+                             const Page *contents, BufHint hint, Page *&page) {
+        // Find the spot and replace the page inside the picked frame
+        FrameId frameId;
+        if (acquireFrame(lock, frameId, file)) {
+            // The lock was released while waiting, someone else may have brought the page in
+            FrameId otherFrame;
+            try {
+                hashTable->lookup(file, pageNo, otherFrame);
+                clearFrame(frameId);
+                frameFreed.notify_all();
+                pinFrame(otherFrame, hint);
+                page = &bufPool[otherFrame];
+                return false;
+            } catch (HashNotFoundException &e) {
+            }
+            // The copy read before waiting may be stale: the page could have been changed in the pool and
+            // written back while we waited, so read it again
+            contents = NULL;
+        }
+        // Read the page from the file and insert it into the buf pool
+        if (contents != NULL) {
+            bufPool[frameId] = *contents;
+        } else {
+            try {
+                file->readPage(pageNo, bufPool[frameId]);
+            } catch (...) {
+                clearFrame(frameId);
+                frameFreed.notify_all();
+                throw;
+            }
+            bufStats.diskreads++;
+        }
+        // Insert the page into the hash table
+        hashTable->insert(file, pageNo, frameId);
+        // Set the page in the desc table
+        setFrame(frameId, file, pageNo);
+        chargeTenant(frameId);
+        applyHint(frameId, hint, true);
+        rememberFrame(file, pageNo, frameId);
+        // return the pointer to the page
+        page = &bufPool[frameId];
+        return true;
+    }
+
+    void BufMgr::readPages(File *file, const std::vector<PageId> &pageNos, std::vector<Page *> &pages, BufHint hint) {
+        pages.assign(pageNos.size(), NULL);
+        if (!ioEngine) {
+            for (std::size_t i = 0; i < pageNos.size(); i++) {
+                readPage(file, pageNos[i], pages[i], hint);
+            }
+            return;
+        }
+
+        // Pin the pages already cached and read all the others at once, with the lock released
+        std::vector<std::size_t> missing;
+        std::unique_lock<std::mutex> lock(bufLock);
+        for (std::size_t i = 0; i < pageNos.size(); i++) {
+            bufStats.accesses++;
+            TenantStats &usage = tenants[tenantOf(file)];
+            usage.accesses++;
+            FrameId frameId;
+            if (lookupFrame(file, pageNos[i], frameId)) {
+                usage.hits++;
+                pinHit(file, pageNos[i], frameId, hint, pages[i]);
+            } else {
+                missing.push_back(i);
+            }
+        }
+        if (missing.empty()) {
+            return;
+        }
+        // Pages are only written back from the pool with the lock held, so a version taken now changes if a
+        // page is brought in, changed and written back while we read without it
+        std::vector<std::uint64_t> versions(missing.size());
+        for (std::size_t k = 0; k < missing.size(); k++) {
+            versions[k] = file->pageVersion(pageNos[missing[k]]);
+        }
+        lock.unlock();
+
+        std::vector<Page> contents(missing.size());
+        std::vector<std::future<void> > reads;
+        for (std::size_t k = 0; k < missing.size(); k++) {
+            reads.push_back(ioEngine->read(file, pageNos[missing[k]], &contents[k]));
+        }
+        ioEngine->submit();
+        std::exception_ptr error;
+        for (std::size_t k = 0; k < reads.size(); k++) {
+            try {
+                reads[k].get();
+            } catch (...) {
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+
         try {
-            hashTable->lookup(file, pageNo, frameId);
-            page = &bufPool[frameId];
-            // Set the refbit
-            bufDescTable[frameId].refbit = true;
-            // Increment the pin count
-            bufDescTable[frameId].pinCnt++;
+            if (error) {
+                std::rethrow_exception(error);
+            }
+            lock.lock();
+            for (std::size_t k = 0; k < missing.size(); k++) {
+                const std::size_t i = missing[k];
+                bufStats.diskreads++;
+                // A page listed twice, or brought in by someone else while we were reading
+                FrameId frameId;
+                if (lookupFrame(file, pageNos[i], frameId)) {
+                    pinHit(file, pageNos[i], frameId, hint, pages[i]);
+                } else if (file->pageVersion(pageNos[i]) != versions[k]) {
+                    // Our copy is stale, read the page again
+                    installPage(lock, file, pageNos[i], NULL, hint, pages[i]);
+                } else {
+                    installPage(lock, file, pageNos[i], &contents[k], hint, pages[i]);
+                }
+            }
+        } catch (...) {
+            // All or nothing, like readPage()
+            if (lock.owns_lock()) {
+                lock.unlock();
+            }
+            for (std::size_t i = 0; i < pages.size(); i++) {
+                if (pages[i] != NULL) {
+                    unPinPage(file, pageNos[i], false);
+                    pages[i] = NULL;
+                }
+            }
+            throw;
+        }
+    }
+
+    bool BufMgr::readNextPage(File *file, const Page *current, Page *&next, BufHint hint) {
+        const PageId nextNo = current->next_page_number();
+        if (nextNo == Page::INVALID_NUMBER) {
+            return false;
+        }
+        // Pages not in the pool have no links to follow
+        if (current < bufPool || current >= bufPool + numBufs) {
+            readPage(file, nextNo, next, hint);
+            return true;
+        }
+        const FrameId frame = current - bufPool;
+        {
+            std::lock_guard<std::mutex> lock(bufLock);
+            const FrameId target = nextFrames[frame];
+            // The link is good while the target frame has not been given another page since it was made;
+            // evicting the page bumps the frame's generation, which unswizzles every link to it
+            if (nextGens[frame] == frameGens[target] && validBits.test(target) &&
+                bufDescTable[target].file == file && bufDescTable[target].pageNo == nextNo) {
+                bufStats.accesses++;
+                bufStats.swizzleHits++;
+                TenantStats &usage = tenants[tenantOf(file)];
+                usage.accesses++;
+                usage.hits++;
+                pinHit(file, nextNo, target, hint, next);
+                return true;
+            }
+        }
+
+        readPage(file, nextNo, next, hint);
+        // Both pages are pinned, so neither frame can change under us
+        std::lock_guard<std::mutex> lock(bufLock);
+        const FrameId target = next - bufPool;
+        nextFrames[frame] = target;
+        nextGens[frame] = frameGens[target];
+        return true;
+    }
+
+    bool BufMgr::fetchCached(File *file, const PageId pageNo, Page &page) {
+        return (compressedTier && compressedTier->fetch(file, pageNo, page)) ||
+               (l2Cache && l2Cache->fetch(file, pageNo, page));
+    }
+
+    void BufMgr::prefetchAfter(File *file, const PageId pageNo) {
+        prefetcher->record(file, pageNo);
+        // Frames are for the requests waiting in line, not for guesses
+        if (!waitQueue.empty()) {
             return;
-        } catch (HashNotFoundException &e) {
-            // Case2: the page is not in the buffer
+        }
+
+        std::vector<Prefetcher::PageKey> successors;
+        prefetcher->predict(file, pageNo, successors);
+        bool queued = false;
+        for (std::size_t i = 0; i < successors.size() && prefetchQueue.size() < PREFETCH_QUEUE; i++) {
+            FrameId frameId;
             try {
-                Page curPage = file->readPage(pageNo);
-                // Find the spot and replace the page inside the picked frame
-                allocBuf(frameId);
-                // Read the page from the file and insert it into the buf pool
-                bufPool[frameId] = curPage;
-                // Insert the page into the hash table
-                hashTable->insert(file, pageNo, frameId);
-                // Set the page in the desc table
-                bufDescTable[frameId].Set(file, pageNo);
-                // return the pointer to the page
-                page = &bufPool[frameId];
+                hashTable->lookup(successors[i].first, successors[i].second, frameId);
+                continue;
+            } catch (HashNotFoundException &e) {
+            }
+            if (std::find(prefetchQueue.begin(), prefetchQueue.end(), successors[i]) == prefetchQueue.end()) {
+                prefetchQueue.push_back(successors[i]);
+                queued = true;
+            }
+        }
+        if (!queued) {
+            return;
+        }
+        if (!prefetchThread.joinable()) {
+            prefetchThread = std::thread(&BufMgr::runPrefetcher, this);
+        }
+        prefetchWake.notify_all();
+    }
+
+    void BufMgr::runPrefetcher() {
+        std::unique_lock<std::mutex> lock(bufLock);
+        while (true) {
+            prefetchWake.wait(lock, [this]() { return prefetchStop || !prefetchQueue.empty(); });
+            if (prefetchStop) {
                 return;
-            } catch (BufferExceededException &e) {
-                std::cout << e.message() << std::endl;
-                exit(-1);
             }
+            std::vector<std::pair<File *, PageId> > queued;
+            queued.swap(prefetchQueue);
+            // Pick the pages still worth reading, taking those the in-memory tiers hold straight away
+            std::vector<std::pair<File *, PageId> > batch;
+            std::vector<std::uint64_t> versions;
+            for (std::size_t k = 0; k < queued.size() && prefetcher && waitQueue.empty(); k++) {
+                File *file = queued[k].first;
+                const PageId pageNo = queued[k].second;
+                FrameId frameId;
+                try {
+                    hashTable->lookup(file, pageNo, frameId);
+                    continue;
+                } catch (HashNotFoundException &e) {
+                }
+                Page cached;
+                if (fetchCached(file, pageNo, cached)) {
+                    installPrefetched(file, pageNo, cached);
+                    continue;
+                }
+                batch.push_back(queued[k]);
+                versions.push_back(file->pageVersion(pageNo));
+            }
+
+            if (!batch.empty()) {
+                // Read with the lock released, so neither the miss that made the prediction nor anyone else
+                // waits for it
+                prefetchReading = true;
+                lock.unlock();
+                std::vector<Page> contents;
+                std::vector<bool> read;
+                bool failed = false;
+                try {
+                    readUnlocked(batch, contents, read);
+                } catch (FileIOException &e) {
+                    // Prefetching is only an optimization, skip the batch
+                    failed = true;
+                }
+                lock.lock();
+                prefetchReading = false;
+
+                for (std::size_t k = 0; !failed && k < batch.size(); k++) {
+                    if (!read[k]) {
+                        // Deleted since we learned about it
+                        continue;
+                    }
+                    File *file = batch[k].first;
+                    const PageId pageNo = batch[k].second;
+                    bufStats.diskreads++;
+                    // Frames are for the requests waiting in line, and a disabled prefetcher predicts nothing
+                    if (!prefetcher || !waitQueue.empty()) {
+                        break;
+                    }
+                    FrameId frameId;
+                    try {
+                        hashTable->lookup(file, pageNo, frameId);
+                        continue;
+                    } catch (HashNotFoundException &e) {
+                    }
+                    // Changed and written back while we read it
+                    if (file->pageVersion(pageNo) != versions[k]) {
+                        continue;
+                    }
+                    if (!installPrefetched(file, pageNo, contents[k])) {
+                        break;
+                    }
+                }
+            }
+            prefetchWake.notify_all();
+        }
+    }
+
+    bool BufMgr::installPrefetched(File *file, const PageId pageNo, const Page &contents) {
+        FrameId frameId;
+        try {
+            allocBuf(frameId, file);
+        } catch (BufferExceededException &e) {
+            return false;
         }
+        bufPool[frameId] = contents;
+        hashTable->insert(file, pageNo, frameId);
+        setFrame(frameId, file, pageNo);
+        chargeTenant(frameId);
+        pinCounts[frameId] = 0;
+        pinnedBits.reset(frameId);
+        bufDescTable[frameId].prefetched = true;
+        prefetcher->stats().issued++;
+        return true;
+    }
+
+    void BufMgr::waitPrefetch() {
+        std::unique_lock<std::mutex> lock(bufLock);
+        prefetchWake.wait(lock, [this]() { return prefetchStop || (prefetchQueue.empty() && !prefetchReading); });
     }
 
     void BufMgr::unPinPage(File *file, const PageId pageNo, const bool dirty) {
+        std::lock_guard<std::mutex> lock(bufLock);
         FrameId frameId;
         try {
             // Check if the picked page is in the buffer
-            hashTable->lookup(file, pageNo, frameId);
+            if (!lookupFrame(file, pageNo, frameId)) {
+                throw HashNotFoundException(file->filename(), pageNo);
+            }
             // Get the frame
             BufDesc *desc = &bufDescTable[frameId];
             // Check if the pinCnt is 0
-            if (desc->pinCnt <= 0) {
+            if (pinCounts[frameId] == 0) {
                 throw PageNotPinnedException(file->filename(), pageNo, frameId);
             }
             // Decrement the pinCnt;
-            desc->pinCnt--;
+            if (--pinCounts[frameId] == 0) {
+                pinnedBits.reset(frameId);
+            }
             // If it is dirty, set the dirty bit
             if (dirty) {
-                desc->dirty = true;
+                dirtyBits.set(frameId);
+            }
+            // A released USE_ONCE page queues up for eviction
+            if (pinCounts[frameId] == 0 && desc->hint == BufHint::USE_ONCE && !desc->queued) {
+                desc->queued = true;
+                useOnceQueue.push_back(frameId);
+            }
+            if (pinCounts[frameId] == 0) {
+                frameFreed.notify_all();
             }
         } catch (HashNotFoundException &e) {
             std::cout << "Cannot find the page trying to unpinning" << std::endl;
@@ -156,31 +826,49 @@ namespace badgerdb {
     }
 
     void BufMgr::flushFile(const File *file) {
+        std::unique_lock<std::mutex> lock(bufLock);
+        // The file object may go away after a flush, so the prefetch thread must be done reading from it
+        prefetchWake.wait(lock, [this]() { return !prefetchReading; });
+        prefetchQueue.erase(std::remove_if(prefetchQueue.begin(), prefetchQueue.end(),
+                                           [file](const std::pair<File *, PageId> &key) {
+                                               return key.first == file;
+                                           }),
+                            prefetchQueue.end());
+        File *written = NULL;
         // Scan bufTable for pages belonging to the file
         for (uint32_t i = 0; i < numBufs; i++) {
             BufDesc *buf = &bufDescTable[i];
-            // TODO: might not be the same file
-            // If the page belong to the file is not valid, throw BadBUfferException
-            if (!buf->valid) {
-                throw BadBufferException(buf->frameNo, buf->dirty, buf->valid, buf->refbit);
-            }
             if (buf->file == file) {
+                // If the page belong to the file is not valid, throw BadBUfferException
+                if (!validBits.test(i)) {
+                    throw BadBufferException(i, dirtyBits.test(i), false, refBits.test(i));
+                }
                 // If the page is pinned throw PagePinnedException
-                if (buf->pinCnt > 0) {
-                    throw PagePinnedException(file->filename(), buf->pageNo, buf->frameNo);
+                if (pinCounts[i] > 0) {
+                    throw PagePinnedException(file->filename(), buf->pageNo, i);
                 }
                 // If the page is dirty, write the page to the file
                 // TODO: might not need to catch InvalidPageException
 
-                if (buf->dirty) {
+                if (dirtyBits.test(i)) {
                     try {
-                        buf->file->writePage(bufPool[buf->frameNo]);
+                        buf->file->writePage(bufPool[i]);
+                        bufStats.diskwrites++;
+                        written = buf->file;
                     } catch (InvalidPageException &e) {
                         std::cout << "Trying flush file" << e.message() << std::endl;
                         exit(-1);
                     }
                 }
-
+            }
+        }
+        // The pages are forced to disk before they leave the pool; if that fails they stay, still dirty
+        if (written != NULL) {
+            written->sync();
+        }
+        for (uint32_t i = 0; i < numBufs; i++) {
+            BufDesc *buf = &bufDescTable[i];
+            if (buf->file == file) {
                 // Remove the page form the hash table
                 // TODO: may not need to catch the hashNotFound error
                 try {
@@ -190,18 +878,38 @@ namespace badgerdb {
                     exit(-1);
                 }
                 // Clear the page frame
-                buf->Clear();
+                dropResident(i);
+                unchargeTenant(i);
+                clearFrame(i);
+                frameFreed.notify_all();
             }
         }
+        // The file object may go away after a flush, so forget its compressed pages too
+        if (compressedTier) {
+            compressedTier->invalidateFile(file);
+        }
+        if (prefetcher) {
+            prefetcher->forgetFile(file);
+        }
     }
 
-    void BufMgr::allocPage(File *file, PageId &pageNo, Page *&page) {
-        // Invoke empty page
-        Page curPage = file->allocatePage();
-
-        // Get a buffer pool frame
+    void BufMgr::allocPage(File *file, PageId &pageNo, Page *&page, BufHint hint) {
+        std::unique_lock<std::mutex> lock(bufLock);
+        // Get a buffer pool frame first, so that a page is never allocated in the file with nowhere to put it
         FrameId frameId;
-        allocBuf(frameId);
+        acquireFrame(lock, frameId, file);
+
+        // Invoke empty page
+        Page curPage;
+        try {
+            curPage = file->allocatePage();
+        } catch (...) {
+            clearFrame(frameId);
+            frameFreed.notify_all();
+            throw;
+        }
+        bufStats.accesses++;
+        bufStats.diskreads++;
 
         // Entry into hash table
         try {
@@ -215,7 +923,10 @@ namespace badgerdb {
         }
 
         // Call the set on the buf table
-        bufDescTable[frameId].Set(file, curPage.page_number());
+        setFrame(frameId, file, curPage.page_number());
+        chargeTenant(frameId);
+        applyHint(frameId, hint, true);
+        rememberFrame(file, curPage.page_number(), frameId);
 
         // Isnert the page into the bufPool;
         bufPool[frameId] = curPage;
@@ -226,33 +937,568 @@ namespace badgerdb {
     }
 
     void BufMgr::disposePage(File *file, const PageId PageNo) {
+        std::lock_guard<std::mutex> lock(bufLock);
         // Try to find the page
         FrameId frameId;
 
         try {
             hashTable->lookup(file, PageNo, frameId);
             // If the page is found in the buffer pool, free the frame and deleter from hashTable
-            bufDescTable[frameId].Clear();
+            dropResident(frameId);
+            unchargeTenant(frameId);
+            clearFrame(frameId);
             hashTable->remove(file, PageNo);
+            frameFreed.notify_all();
 
         } catch (HashNotFoundException &e) {
             // Print some message
             std::cout << "the page trying to dispose is not in the buffer" << e.message() << std::endl;
         }
+        if (compressedTier) {
+            compressedTier->invalidate(file, PageNo);
+        }
+        if (l2Cache) {
+            l2Cache->invalidate(file, PageNo);
+        }
         // Delete the page from the file
         file->deletePage(PageNo);
     }
 
+    void BufMgr::releaseResident(File *file, const PageId pageNo) {
+        std::lock_guard<std::mutex> lock(bufLock);
+        FrameId frameId;
+        try {
+            hashTable->lookup(file, pageNo, frameId);
+        } catch (HashNotFoundException &e) {
+            return;
+        }
+        dropResident(frameId);
+        frameFreed.notify_all();
+    }
+
+    void BufMgr::setResidentShare(double share) {
+        std::lock_guard<std::mutex> lock(bufLock);
+        if (share < 0) {
+            share = 0;
+        } else if (share > 1) {
+            share = 1;
+        }
+        maxResident = (std::uint32_t) (numBufs * share);
+    }
+
+    void BufMgr::enableCompressedTier(std::size_t bytes) {
+        std::lock_guard<std::mutex> lock(bufLock);
+        delete compressedTier;
+        compressedTier = bytes > 0 ? new CompressedTier(bytes) : NULL;
+    }
+
+    void BufMgr::enableL2Cache(const std::string &path, std::uint32_t pages) {
+        std::lock_guard<std::mutex> lock(bufLock);
+        delete l2Cache;
+        l2Cache = NULL;
+        if (pages > 0) {
+            l2Cache = new L2Cache(path, pages);
+        }
+    }
+
+    void BufMgr::enablePrefetcher(std::size_t tablePages, double threshold) {
+        std::lock_guard<std::mutex> lock(bufLock);
+        delete prefetcher;
+        prefetcher = tablePages > 0 ? new Prefetcher(tablePages, threshold) : NULL;
+        prefetchQueue.clear();
+        // Frames read ahead by the previous prefetcher are ordinary pages now
+        for (std::uint32_t i = 0; i < numBufs; i++) {
+            bufDescTable[i].prefetched = false;
+        }
+    }
+
+    void BufMgr::enableAsyncIo(std::uint32_t depth, bool useUring) {
+        std::unique_lock<std::mutex> lock(bufLock);
+        // The prefetch thread may be reading through the engine
+        prefetchWake.wait(lock, [this]() { return !prefetchReading; });
+        delete ioEngine;
+        ioEngine = depth > 0 ? new IoEngine(depth, useUring) : NULL;
+    }
+
+    void BufMgr::setPrefetch(const File *file, bool enabled) {
+        std::lock_guard<std::mutex> lock(bufLock);
+        if (prefetcher) {
+            prefetcher->setEnabled(file, enabled);
+        }
+    }
+
+    std::uint32_t BufMgr::tenantOf(const File *file) const {
+        std::map<const File *, std::uint32_t>::const_iterator found = fileTenants.find(file);
+        return found != fileTenants.end() ? found->second : 0;
+    }
+
+    void BufMgr::chargeTenant(FrameId frame) {
+        BufDesc *desc = &bufDescTable[frame];
+        desc->tenant = tenantOf(desc->file);
+        tenants[desc->tenant].frames++;
+    }
+
+    void BufMgr::unchargeTenant(FrameId frame) {
+        tenants[bufDescTable[frame].tenant].frames--;
+    }
+
+    void BufMgr::setTenant(const File *file, std::uint32_t tenant) {
+        std::lock_guard<std::mutex> lock(bufLock);
+        if (tenant == 0) {
+            fileTenants.erase(file);
+        } else {
+            fileTenants[file] = tenant;
+        }
+    }
+
+    void BufMgr::setTenantQuota(std::uint32_t tenant, std::uint32_t minFrames, std::uint32_t maxFrames) {
+        std::lock_guard<std::mutex> lock(bufLock);
+        TenantStats &quota = tenants[tenant];
+        quota.minFrames = minFrames;
+        quota.maxFrames = maxFrames;
+    }
+
+    TenantStats BufMgr::getTenantStats(std::uint32_t tenant) {
+        std::lock_guard<std::mutex> lock(bufLock);
+        std::map<std::uint32_t, TenantStats>::const_iterator found = tenants.find(tenant);
+        return found != tenants.end() ? found->second : TenantStats();
+    }
+
+    void BufMgr::setAllocTimeout(std::chrono::milliseconds timeout) {
+        std::lock_guard<std::mutex> lock(bufLock);
+        allocTimeout = timeout;
+    }
+
+    FlushStats BufMgr::writeDirtyPages(const FlushProgress &progress, bool withPinned) {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        // Group by file name rather than File object, since copies of a File share one descriptor
+        typedef std::vector<std::pair<PageId, FrameId> > FramesOfFile;
+        std::map<std::string, FramesOfFile> byFile;
+        std::uint32_t total = 0;
+        for (std::size_t w = 0; w * 64 < numBufs; w++) {
+            // Whole words of clean frames are skipped at once
+            for (std::uint64_t dirty = dirtyBits.word(w) & validBits.word(w) & (withPinned ? ~std::uint64_t(0) : ~pinnedBits.word(w));
+                 dirty != 0; dirty &= dirty - 1) {
+                const FrameId i = w * 64 + __builtin_ctzll(dirty);
+                BufDesc *desc = &bufDescTable[i];
+                byFile[desc->file->filename()].push_back(std::make_pair(desc->pageNo, i));
+                total++;
+            }
+        }
+        std::vector<FramesOfFile *> work;
+        for (std::map<std::string, FramesOfFile>::iterator it = byFile.begin(); it != byFile.end(); ++it) {
+            std::sort(it->second.begin(), it->second.end());
+            work.push_back(&it->second);
+        }
+
+        std::atomic<std::size_t> nextFile(0);
+        std::mutex progressLock;
+        std::uint32_t written = 0;
+        std::exception_ptr error;
+        auto worker = [&]() {
+            for (std::size_t f = nextFile++; f < work.size(); f = nextFile++) {
+                for (std::size_t p = 0; p < work[f]->size(); p++) {
+                    const FrameId frame = (*work[f])[p].second;
+                    try {
+                        bufDescTable[frame].file->writePage(bufPool[frame]);
+                    } catch (...) {
+                        std::lock_guard<std::mutex> lock(progressLock);
+                        if (!error) {
+                            error = std::current_exception();
+                        }
+                        // Stays dirty
+                        (*work[f])[p].first = Page::INVALID_NUMBER;
+                        continue;
+                    }
+                    std::lock_guard<std::mutex> lock(progressLock);
+                    written++;
+                    if (progress) {
+                        progress(written, total);
+                    }
+                }
+            }
+        };
+        if (ioEngine) {
+            // All writes are in flight at once, up to the engine's depth, each file's in page order
+            for (std::size_t f = 0; f < work.size(); f++) {
+                for (std::size_t p = 0; p < work[f]->size(); p++) {
+                    std::pair<PageId, FrameId> &entry = (*work[f])[p];
+                    try {
+                        ioEngine->write(bufDescTable[entry.second].file, &bufPool[entry.second],
+                                        [&entry, &progressLock, &error, &written, total, &progress](std::exception_ptr failure) {
+                            std::lock_guard<std::mutex> lock(progressLock);
+                            if (failure) {
+                                if (!error) {
+                                    error = failure;
+                                }
+                                entry.first = Page::INVALID_NUMBER;
+                                return;
+                            }
+                            written++;
+                            if (progress) {
+                                progress(written, total);
+                            }
+                        });
+                    } catch (...) {
+                        std::lock_guard<std::mutex> lock(progressLock);
+                        if (!error) {
+                            error = std::current_exception();
+                        }
+                        entry.first = Page::INVALID_NUMBER;
+                    }
+                }
+            }
+            ioEngine->drain();
+        } else {
+            std::vector<std::thread> helpers;
+            for (std::size_t w = 1; w < FLUSH_WORKERS && w < work.size(); w++) {
+                helpers.push_back(std::thread(worker));
+            }
+            worker();
+            for (std::size_t w = 0; w < helpers.size(); w++) {
+                helpers[w].join();
+            }
+        }
+        // This is a checkpoint, so the pages are forced to disk; one sync per file covers all its pages
+        for (std::size_t f = 0; f < work.size(); f++) {
+            try {
+                bufDescTable[work[f]->front().second].file->sync();
+            } catch (...) {
+                if (!error) {
+                    error = std::current_exception();
+                }
+                // A failed sync says nothing about which pages made it
+                for (std::size_t p = 0; p < work[f]->size(); p++) {
+                    (*work[f])[p].first = Page::INVALID_NUMBER;
+                }
+            }
+        }
+        // Dirty bits of different files share words, so they are cleared here rather than by the workers
+        for (std::size_t f = 0; f < work.size(); f++) {
+            for (std::size_t p = 0; p < work[f]->size(); p++) {
+                if ((*work[f])[p].first != Page::INVALID_NUMBER) {
+                    dirtyBits.reset((*work[f])[p].second);
+                }
+            }
+        }
+
+        bufStats.diskwrites += written;
+        FlushStats stats;
+        stats.pages = written;
+        stats.files = work.size();
+        stats.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start);
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return stats;
+    }
+
+    FlushStats BufMgr::flushAll(const FlushProgress &progress) {
+        std::lock_guard<std::mutex> lock(bufLock);
+        return writeDirtyPages(progress, false);
+    }
+
+    void BufMgr::residentSet(std::vector<std::pair<std::string, PageId> > &keys) {
+        // Hotter buckets first; within a bucket, frame order
+        std::vector<FrameId> buckets[4];
+        for (FrameId i = 0; i < numBufs; i++) {
+            BufDesc *desc = &bufDescTable[i];
+            if (!validBits.test(i) || desc->hint == BufHint::USE_ONCE || desc->prefetched) {
+                continue;
+            }
+            if (desc->resident) {
+                buckets[0].push_back(i);
+            } else if (desc->hint == BufHint::KEEP_HOT) {
+                buckets[1].push_back(i);
+            } else if (refBits.test(i)) {
+                buckets[2].push_back(i);
+            } else {
+                buckets[3].push_back(i);
+            }
+        }
+        for (int b = 0; b < 4; b++) {
+            for (std::size_t i = 0; i < buckets[b].size(); i++) {
+                BufDesc *desc = &bufDescTable[buckets[b][i]];
+                keys.push_back(std::make_pair(desc->file->filename(), desc->pageNo));
+            }
+        }
+    }
+
+    void BufMgr::writeResidentSet(const std::string &path,
+                                  const std::vector<std::pair<std::string, PageId> > &keys) {
+        // Write a new file and rename it over the old one, so a crash never leaves half a list behind
+        const std::string tmpPath = path + ".tmp";
+        std::ofstream out(tmpPath.c_str(), std::ios::out | std::ios::trunc);
+        out << "badgerdb-resident-set 1 " << Page::SIZE << "\n";
+        for (std::size_t i = 0; i < keys.size(); i++) {
+            out << keys[i].second << " " << keys[i].first << "\n";
+        }
+        out.close();
+        if (!out) {
+            std::remove(tmpPath.c_str());
+            throw FileIOException(tmpPath);
+        }
+        if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+            throw FileIOException(path);
+        }
+    }
+
+    void BufMgr::saveResidentSetPeriodically() {
+        std::unique_lock<std::mutex> lock(bufLock);
+        while (!warmWake.wait_for(lock, warmInterval, [this] { return warmSaverStop; })) {
+            std::vector<std::pair<std::string, PageId> > keys;
+            residentSet(keys);
+            const std::string path = warmPath;
+            // Write the file without holding up the buffer pool
+            lock.unlock();
+            try {
+                writeResidentSet(path, keys);
+            } catch (FileIOException &e) {
+                // Try again next round
+            }
+            lock.lock();
+        }
+    }
+
+    void BufMgr::stopWarmSaver() {
+        {
+            std::lock_guard<std::mutex> lock(bufLock);
+            warmSaverStop = true;
+        }
+        warmWake.notify_all();
+        if (warmSaver.joinable()) {
+            warmSaver.join();
+        }
+        std::lock_guard<std::mutex> lock(bufLock);
+        warmSaverStop = false;
+    }
+
+    void BufMgr::enableWarmRestart(const std::string &path, std::chrono::milliseconds interval) {
+        stopWarmSaver();
+        std::lock_guard<std::mutex> lock(bufLock);
+        warmPath = path;
+        warmInterval = interval;
+        if (!warmPath.empty() && warmInterval.count() > 0) {
+            warmSaver = std::thread(&BufMgr::saveResidentSetPeriodically, this);
+        }
+    }
+
+    void BufMgr::saveResidentSet() {
+        std::vector<std::pair<std::string, PageId> > keys;
+        std::string path;
+        {
+            std::lock_guard<std::mutex> lock(bufLock);
+            if (warmPath.empty()) {
+                return;
+            }
+            residentSet(keys);
+            path = warmPath;
+        }
+        writeResidentSet(path, keys);
+    }
+
+    std::uint32_t BufMgr::warmStart(const std::string &path, const std::vector<File *> &files) {
+        std::ifstream in(path.c_str());
+        std::string magic;
+        int version = 0;
+        std::size_t pageSize = 0;
+        if (!(in >> magic >> version >> pageSize) || magic != "badgerdb-resident-set" || version != 1 ||
+            pageSize != Page::SIZE) {
+            throw FileIOException(path);
+        }
+
+        std::map<std::string, File *> byName;
+        for (std::size_t i = 0; i < files.size(); i++) {
+            byName[files[i]->filename()] = files[i];
+        }
+
+        // The hottest pool's worth of pages of the files we were given
+        std::vector<std::pair<File *, PageId> > pages;
+        PageId pageNo;
+        std::string name;
+        while (pages.size() < numBufs && in >> pageNo && in.get() == ' ' && std::getline(in, name)) {
+            std::map<std::string, File *>::iterator found = byName.find(name);
+            if (found != byName.end()) {
+                pages.push_back(std::make_pair(found->second, pageNo));
+            }
+        }
+        // Read them file by file in page order, so the reads are sequential on disk
+        std::sort(pages.begin(), pages.end(),
+                  [](const std::pair<File *, PageId> &a, const std::pair<File *, PageId> &b) {
+                      return a.first->filename() != b.first->filename() ?
+                             a.first->filename() < b.first->filename() : a.second < b.second;
+                  });
+
+        {
+            std::lock_guard<std::mutex> lock(bufLock);
+            warmLoaderStop = true;
+        }
+        waitWarmStart();
+        std::lock_guard<std::mutex> lock(bufLock);
+        warmLoaderStop = false;
+        warmLoader = std::thread(&BufMgr::loadResidentSet, this, pages);
+        return pages.size();
+    }
+
+    void BufMgr::readUnlocked(const std::vector<std::pair<File *, PageId> > &keys, std::vector<Page> &contents,
+                              std::vector<bool> &read) {
+        contents.assign(keys.size(), Page());
+        read.assign(keys.size(), false);
+        std::vector<char> done(keys.size(), 0);
+        std::mutex errorLock;
+        std::exception_ptr error;
+        if (ioEngine) {
+            std::vector<std::future<void> > reads;
+            for (std::size_t k = 0; k < keys.size(); k++) {
+                reads.push_back(ioEngine->read(keys[k].first, keys[k].second, &contents[k]));
+            }
+            ioEngine->submit();
+            // Every read has to finish before contents goes away, failed or not
+            for (std::size_t k = 0; k < reads.size(); k++) {
+                try {
+                    reads[k].get();
+                    done[k] = 1;
+                } catch (InvalidPageException &e) {
+                } catch (...) {
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                }
+            }
+        } else {
+            // Without the engine, a few threads share out the pages, each reading them in order
+            std::atomic<std::size_t> next(0);
+            auto worker = [&]() {
+                for (std::size_t k = next++; k < keys.size(); k = next++) {
+                    try {
+                        keys[k].first->readPage(keys[k].second, contents[k]);
+                        done[k] = 1;
+                    } catch (InvalidPageException &e) {
+                    } catch (...) {
+                        std::lock_guard<std::mutex> lock(errorLock);
+                        if (!error) {
+                            error = std::current_exception();
+                        }
+                    }
+                }
+            };
+            std::vector<std::thread> helpers;
+            for (std::size_t w = 1; w < FLUSH_WORKERS && w < keys.size(); w++) {
+                helpers.push_back(std::thread(worker));
+            }
+            worker();
+            for (std::size_t w = 0; w < helpers.size(); w++) {
+                helpers[w].join();
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        for (std::size_t k = 0; k < keys.size(); k++) {
+            read[k] = done[k] != 0;
+        }
+    }
+
+    void BufMgr::loadResidentSet(std::vector<std::pair<File *, PageId> > pages) {
+        FrameId freeFrame = 0;
+        for (std::size_t first = 0; first < pages.size(); first += WARM_BATCH) {
+            const std::size_t last = std::min<std::size_t>(pages.size(), first + WARM_BATCH);
+            // Pick the pages of the batch that are still worth reading
+            std::vector<std::pair<File *, PageId> > batch;
+            std::vector<std::uint64_t> versions;
+            {
+                std::lock_guard<std::mutex> lock(bufLock);
+                // Frames are for the requests waiting in line
+                if (warmLoaderStop || !waitQueue.empty()) {
+                    return;
+                }
+                for (std::size_t i = first; i < last; i++) {
+                    FrameId frameId;
+                    try {
+                        hashTable->lookup(pages[i].first, pages[i].second, frameId);
+                        continue;
+                    } catch (HashNotFoundException &e) {
+                    }
+                    batch.push_back(pages[i]);
+                    versions.push_back(pages[i].first->pageVersion(pages[i].second));
+                }
+            }
+
+            // Read them all at once with the lock released, so demand requests are never held up by a warm-up read
+            std::vector<Page> contents;
+            std::vector<bool> read;
+            try {
+                readUnlocked(batch, contents, read);
+            } catch (FileIOException &e) {
+                // Warming up is only an optimization, give up on it
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(bufLock);
+            if (warmLoaderStop || !waitQueue.empty()) {
+                return;
+            }
+            for (std::size_t k = 0; k < batch.size(); k++) {
+                if (!read[k]) {
+                    // Deleted since the set was saved
+                    continue;
+                }
+                File *file = batch[k].first;
+                const PageId pageNo = batch[k].second;
+                bufStats.diskreads++;
+                FrameId frameId;
+                try {
+                    hashTable->lookup(file, pageNo, frameId);
+                    continue;
+                } catch (HashNotFoundException &e) {
+                }
+                // Changed and written back while we read it; it is only a guess at what will be used, so let it go
+                if (file->pageVersion(pageNo) != versions[k]) {
+                    continue;
+                }
+
+                std::map<std::uint32_t, TenantStats>::iterator quota = tenants.find(tenantOf(file));
+                if (quota != tenants.end() && quota->second.frames >= quota->second.maxFrames) {
+                    continue;
+                }
+                // Only fill frames nobody has used yet, never evict for the sake of warming up
+                while (freeFrame < numBufs && validBits.test(freeFrame)) {
+                    freeFrame++;
+                }
+                if (freeFrame == numBufs) {
+                    return;
+                }
+                bufPool[freeFrame] = contents[k];
+                hashTable->insert(file, pageNo, freeFrame);
+                setFrame(freeFrame, file, pageNo);
+                chargeTenant(freeFrame);
+                pinCounts[freeFrame] = 0;
+                pinnedBits.reset(freeFrame);
+                // Warm pages that nobody asks for again are the first to go
+                refBits.reset(freeFrame);
+                bufStats.warmLoaded++;
+            }
+        }
+    }
+
+    void BufMgr::waitWarmStart() {
+        if (warmLoader.joinable()) {
+            warmLoader.join();
+        }
+    }
+
     void BufMgr::printSelf(void) {
+        std::lock_guard<std::mutex> lock(bufLock);
         BufDesc *tmpbuf;
         int validFrames = 0;
 
         for (std::uint32_t i = 0; i < numBufs; i++) {
             tmpbuf = &(bufDescTable[i]);
             std::cout << "FrameNo:" << i << " ";
-            tmpbuf->Print();
+            tmpbuf->Print(validBits.test(i), pinCounts[i], dirtyBits.test(i), refBits.test(i));
 
-            if (tmpbuf->valid == true)
+            if (validBits.test(i))
                 validFrames++;
         }
 
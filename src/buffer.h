@@ -7,18 +7,154 @@
 
 #pragma once
 
+#include <deque>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 #include "file.h"
 #include "bufHashTbl.h"
+#include "concurrent_page_table.h"
+#include "compressed_tier.h"
+#include "io_engine.h"
+#include "l2_cache.h"
+#include "prefetcher.h"
+
+/**
+ * Build with -DBADGERDB_CONCURRENT_PAGE_TABLE=1 to have BufMgr use the lock-free
+ * ConcurrentPageTable instead of BufHashTbl.
+ */
+#ifndef BADGERDB_CONCURRENT_PAGE_TABLE
+#define BADGERDB_CONCURRENT_PAGE_TABLE 0
+#endif
 
 namespace badgerdb {
 
+/**
+* @brief Page table implementation used by BufMgr, chosen at compile time
+*/
+#if BADGERDB_CONCURRENT_PAGE_TABLE
+typedef ConcurrentPageTable PageTable;
+#else
+typedef BufHashTbl PageTable;
+#endif
+
 /**
 * forward declaration of BufMgr class 
 */
 class BufMgr;
 
+/**
+* @brief Access intent a caller can attach to readPage() and allocPage()
+*
+* CLOCK only sees reference bits; the caller often knows more about how a page
+* is going to be used.  The hint only affects replacement, never correctness.
+*/
+enum class BufHint {
+	/**
+   * Plain CLOCK treatment
+	 */
+  NORMAL,
+
+	/**
+   * Page survives extra clock sweeps after its reference bit is cleared
+	 */
+  KEEP_HOT,
+
+	/**
+   * Page is read exactly once; it is the first eviction candidate once unpinned
+	 */
+  USE_ONCE,
+
+	/**
+   * Page is never evicted until BufMgr::releaseResident() is called for it
+	 */
+  RESIDENT
+};
+
+/**
+* @brief One bit per frame, packed 64 frames to a word so that whole words can be examined at once
+*/
+class FrameBitmap
+{
+ public:
+	/**
+   * Number of words of storage needed for the bits of the given number of frames
+	 */
+  static std::size_t wordsFor(std::uint32_t frames)
+  {
+		return (frames + 63) / 64;
+  }
+
+	/**
+   * Keep the bits in the given storage, which must be zero-filled, hold wordsFor() words and outlive the bitmap
+	 */
+  void place(std::uint64_t* storage)
+  {
+		words = storage;
+  }
+
+	/**
+   * Return the bit of a frame
+	 */
+  bool test(FrameId frame) const
+  {
+		return (words[frame >> 6] >> (frame & 63)) & 1;
+  }
+
+	/**
+   * Set the bit of a frame
+	 */
+  void set(FrameId frame)
+  {
+		words[frame >> 6] |= std::uint64_t(1) << (frame & 63);
+  }
+
+	/**
+   * Clear the bit of a frame
+	 */
+  void reset(FrameId frame)
+  {
+		words[frame >> 6] &= ~(std::uint64_t(1) << (frame & 63));
+  }
+
+	/**
+   * Set or clear the bit of a frame
+	 */
+  void assign(FrameId frame, bool value)
+  {
+		if (value)
+			set(frame);
+		else
+			reset(frame);
+  }
+
+	/**
+   * Word holding the bits of frames 64 * index to 64 * index + 63, lowest frame in the lowest bit
+	 */
+  std::uint64_t& word(std::size_t index)
+  {
+		return words[index];
+  }
+
+ private:
+  std::uint64_t* words = NULL;
+};
+
+
 /**
 * @brief Class for maintaining information about buffer pool frames
+*
+* A descriptor whose bytes are all zero is a cleared one, so the descriptor table can start out as untouched
+* zero-filled memory.  The frame number of a descriptor is its index in the table.  The state the clock sweep
+* looks at on every step (valid, dirty, reference and pin state) is kept by BufMgr in FrameBitmaps instead.
 */
 class BufDesc {
 
@@ -36,41 +172,48 @@ class BufDesc {
   PageId pageNo;
 
 	/**
-   * Frame number of the frame, in the buffer pool, being used
+   * Access hint the page was last brought in or touched with
 	 */
-  FrameId	frameNo;
+  BufHint hint;
 
 	/**
-   * Number of times this page has been pinned
+   * Extra clock sweeps a KEEP_HOT page survives after its refbit is cleared
 	 */
-  int pinCnt;
+  int retain;
 
 	/**
-   * True if page is dirty;  false otherwise
+   * True if the frame is held resident and must not be evicted
 	 */
-  bool dirty;
+  bool resident;
 
 	/**
-   * True if page is valid
+   * True if the frame is sitting in the use-once eviction queue
 	 */
-  bool valid;
+  bool queued;
 
 	/**
-   * Has this buffer frame been reference recently
+   * True if the page was read ahead by the prefetcher and nobody has asked for it yet
 	 */
-  bool refbit;
+  bool prefetched;
+
+	/**
+   * Tenant the page was charged to when it was brought in
+	 */
+  std::uint32_t tenant;
 
 	/**
    * Initialize buffer frame for a new user
 	 */
   void Clear()
 	{
-    pinCnt = 0;
 		file = NULL;
 		pageNo = Page::INVALID_NUMBER;
-    dirty = false;
-    refbit = false;
-		valid = false;
+		hint = BufHint::NORMAL;
+		retain = 0;
+		resident = false;
+		queued = false;
+		prefetched = false;
+		tenant = 0;
   };
 
 	/**
@@ -84,13 +227,17 @@ class BufDesc {
 	{ 
 		file = filePtr;
     pageNo = pageNum;
-    pinCnt = 1;
-    dirty = false;
-    valid = true;
-    refbit = true;
+		hint = BufHint::NORMAL;
+		retain = 0;
+		resident = false;
+		queued = false;
+		prefetched = false;
   }
 
-  void Print()
+	/**
+	 * Print the descriptor together with the frame's state kept outside it.
+	 */
+  void Print(bool valid, std::uint32_t pinCnt, bool dirty, bool refbit)
 	{
 		if(file)
 		{
@@ -103,7 +250,8 @@ class BufDesc {
 		std::cout << "valid:" << valid << " ";
 		std::cout << "pinCnt:" << pinCnt << " ";
 		std::cout << "dirty:" << dirty << " ";
-		std::cout << "refbit:" << refbit << "\n";
+		std::cout << "refbit:" << refbit << " ";
+		std::cout << "resident:" << resident << "\n";
   }
 
 	/**
@@ -136,12 +284,65 @@ struct BufStats
 	 */
   int diskwrites;
 
+	/**
+   * Number of RESIDENT hints downgraded to KEEP_HOT because the resident share was used up
+	 */
+  int residentDenied;
+
+	/**
+   * Number of requests that found every frame pinned and waited for one
+	 */
+  int waits;
+
+	/**
+   * Number of waiting requests that gave up when their timeout expired
+	 */
+  int waitTimeouts;
+
+	/**
+   * Total time spent waiting for frames, in microseconds
+	 */
+  std::uint64_t waitMicros;
+
+	/**
+   * Number of pages preloaded from a saved resident set by warmStart()
+	 */
+  int warmLoaded;
+
+	/**
+   * Number of page lookups answered by the calling thread's frame hints, without probing the hash table
+	 */
+  int hintHits;
+
+	/**
+   * Number of page lookups that had to probe the hash table
+	 */
+  int hintMisses;
+
+	/**
+   * Fraction of page lookups answered by frame hints
+	 */
+  double hintHitRate() const
+  {
+		return hintHits + hintMisses == 0 ? 0.0 : (double) hintHits / (hintHits + hintMisses);
+  }
+
+	/**
+   * Number of readNextPage() calls that followed a swizzled link instead of probing the page table
+	 */
+  int swizzleHits;
+
 	/**
    * Clear all values 
 	 */
   void clear()
   {
-		accesses = diskreads = diskwrites = 0;
+		accesses = diskreads = diskwrites = residentDenied = 0;
+		waits = waitTimeouts = 0;
+		waitMicros = 0;
+		warmLoaded = 0;
+		hintHits = hintMisses = 0;
+		swizzleHits = 0;
   }
       
 	/**
@@ -154,12 +355,122 @@ struct BufStats
 };
 
 
+/**
+* @brief Frame quota and usage statistics of one tenant of a buffer pool
+*/
+struct TenantStats
+{
+	/**
+   * Number of frames currently holding the tenant's pages
+	 */
+  std::uint32_t frames;
+
+	/**
+   * Frames the tenant keeps even when other tenants need room
+	 */
+  std::uint32_t minFrames;
+
+	/**
+   * Frames the tenant may hold at most; beyond that it replaces its own pages
+	 */
+  std::uint32_t maxFrames;
+
+	/**
+   * Number of readPage() calls for the tenant's pages
+	 */
+  std::uint64_t accesses;
+
+	/**
+   * Number of those calls that found the page in the buffer pool
+	 */
+  std::uint64_t hits;
+
+	/**
+   * Fraction of accesses that were hits
+	 */
+  double hitRate() const
+  {
+		return accesses == 0 ? 0.0 : (double) hits / accesses;
+  }
+
+	/**
+   * Constructor of TenantStats class: no pages, no quota
+	 */
+  TenantStats() : frames(0), minFrames(0), maxFrames(std::numeric_limits<std::uint32_t>::max()), accesses(0), hits(0)
+  {
+  }
+};
+
+/**
+* @brief Outcome of writing back the dirty pages of the buffer pool
+*/
+struct FlushStats
+{
+	/**
+   * Number of pages written
+	 */
+  std::uint32_t pages;
+
+	/**
+   * Number of files the pages belonged to
+	 */
+  std::uint32_t files;
+
+	/**
+   * Wall-clock time the flush took
+	 */
+  std::chrono::microseconds elapsed;
+
+	/**
+   * Constructor of FlushStats class
+	 */
+  FlushStats() : pages(0), files(0), elapsed(0)
+  {
+  }
+};
+
+/**
+* @brief Progress callback of BufMgr::flushAll(), called with the number of pages written so far and the
+* number to write.  Calls come from the flushing threads, one at a time.
+*/
+typedef std::function<void(std::uint32_t written, std::uint32_t total)> FlushProgress;
+
+
 /**
 * @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
+*
+* All public operations are serialized by a single lock, so a BufMgr may be shared between threads.  Each
+* thread remembers the frames of the pages it used last, so a page it keeps coming back to is found without
+* probing the shared hash table.
 */
 class BufMgr 
 {
  private:
+	/**
+   * Number of extra clock sweeps granted to a KEEP_HOT page on each access
+	 */
+  static const int KEEP_HOT_SWEEPS = 2;
+
+	/**
+   * Largest number of threads writing back files at once in flushAll() and on destruction
+	 */
+  static const std::uint32_t FLUSH_WORKERS = 4;
+
+	/**
+   * Number of pages of a saved resident set read at once, with bufLock released, by the warm-start loader
+	 */
+  static const std::uint32_t WARM_BATCH = 64;
+
+	/**
+   * Largest number of predicted pages waiting for the prefetch thread; further predictions are dropped
+	 */
+  static const std::uint32_t PREFETCH_QUEUE = 64;
+
+	/**
+   * Identifies this buffer manager in the per-thread frame hints, unlike its address, which a later one may reuse
+	 */
+  const std::uint64_t instanceId;
+
 	/**
    * Current position of clockhand in our buffer pool
 	 */
@@ -173,7 +484,7 @@ class BufMgr
 	/**
    * Hash table mapping (File, page) to frame
 	 */
-  BufHashTbl *hashTable;
+  PageTable *hashTable;
 
 	/**
    * Array of BufDesc objects to hold information corresponding to every frame allocation from 'bufPool' (the buffer pool)
@@ -185,22 +496,444 @@ class BufMgr
 	 */
   BufStats bufStats;
 
+	/**
+   * Frames holding a page
+	 */
+  FrameBitmap validBits;
+
+	/**
+   * Frames whose page has been changed since it was read or last written
+	 */
+  FrameBitmap dirtyBits;
+
+	/**
+   * Frames referenced since the clock hand last passed them
+	 */
+  FrameBitmap refBits;
+
+	/**
+   * Frames with a pin count above 0
+	 */
+  FrameBitmap pinnedBits;
+
+	/**
+   * Frames held resident or with KEEP_HOT sweeps left, which the clock has to look at one by one
+	 */
+  FrameBitmap holdBits;
+
+	/**
+   * Zero-filled memory holding the frame bitmaps and the per-frame arrays below, reserved in one piece and
+   * faulted in as frames are first used
+	 */
+  void* frameState;
+
+	/**
+   * Size of frameState in bytes
+	 */
+  std::size_t frameStateBytes;
+
+	/**
+   * Pin count of every frame
+	 */
+  std::uint32_t* pinCounts;
+
+	/**
+   * Generation of every frame, bumped whenever the frame is given a page or cleared.  A frame hint is good
+   * only while the frame's generation is the one it recorded.
+	 */
+  std::uint32_t* frameGens;
+
+	/**
+   * Swizzled chain links: for every frame, the frame last found holding the page that follows its page
+	 */
+  FrameId* nextFrames;
+
+	/**
+   * Generation of each nextFrames entry's target when the link was made; the link is dead once they differ
+	 */
+  std::uint32_t* nextGens;
+
+	/**
+   * Frames holding USE_ONCE pages that have been unpinned, oldest first.  allocBuf() takes victims from here
+   * before sweeping the clock.  Entries may be stale; they are re-checked when popped.
+	 */
+  std::deque<FrameId> useOnceQueue;
+
+	/**
+   * Number of frames currently held resident
+	 */
+  std::uint32_t residentFrames;
+
+	/**
+   * Maximum number of frames that may be held resident at once
+	 */
+  std::uint32_t maxResident;
+
+	/**
+   * Second tier holding compressed copies of evicted pages, NULL when disabled
+	 */
+  CompressedTier *compressedTier;
+
+	/**
+   * Local victim-cache file consulted after the compressed tier, NULL when disabled
+	 */
+  L2Cache *l2Cache;
+
+	/**
+   * Learned prefetcher fed by the miss stream, NULL when disabled
+	 */
+  Prefetcher *prefetcher;
+
+	/**
+   * Engine for reading misses in readPages() and writing back dirty pages asynchronously, NULL when disabled
+	 */
+  IoEngine *ioEngine;
+
+	/**
+   * Serializes all operations on the buffer manager
+	 */
+  std::mutex bufLock;
+
+	/**
+   * Signalled whenever a frame may have become available: a pin count dropping to 0 or a frame being freed
+	 */
+  std::condition_variable frameFreed;
+
+	/**
+   * How long a request that finds every frame pinned waits for one; 0 means throw right away
+	 */
+  std::chrono::milliseconds allocTimeout;
+
+	/**
+   * Tenant of each tagged file
+	 */
+  std::map<const File*, std::uint32_t> fileTenants;
+
+	/**
+   * Quota and statistics of every tenant that has a quota or has had pages in the buffer pool
+	 */
+  std::map<std::uint32_t, TenantStats> tenants;
+
+	/**
+   * Tickets of the requests waiting for a frame, in arrival order
+	 */
+  std::deque<std::uint64_t> waitQueue;
+
+	/**
+   * Ticket handed to the next waiting request
+	 */
+  std::uint64_t nextTicket;
+
+	/**
+   * File the resident set is saved to on destruction and by the saver thread, empty when disabled
+	 */
+  std::string warmPath;
+
+	/**
+   * Interval between saves of the resident set, 0 to save only on destruction
+	 */
+  std::chrono::milliseconds warmInterval;
+
+	/**
+   * Thread saving the resident set every warmInterval
+	 */
+  std::thread warmSaver;
+
+	/**
+   * Thread preloading a saved resident set
+	 */
+  std::thread warmLoader;
+
+	/**
+   * Tells the saver thread to stop
+	 */
+  bool warmSaverStop;
+
+	/**
+   * Tells the loader thread to stop
+	 */
+  bool warmLoaderStop;
+
+	/**
+   * Wakes the saver thread when it has to stop
+	 */
+  std::condition_variable warmWake;
+
+	/**
+   * Pages predicted by the prefetcher and not yet read, oldest first
+	 */
+  std::vector<std::pair<File*, PageId> > prefetchQueue;
+
+	/**
+   * Thread reading predicted pages, started by the first prediction
+	 */
+  std::thread prefetchThread;
+
+	/**
+   * Tells the prefetch thread to stop
+	 */
+  bool prefetchStop;
+
+	/**
+   * True while the prefetch thread reads with bufLock released; files it reads from must stay open
+	 */
+  bool prefetchReading;
+
+	/**
+   * Signalled when pages are queued for the prefetch thread, when it finishes a batch, and when it has to stop
+	 */
+  std::condition_variable prefetchWake;
+
 	/**
    * Advance clock to next frame in the buffer pool
 	 */
   void advanceClock();
 
 	/**
-	 * Allocate a free frame.  
+	 * Assign a frame to a page and pin it, as BufDesc::Set() does for the descriptor.
+	 *
+	 * @param frame   	Frame to assign
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 */
+  void setFrame(FrameId frame, File* file, PageId pageNo);
+
+	/**
+	 * Make a frame free, as BufDesc::Clear() does for the descriptor.
+	 *
+	 * @param frame   	Frame to clear
+	 */
+  void clearFrame(FrameId frame);
+
+	/**
+	 * Recompute the hold bit of a frame from its resident flag and remaining KEEP_HOT sweeps.
+	 *
+	 * @param frame   	Frame to update
+	 */
+  void updateHold(FrameId frame);
+
+	/**
+	 * Find the frame holding a page, first among the calling thread's frame hints and then in the hash table.
+	 * A page found in the hash table becomes a hint.  Called with bufLock held.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number
+	 * @param frame   	Frame holding the page returned via this variable
+	 * @return  			True if the page is in the buffer pool
+	 */
+  bool lookupFrame(const File* file, const PageId pageNo, FrameId& frame);
+
+	/**
+	 * Make a frame the calling thread's hint for a page.  Called with bufLock held.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number
+	 * @param frame   	Frame holding the page
+	 */
+  void rememberFrame(const File* file, const PageId pageNo, FrameId frame);
+
+	/**
+	 * Apply an access hint to a frame that has just been pinned.
+	 *
+	 * @param frame   	Frame the page lives in
+	 * @param hint  		Access hint passed by the caller
+	 * @param newPage 	True if the page was just brought into the frame
+	 */
+  void applyHint(FrameId frame, BufHint hint, bool newPage);
+
+	/**
+	 * Drop the resident hold (if any) on a frame, keeping the resident accounting straight.
+	 *
+	 * @param frame   	Frame to release
+	 */
+  void dropResident(FrameId frame);
+
+	/**
+	 * Evict the page in the given frame: write it back if dirty and remove it from the hash table.
+	 *
+	 * @param frame   	Frame to evict
+	 */
+  void evictFrame(FrameId frame);
+
+	/**
+	 * Allocate a free frame.  A tenant holding its maximum number of frames only gets one of its own frames,
+	 * and frames of other tenants down to their minimum are left alone.
 	 *
 	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
+	 * @param file   	File the frame is for, which decides the tenant
 	 * @throws BufferExceededException If no such buffer is found which can be allocated
 	 */
-  void allocBuf(FrameId & frame);
+  void allocBuf(FrameId & frame, const File* file);
+
+	/**
+	 * Allocate a free frame, waiting in line for a frame to be unpinned if the allocation timeout is set.
+	 * Called with bufLock held through lock, which is released while waiting.
+	 *
+	 * @param lock   	Lock holding bufLock
+	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
+	 * @param file   	File the frame is for, which decides the tenant
+	 * @return  			True if the request had to wait, i.e. bufLock was released in between
+	 * @throws BufferExceededException If no frame becomes available (before the timeout, if set)
+	 */
+  bool acquireFrame(std::unique_lock<std::mutex> & lock, FrameId & frame, const File* file);
+
+	/**
+	 * Return the tenant a file is tagged with, 0 if untagged.
+	 *
+	 * @param file   	File object
+	 */
+  std::uint32_t tenantOf(const File* file) const;
+
+	/**
+	 * Charge a frame that has just been Set() to its file's tenant.
+	 *
+	 * @param frame   	Frame now holding a page
+	 */
+  void chargeTenant(FrameId frame);
+
+	/**
+	 * Take a frame whose page is being dropped off its tenant's account.
+	 *
+	 * @param frame   	Frame whose page is leaving the buffer pool
+	 */
+  void unchargeTenant(FrameId frame);
+
+	/**
+	 * Pin a page that is already in the buffer pool.
+	 *
+	 * @param frame   	Frame the page lives in
+	 * @param hint  		Access hint passed by the caller
+	 */
+  void pinFrame(FrameId frame, BufHint hint);
+
+	/**
+	 * Pin a page found in the buffer pool and return it, noting the first use of a prefetched page.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number
+	 * @param frame   	Frame the page lives in
+	 * @param hint  		Access hint passed by the caller
+	 * @param page  	Reference to page pointer, set to the frame
+	 */
+  void pinHit(File* file, const PageId pageNo, FrameId frame, BufHint hint, Page*& page);
+
+	/**
+	 * Put a page just read into a frame and pin it, or pin the copy someone else brought in while the lock was
+	 * released waiting for a frame.  Called with bufLock held.
+	 *
+	 * @param lock   	Holds bufLock; released while waiting for a frame
+	 * @param file   	File object
+	 * @param pageNo  Page number
+	 * @param contents	The page as read, or NULL to read it from the file straight into the frame; ignored, and
+	 *                 	the page read again, if the lock was released waiting for a frame
+	 * @param hint  		Access hint passed by the caller
+	 * @param page  	Reference to page pointer, set to the frame holding the page
+	 * @return  			True if the page was put into a frame, false if another copy was pinned
+	 * @throws  BufferExceededException If every frame is pinned (for longer than the allocation timeout, if set)
+	 * @throws  InvalidPageException If the page is read from the file and does not exist in it
+	 */
+  bool installPage(std::unique_lock<std::mutex>& lock, File* file, const PageId pageNo, const Page* contents,
+                   BufHint hint, Page*& page);
+
+	/**
+	 * Read a page that is not in the buffer pool from the compressed tier or the L2 cache.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param page  	Page to read into
+	 * @return  			True if either held the page
+	 */
+  bool fetchCached(File* file, const PageId pageNo, Page& page);
+
+	/**
+	 * Feed a would-be miss to the prefetcher and queue the predicted successors for the prefetch thread, so
+	 * the miss itself never waits for a read ahead.  Called with bufLock held.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 */
+  void prefetchAfter(File* file, const PageId pageNo);
+
+	/**
+	 * Write back dirty pages, keeping them in the buffer pool.  Pages are grouped by file; files are written
+	 * concurrently by up to FLUSH_WORKERS threads, each in page number order.  Called with bufLock held.
+	 *
+	 * @param progress   	Called after every page written, may be empty
+	 * @param withPinned 	Whether to write pinned pages too
+	 * @return  				What was written and how long it took
+	 * @throws  InvalidPageException If a dirty page was deleted from its file; the other pages are still written
+	 */
+  FlushStats writeDirtyPages(const FlushProgress& progress, bool withPinned);
+
+	/**
+	 * List the pages in the buffer pool, hottest first: resident pages, then KEEP_HOT pages, then recently
+	 * referenced ones, then the rest.  USE_ONCE pages and unused prefetched pages are left out.  Called with
+	 * bufLock held.
+	 *
+	 * @param keys   	(file name, page number) of each page, returned via this variable
+	 */
+  void residentSet(std::vector<std::pair<std::string, PageId> > & keys);
+
+	/**
+	 * Write a resident set to a file, replacing it atomically.
+	 *
+	 * @param path   	File to write
+	 * @param keys   	(file name, page number) of each page, hottest first
+	 * @throws  FileIOException If the file cannot be written
+	 */
+  static void writeResidentSet(const std::string& path, const std::vector<std::pair<std::string, PageId> > & keys);
+
+	/**
+	 * Body of the saver thread: save the resident set every warmInterval until told to stop.
+	 */
+  void saveResidentSetPeriodically();
+
+	/**
+	 * Body of the prefetch thread: read the queued pages with bufLock released, through the asynchronous I/O
+	 * engine when it is enabled, and put them into free or evictable frames, unpinned, with it held.
+	 * Prefetching never waits for a frame.
+	 */
+  void runPrefetcher();
+
+	/**
+	 * Put a prefetched page into a frame, unpinned.  Called with bufLock held.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param contents	Contents of the page
+	 * @return  			False if no frame could be had without waiting
+	 */
+  bool installPrefetched(File* file, const PageId pageNo, const Page& contents);
+
+	/**
+	 * Body of the loader thread: read the given pages into free frames, WARM_BATCH pages at a time.  Each batch
+	 * is read with bufLock released and put into frames with it held.
+	 *
+	 * @param pages   	Pages to load, in the order to read them
+	 */
+  void loadResidentSet(std::vector<std::pair<File*, PageId> > pages);
+
+	/**
+	 * Read pages into memory outside the buffer pool, several at once: through the asynchronous I/O engine if
+	 * enabled, otherwise with up to FLUSH_WORKERS threads.  Called without bufLock held.
+	 *
+	 * @param keys   	(file, page number) of each page to read
+	 * @param contents	Set to the pages read, in the order of keys
+	 * @param read   	Set to whether each page was read; false if it is not in use
+	 * @throws  FileIOException If a read fails
+	 */
+  void readUnlocked(const std::vector<std::pair<File*, PageId> >& keys, std::vector<Page>& contents,
+                    std::vector<bool>& read);
+
+	/**
+	 * Stop the saver thread, if running.  Called without bufLock held.
+	 */
+  void stopWarmSaver();
 
  public:
 	/**
-   * Actual buffer pool from which frames are allocated
+   * Actual buffer pool from which frames are allocated.  Frames are raw memory, reserved up front and faulted in
+   * on first use; a frame only holds a page once one has been copied into it.
 	 */
   Page* bufPool;
 
@@ -222,8 +955,39 @@ class BufMgr
 	 * @param file   	File object
 	 * @param PageNo  Page number in the file to be read
 	 * @param page  	Reference to page pointer. Used to fetch the Page object in which requested page from file is read in.
+	 * @param hint  	Access hint for the replacement policy
+   * @throws  BufferExceededException If every frame is pinned (for longer than the allocation timeout, if set)
 	 */
-  void readPage(File* file, const PageId PageNo, Page*& page);
+  void readPage(File* file, const PageId PageNo, Page*& page, BufHint hint = BufHint::NORMAL);
+
+	/**
+	 * Reads the page that follows a pinned page in its file's chain of used pages, as FileIterator does, and
+	 * pins it.  Once a page has been followed from a frame, the link is kept as a direct frame reference, so
+	 * following it again while both pages stay cached skips the page table.
+	 *
+	 * @param file   	File object
+	 * @param current	Pinned page whose next_page_number() is followed
+	 * @param next  	Reference to page pointer, set to the frame holding the next page
+	 * @param hint  	Access hint for the replacement policy
+	 * @return  			False if current is the last page of the chain, leaving next alone
+   * @throws  BufferExceededException If every frame is pinned (for longer than the allocation timeout, if set)
+	 */
+  bool readNextPage(File* file, const Page* current, Page*& next, BufHint hint = BufHint::NORMAL);
+
+	/**
+	 * Reads and pins several pages of a file.  With asynchronous I/O enabled, the pages not in the buffer pool
+	 * are all read at once, while the lock is released; otherwise this is readPage() for each page in turn.
+	 * Either every page is pinned or, if one of them cannot be read, none is.
+	 *
+	 * @param file   	File object
+	 * @param pageNos	Page numbers in the file to be read
+	 * @param pages  	Set to the frames holding the pages, in the order of pageNos
+	 * @param hint  	Access hint for the replacement policy
+   * @throws  InvalidPageException If one of the pages is not in use
+   * @throws  BufferExceededException If every frame is pinned (for longer than the allocation timeout, if set)
+	 */
+  void readPages(File* file, const std::vector<PageId>& pageNos, std::vector<Page*>& pages,
+                 BufHint hint = BufHint::NORMAL);
 
 	/**
 	 * Unpin a page from memory since it is no longer required for it to remain in memory.
@@ -242,17 +1006,209 @@ class BufMgr
 	 * @param file   	File object
 	 * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
 	 * @param page  	Reference to page pointer. The newly allocated in-memory Page object is returned via this reference.
+	 * @param hint  	Access hint for the replacement policy
+   * @throws  BufferExceededException If every frame is pinned (for longer than the allocation timeout, if set)
+	 */
+  void allocPage(File* file, PageId &PageNo, Page*& page, BufHint hint = BufHint::NORMAL); 
+
+	/**
+	 * Release the RESIDENT hold on a page so that it becomes evictable again.
+	 * Does nothing if the page is not in the buffer pool or not held resident.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number
+	 */
+  void releaseResident(File* file, const PageId PageNo);
+
+	/**
+	 * Set the largest share of the buffer pool that RESIDENT pages may occupy.  RESIDENT hints
+	 * beyond this share are treated as KEEP_HOT.  Pages already resident keep their hold.
+	 *
+	 * @param share  	Fraction of the frames, between 0 and 1
+	 */
+  void setResidentShare(double share);
+
+	/**
+	 * Enable the learned prefetcher.  It records which pages follow each other in the stream of readPage()
+	 * misses and, once a successor is seen often enough, reads it into the buffer pool ahead of time, on a
+	 * thread of its own.
+	 * Calling it again starts over with an empty table; a table size of 0 disables it.
+	 *
+	 * @param tablePages  Number of pages whose successors are tracked
+	 * @param threshold  	Share of a page's observed successors a page must make up to be prefetched
+	 */
+  void enablePrefetcher(std::size_t tablePages, double threshold = 0.5);
+
+	/**
+	 * Enable asynchronous I/O.  readPages() then issues its misses as one batch, and flushAll() and the
+	 * destructor keep all write-backs in flight at once instead of writing with FLUSH_WORKERS threads.  The
+	 * engine uses io_uring where the kernel has it, and worker threads otherwise.  A depth of 0 disables it.
+	 * Not to be called while other threads are using the buffer manager.
+	 *
+	 * @param depth  	Largest number of reads or writes in flight at once
+	 * @param useUring	Whether to try io_uring before falling back to worker threads
+	 */
+  void enableAsyncIo(std::uint32_t depth = 64, bool useUring = true);
+
+	/**
+   * Get the statistics of the asynchronous I/O engine.  All zero when it is disabled.
+	 */
+  IoStats getIoStats()
+  {
+		return ioEngine ? ioEngine->stats() : IoStats();
+  }
+
+	/**
+	 * Turn prefetching on or off for one file.  Pages of a disabled file are neither learned from nor
+	 * prefetched.  All files start enabled.
+	 *
+	 * @param file   	File object
+	 * @param enabled	Whether to prefetch for the file
+	 */
+  void setPrefetch(const File* file, bool enabled);
+
+	/**
+	 * Wait until the pages the prefetcher has predicted so far have been read in or given up on.
+	 */
+  void waitPrefetch();
+
+	/**
+   * Get prefetcher statistics (precision and recall of its predictions).  All zero when it is disabled.
+	 */
+  PrefetchStats getPrefetchStats() const
+  {
+		return prefetcher ? prefetcher->stats() : PrefetchStats();
+  }
+
+	/**
+	 * Tag a file with a tenant.  Pages the file brings into the buffer pool from now on count against the
+	 * tenant's quota.  Untagged files belong to tenant 0.
+	 *
+	 * @param file   	File object
+	 * @param tenant  Tenant ID
+	 */
+  void setTenant(const File* file, std::uint32_t tenant);
+
+	/**
+	 * Set a tenant's frame quota.  While a tenant holds maxFrames frames, its misses replace its own pages
+	 * instead of taking free frames or other tenants' pages.  Other tenants' misses never take a frame from
+	 * a tenant holding minFrames frames or fewer.  The minimums should add up to less than the pool size.
+	 *
+	 * @param tenant  	Tenant ID
+	 * @param minFrames Frames the tenant keeps
+	 * @param maxFrames Frames the tenant may hold at most
+	 */
+  void setTenantQuota(std::uint32_t tenant, std::uint32_t minFrames, std::uint32_t maxFrames);
+
+	/**
+   * Get a tenant's quota, occupancy and hit statistics
+	 */
+  TenantStats getTenantStats(std::uint32_t tenant);
+
+	/**
+	 * Make readPage() and allocPage() wait when every frame is pinned, instead of throwing
+	 * BufferExceededException right away.  Waiting requests are served in arrival order as pages get unpinned,
+	 * and throw BufferExceededException if no frame frees up within the timeout.  A timeout of 0 (the default)
+	 * restores the throwing behaviour.
+	 *
+	 * @param timeout  	Longest time a request waits for a frame
+	 */
+  void setAllocTimeout(std::chrono::milliseconds timeout);
+
+	/**
+	 * Enable the compressed victim tier.  Pages evicted from the buffer pool are compressed into a memory
+	 * region of the given size, and later misses are served from it before going to disk.
+	 * Calling it again resizes the tier, dropping its current contents; a size of 0 disables it.
+	 *
+	 * @param bytes  	Memory budget of the tier in bytes
+	 */
+  void enableCompressedTier(std::size_t bytes);
+
+	/**
+   * Get compressed tier usage statistics (hit rate and compression ratio).  All zero when the tier is disabled.
+	 */
+  CompressedTierStats getCompressedTierStats() const
+  {
+		return compressedTier ? compressedTier->stats() : CompressedTierStats();
+  }
+
+	/**
+	 * Enable the L2 victim cache.  Evicted pages are copied into a fixed-size cache file, meant to be on a
+	 * fast local disk, and misses are served from it before going to the page's own file.  Calling it again
+	 * replaces the cache; a size of 0 disables it.
+	 *
+	 * @param path  	Path of the cache file, created (or truncated) now and removed when the cache goes away
+	 * @param pages  	Number of pages the cache file holds
+	 * @throws  FileIOException If the cache file cannot be created
+	 */
+  void enableL2Cache(const std::string& path, std::uint32_t pages);
+
+	/**
+   * Get L2 cache usage statistics.  All zero when the cache is disabled.
+	 */
+  L2CacheStats getL2CacheStats() const
+  {
+		return l2Cache ? l2Cache->stats() : L2CacheStats();
+  }
+
+	/**
+	 * Save the list of pages in the buffer pool, hottest first, to a file when the buffer manager is destroyed,
+	 * and also every interval if one is given.  A later buffer manager can preload them with warmStart().
+	 * Calling it again replaces the settings; an empty path disables saving.
+	 *
+	 * @param path  	File to save the resident set to
+	 * @param interval	Time between periodic saves, 0 to save only on destruction
+	 */
+  void enableWarmRestart(const std::string& path, std::chrono::milliseconds interval = std::chrono::milliseconds(0));
+
+	/**
+	 * Save the resident set now, to the file given to enableWarmRestart().  Does nothing if saving is disabled.
+	 *
+	 * @throws  FileIOException If the file cannot be written
+	 */
+  void saveResidentSet();
+
+	/**
+	 * Preload a resident set saved by an earlier buffer manager.  Up to one pool's worth of the hottest pages
+	 * is read in the background, file by file in page order, into frames nobody is using yet; readPage() and
+	 * the other operations go on meanwhile.  Pages of files not in the list, and pages deleted since, are
+	 * skipped.  The files must stay open until waitWarmStart() returns or the buffer manager is destroyed.
+	 *
+	 * @param path  	File written by saveResidentSet() or on destruction
+	 * @param files  	Open files whose pages may be loaded, matched by name
+	 * @return  			Number of pages queued for loading
+	 * @throws  FileIOException If the file cannot be read or was written with another page size
+	 */
+  std::uint32_t warmStart(const std::string& path, const std::vector<File*>& files);
+
+	/**
+	 * Wait until the pages queued by warmStart() have been loaded.
+	 */
+  void waitWarmStart();
+
+	/**
+	 * Writes out the dirty pages of every file, keeping them in the buffer pool, and syncs each file
+	 * written to disk.  Files are written concurrently by a few threads, each file in page number order.
+	 * Pinned pages are left dirty, since their users may be changing them.  The destructor writes back
+	 * the same way, pinned pages included.  Pages are only forced to disk here, in flushFile() and on
+	 * destruction; write-backs on eviction are left to the kernel until then.
+	 *
+	 * @param progress   	Called after every page written with the count so far and the total
+	 * @return  				Number of pages and files written and the time taken
+	 * @throws  InvalidPageException If a dirty page was deleted from its file; the other pages are still written
+	 * @throws  FileIOException If a file cannot be synced; its pages stay dirty
 	 */
-  void allocPage(File* file, PageId &PageNo, Page*& page); 
+  FlushStats flushAll(const FlushProgress& progress = FlushProgress());
 
 	/**
-	 * Writes out all dirty pages of the file to disk.
+	 * Writes out all dirty pages of the file to disk, and syncs the file if any were written.
 	 * All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
 	 * Otherwise Error returned.
 	 *
 	 * @param file   	File object
    * @throws  PagePinnedException If any page of the file is pinned in the buffer pool 
    * @throws BadBufferException If any frame allocated to the file is found to be invalid
+   * @throws  FileIOException If the file cannot be synced; its pages stay in the buffer pool, dirty
 	 */
   void flushFile(const File* file);
 
@@ -0,0 +1,201 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "compressed_tier.h"
+
+#include <cstring>
+
+namespace badgerdb {
+
+namespace {
+
+// Token layout of the codec: a control byte below 0x80 is followed by
+// (control + 1) literal bytes; a control byte of 0x80 or above is a match of
+// (control - 0x80 + MIN_MATCH) bytes copied from a two-byte little-endian
+// offset back in the output.  Overlapping matches encode runs, so the long
+// zero-filled stretches of a page cost three bytes per MAX_MATCH bytes.
+const std::size_t MIN_MATCH = 4;
+const std::size_t MAX_MATCH = 0x7f + MIN_MATCH;
+const std::size_t MAX_LITERALS = 0x80;
+const std::size_t MAX_OFFSET = 0xffff;
+const int HASH_BITS = 12;
+
+void appendLiterals(const char* src, std::size_t len, std::string& out) {
+  while (len > 0) {
+    const std::size_t run = len < MAX_LITERALS ? len : MAX_LITERALS;
+    out.push_back(static_cast<char>(run - 1));
+    out.append(src, run);
+    src += run;
+    len -= run;
+  }
+}
+
+}
+
+CompressedTier::CompressedTier(const std::size_t capacity)
+    : capacity_(capacity),
+      used_(0) {
+}
+
+void CompressedTier::compress(const char* src, const std::size_t len,
+                              std::string& out) {
+  out.clear();
+  long table[1 << HASH_BITS];
+  for (std::size_t h = 0; h < (1 << HASH_BITS); ++h) {
+    table[h] = -1;
+  }
+
+  std::size_t pos = 0;
+  std::size_t literal_start = 0;
+  while (pos + MIN_MATCH <= len) {
+    std::uint32_t sequence;
+    std::memcpy(&sequence, src + pos, sizeof(sequence));
+    const std::size_t h = (sequence * 2654435761u) >> (32 - HASH_BITS);
+    const long candidate = table[h];
+    table[h] = static_cast<long>(pos);
+
+    if (candidate < 0 || pos - candidate > MAX_OFFSET ||
+        std::memcmp(src + candidate, src + pos, MIN_MATCH) != 0) {
+      ++pos;
+      continue;
+    }
+
+    std::size_t match = MIN_MATCH;
+    while (pos + match < len && match < MAX_MATCH &&
+           src[candidate + match] == src[pos + match]) {
+      ++match;
+    }
+    appendLiterals(src + literal_start, pos - literal_start, out);
+    const std::size_t offset = pos - candidate;
+    out.push_back(static_cast<char>(0x80 | (match - MIN_MATCH)));
+    out.push_back(static_cast<char>(offset & 0xff));
+    out.push_back(static_cast<char>(offset >> 8));
+    pos += match;
+    literal_start = pos;
+  }
+  appendLiterals(src + literal_start, len - literal_start, out);
+}
+
+bool CompressedTier::decompress(const std::string& src, char* dst,
+                                const std::size_t len) {
+  std::size_t in = 0;
+  std::size_t out = 0;
+  while (in < src.size()) {
+    const unsigned char control = static_cast<unsigned char>(src[in++]);
+    if (control < 0x80) {
+      const std::size_t run = control + 1;
+      if (in + run > src.size() || out + run > len) {
+        return false;
+      }
+      std::memcpy(dst + out, src.data() + in, run);
+      in += run;
+      out += run;
+    } else {
+      const std::size_t match = (control & 0x7f) + MIN_MATCH;
+      if (in + 2 > src.size()) {
+        return false;
+      }
+      const std::size_t offset =
+          static_cast<unsigned char>(src[in]) |
+          (static_cast<unsigned char>(src[in + 1]) << 8);
+      in += 2;
+      if (offset == 0 || offset > out || out + match > len) {
+        return false;
+      }
+      // Byte by byte, since the source may overlap what we are writing.
+      for (std::size_t i = 0; i < match; ++i, ++out) {
+        dst[out] = dst[out - offset];
+      }
+    }
+  }
+  return out == len;
+}
+
+void CompressedTier::insert(const File* file, const PageId page_no,
+                            const Page& page) {
+  invalidate(file, page_no);
+
+  char raw[Page::SIZE];
+  std::memcpy(raw, &page.header_, sizeof(page.header_));
+  std::memcpy(raw + sizeof(page.header_), page.data_, Page::DATA_SIZE);
+
+  Entry entry;
+  entry.key = Key(file, page_no);
+  entry.version = file->pageVersion(page_no);
+  compress(raw, Page::SIZE, entry.bytes);
+  if (entry.bytes.size() >= Page::SIZE || entry.bytes.size() > capacity_) {
+    return;
+  }
+
+  // Make room by dropping the oldest pages.
+  while (used_ + entry.bytes.size() > capacity_) {
+    erase(entries_.begin());
+  }
+
+  stats_.stored++;
+  stats_.raw_bytes += Page::SIZE;
+  stats_.compressed_bytes += entry.bytes.size();
+  used_ += entry.bytes.size();
+  entries_.push_back(Entry());
+  entries_.back().key = entry.key;
+  entries_.back().version = entry.version;
+  entries_.back().bytes.swap(entry.bytes);
+  index_[entry.key] = --entries_.end();
+}
+
+bool CompressedTier::fetch(const File* file, const PageId page_no,
+                           Page& page) {
+  stats_.lookups++;
+  std::map<Key, EntryList::iterator>::iterator found =
+      index_.find(Key(file, page_no));
+  if (found == index_.end()) {
+    return false;
+  }
+  if (found->second->version != file->pageVersion(page_no)) {
+    // Rewritten or deleted in the file since we compressed it.
+    stats_.stale++;
+    erase(found->second);
+    return false;
+  }
+
+  char raw[Page::SIZE];
+  const bool ok = decompress(found->second->bytes, raw, Page::SIZE);
+  erase(found->second);
+  if (!ok) {
+    return false;
+  }
+  std::memcpy(&page.header_, raw, sizeof(page.header_));
+  std::memcpy(page.data_, raw + sizeof(page.header_), Page::DATA_SIZE);
+  stats_.hits++;
+  return true;
+}
+
+void CompressedTier::invalidate(const File* file, const PageId page_no) {
+  std::map<Key, EntryList::iterator>::iterator found =
+      index_.find(Key(file, page_no));
+  if (found != index_.end()) {
+    erase(found->second);
+  }
+}
+
+void CompressedTier::invalidateFile(const File* file) {
+  std::map<Key, EntryList::iterator>::iterator pos =
+      index_.lower_bound(Key(file, 0));
+  while (pos != index_.end() && pos->first.first == file) {
+    EntryList::iterator entry = pos->second;
+    ++pos;
+    erase(entry);
+  }
+}
+
+void CompressedTier::erase(EntryList::iterator pos) {
+  used_ -= pos->bytes.size();
+  index_.erase(pos->key);
+  entries_.erase(pos);
+}
+
+}
@@ -0,0 +1,215 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "file.h"
+#include "page.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Usage statistics of a CompressedTier.
+ */
+struct CompressedTierStats {
+  /**
+   * Number of buffer pool misses that looked in the tier.
+   */
+  std::uint64_t lookups;
+
+  /**
+   * Number of lookups served from the tier.
+   */
+  std::uint64_t hits;
+
+  /**
+   * Number of lookups that found a copy older than the page on disk.
+   */
+  std::uint64_t stale;
+
+  /**
+   * Number of pages stored in the tier.
+   */
+  std::uint64_t stored;
+
+  /**
+   * Uncompressed bytes of all pages stored.
+   */
+  std::uint64_t raw_bytes;
+
+  /**
+   * Compressed bytes of all pages stored.
+   */
+  std::uint64_t compressed_bytes;
+
+  /**
+   * Returns the fraction of lookups served from the tier.
+   */
+  double hitRate() const {
+    return lookups == 0 ? 0.0 : static_cast<double>(hits) / lookups;
+  }
+
+  /**
+   * Returns the average ratio of uncompressed to compressed page size.
+   */
+  double compressionRatio() const {
+    return compressed_bytes == 0 ?
+        0.0 : static_cast<double>(raw_bytes) / compressed_bytes;
+  }
+
+  /**
+   * Clear all values.
+   */
+  void clear() {
+    lookups = hits = stale = stored = raw_bytes = compressed_bytes = 0;
+  }
+
+  CompressedTierStats() {
+    clear();
+  }
+};
+
+/**
+ * @brief Bounded in-memory store of compressed pages evicted from the buffer
+ *        pool.
+ *
+ * Pages evicted by the buffer manager are compressed with a small built-in
+ * LZ77-style codec and kept here until the byte budget is exhausted, at which
+ * point the oldest pages are dropped.  A buffer pool miss checks the tier
+ * before going to disk.  The tier is exclusive: a page fetched from it is
+ * removed, since the buffer pool then holds the current copy.  Like L2Cache,
+ * each page remembers the File::pageVersion() it was stored at, and a lookup
+ * only hits if the page has not been written or deleted in the file since.
+ *
+ * @warning This class is not threadsafe.
+ */
+class CompressedTier {
+ public:
+  /**
+   * Constructs an empty tier.
+   *
+   * @param capacity  Upper bound on the compressed bytes held.
+   */
+  explicit CompressedTier(const std::size_t capacity);
+
+  /**
+   * Compresses a page and stores it, dropping the oldest pages if needed.
+   * Pages that do not compress are not stored.
+   *
+   * @param file      File the page belongs to.
+   * @param page_no   Page number in the file.
+   * @param page      Contents of the page.
+   */
+  void insert(const File* file, const PageId page_no, const Page& page);
+
+  /**
+   * Looks a page up and, if present, decompresses it and removes it from the
+   * tier.
+   *
+   * @param file      File the page belongs to.
+   * @param page_no   Page number in the file.
+   * @param page      Page to decompress into.
+   * @return  True if the page was found.
+   */
+  bool fetch(const File* file, const PageId page_no, Page& page);
+
+  /**
+   * Drops a page from the tier if present.
+   *
+   * @param file      File the page belongs to.
+   * @param page_no   Page number in the file.
+   */
+  void invalidate(const File* file, const PageId page_no);
+
+  /**
+   * Drops every page of a file from the tier.
+   *
+   * @param file      File whose pages to drop.
+   */
+  void invalidateFile(const File* file);
+
+  /**
+   * Returns the tier usage statistics.
+   */
+  CompressedTierStats& stats() { return stats_; }
+
+  /**
+   * Compresses a buffer.
+   *
+   * @param src   Bytes to compress.
+   * @param len   Number of bytes.
+   * @param out   Compressed bytes are stored here.
+   */
+  static void compress(const char* src, const std::size_t len,
+                       std::string& out);
+
+  /**
+   * Decompresses a buffer produced by compress().
+   *
+   * @param src   Compressed bytes.
+   * @param dst   Buffer to decompress into.
+   * @param len   Size of the decompressed data.
+   * @return  True if the input decompressed to exactly len bytes.
+   */
+  static bool decompress(const std::string& src, char* dst,
+                         const std::size_t len);
+
+ private:
+  typedef std::pair<const File*, PageId> Key;
+
+  /**
+   * A compressed page and the version of the page it was compressed from.
+   */
+  struct Entry {
+    Key key;
+    std::uint64_t version;
+    std::string bytes;
+  };
+
+  typedef std::list<Entry> EntryList;
+
+  /**
+   * Removes an entry from the tier.
+   *
+   * @param pos   Entry to remove.
+   */
+  void erase(EntryList::iterator pos);
+
+  /**
+   * Upper bound on the compressed bytes held.
+   */
+  std::size_t capacity_;
+
+  /**
+   * Compressed bytes currently held.
+   */
+  std::size_t used_;
+
+  /**
+   * Entries in insertion order, oldest first.
+   */
+  EntryList entries_;
+
+  /**
+   * Index from (file, page) to entry.
+   */
+  std::map<Key, EntryList::iterator> index_;
+
+  /**
+   * Usage statistics.
+   */
+  CompressedTierStats stats_;
+};
+
+}
@@ -0,0 +1,300 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "concurrent_page_table.h"
+
+#include "exceptions/hash_already_present_exception.h"
+#include "exceptions/hash_not_found_exception.h"
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Epoch announcement of one thread: (epoch << 1) | 1 while the thread is in
+ * an operation, 0 otherwise.  Records are reused by later threads and never
+ * freed.
+ */
+struct EpochRecord {
+  std::atomic<std::uint64_t> state;
+  std::atomic<bool> in_use;
+  EpochRecord* next;
+};
+
+std::atomic<std::uint64_t> global_epoch(2);
+
+std::atomic<EpochRecord*> epoch_records(nullptr);
+
+EpochRecord* acquireRecord() {
+  for (EpochRecord* r = epoch_records.load(); r != nullptr; r = r->next) {
+    bool expected = false;
+    if (r->in_use.compare_exchange_strong(expected, true)) {
+      return r;
+    }
+  }
+  EpochRecord* r = new EpochRecord;
+  r->state.store(0);
+  r->in_use.store(true);
+  r->next = epoch_records.load();
+  while (!epoch_records.compare_exchange_weak(r->next, r)) {
+  }
+  return r;
+}
+
+/**
+ * The calling thread's record, released when the thread exits.
+ */
+struct ThreadEpoch {
+  EpochRecord* record;
+  int depth;
+
+  ThreadEpoch() : record(acquireRecord()), depth(0) {}
+
+  ~ThreadEpoch() {
+    record->state.store(0);
+    record->in_use.store(false);
+  }
+};
+
+thread_local ThreadEpoch thread_epoch;
+
+/**
+ * Announces the current epoch for the duration of an operation.
+ */
+class EpochGuard {
+ public:
+  EpochGuard() : thread_(thread_epoch) {
+    if (thread_.depth++ > 0) {
+      return;
+    }
+    // Re-announce until the epoch did not move in between, so that no thread
+    // advances past us without having seen our announcement
+    std::uint64_t epoch = global_epoch.load();
+    for (;;) {
+      thread_.record->state.store((epoch << 1) | 1);
+      const std::uint64_t now = global_epoch.load();
+      if (now == epoch) {
+        break;
+      }
+      epoch = now;
+    }
+  }
+
+  ~EpochGuard() {
+    if (--thread_.depth == 0) {
+      thread_.record->state.store(0);
+    }
+  }
+
+ private:
+  ThreadEpoch& thread_;
+};
+
+/**
+ * Moves the global epoch forward if every thread in an operation has
+ * announced the current one.  Returns the global epoch.
+ */
+std::uint64_t tryAdvanceEpoch() {
+  std::uint64_t epoch = global_epoch.load();
+  for (EpochRecord* r = epoch_records.load(); r != nullptr; r = r->next) {
+    const std::uint64_t state = r->state.load();
+    if ((state & 1) && (state >> 1) != epoch) {
+      return epoch;
+    }
+  }
+  global_epoch.compare_exchange_strong(epoch, epoch + 1);
+  return global_epoch.load();
+}
+
+const std::uintptr_t MARK = 1;
+
+}
+
+struct ConcurrentPageTable::Node {
+  const File* file;
+  PageId pageNo;
+  FrameId frameNo;
+  std::atomic<std::uintptr_t> next;
+  std::uint64_t retire_epoch;
+  Node* retired_next;
+
+  /**
+   * Returns true if this node's key comes before (file, pageNo) in a bucket.
+   */
+  bool before(const File* f, const PageId p) const {
+    return file != f ? reinterpret_cast<std::uintptr_t>(file) <
+                           reinterpret_cast<std::uintptr_t>(f)
+                     : pageNo < p;
+  }
+
+  bool is(const File* f, const PageId p) const {
+    return file == f && pageNo == p;
+  }
+};
+
+ConcurrentPageTable::ConcurrentPageTable(const int htSize)
+    : num_buckets_(htSize),
+      buckets_(new std::atomic<std::uintptr_t>[htSize]),
+      retired_(nullptr),
+      retired_count_(0) {
+  for (int i = 0; i < num_buckets_; i++) {
+    buckets_[i].store(0);
+  }
+}
+
+ConcurrentPageTable::~ConcurrentPageTable() {
+  for (int i = 0; i < num_buckets_; i++) {
+    Node* node = reinterpret_cast<Node*>(buckets_[i].load() & ~MARK);
+    while (node != nullptr) {
+      Node* next = reinterpret_cast<Node*>(node->next.load() & ~MARK);
+      delete node;
+      node = next;
+    }
+  }
+  delete[] buckets_;
+  Node* node = retired_.load();
+  while (node != nullptr) {
+    Node* next = node->retired_next;
+    delete node;
+    node = next;
+  }
+}
+
+std::atomic<std::uintptr_t>& ConcurrentPageTable::bucket(const File* file,
+                                                          const PageId pageNo) {
+  const std::uintptr_t key =
+      (reinterpret_cast<std::uintptr_t>(file) >> 4) * 31 + pageNo;
+  return buckets_[key % num_buckets_];
+}
+
+bool ConcurrentPageTable::find(const File* file, const PageId pageNo,
+                               std::atomic<std::uintptr_t>*& prev,
+                               Node*& cur) {
+retry:
+  prev = &bucket(file, pageNo);
+  std::uintptr_t link = prev->load();
+  for (;;) {
+    cur = reinterpret_cast<Node*>(link);
+    if (cur == nullptr) {
+      return false;
+    }
+    const std::uintptr_t next = cur->next.load();
+    // The link we came through changed, or its node was removed meanwhile
+    if (prev->load() != link) {
+      goto retry;
+    }
+    if (next & MARK) {
+      std::uintptr_t expected = link;
+      if (!prev->compare_exchange_strong(expected, next & ~MARK)) {
+        goto retry;
+      }
+      retire(cur);
+      link = next & ~MARK;
+      continue;
+    }
+    if (!cur->before(file, pageNo)) {
+      return cur->is(file, pageNo);
+    }
+    prev = &cur->next;
+    link = next;
+  }
+}
+
+void ConcurrentPageTable::insert(const File* file, const PageId pageNo,
+                                 const FrameId frameNo) {
+  Node* node = new Node;
+  node->file = file;
+  node->pageNo = pageNo;
+  node->frameNo = frameNo;
+  EpochGuard guard;
+  std::atomic<std::uintptr_t>* prev;
+  Node* cur;
+  for (;;) {
+    if (find(file, pageNo, prev, cur)) {
+      delete node;
+      throw HashAlreadyPresentException(file->filename(), pageNo, cur->frameNo);
+    }
+    node->next.store(reinterpret_cast<std::uintptr_t>(cur));
+    std::uintptr_t expected = reinterpret_cast<std::uintptr_t>(cur);
+    if (prev->compare_exchange_strong(expected,
+                                      reinterpret_cast<std::uintptr_t>(node))) {
+      return;
+    }
+  }
+}
+
+void ConcurrentPageTable::lookup(const File* file, const PageId pageNo,
+                                 FrameId& frameNo) {
+  {
+    EpochGuard guard;
+    Node* cur = reinterpret_cast<Node*>(bucket(file, pageNo).load());
+    while (cur != nullptr && cur->before(file, pageNo)) {
+      cur = reinterpret_cast<Node*>(cur->next.load() & ~MARK);
+    }
+    if (cur != nullptr && cur->is(file, pageNo) && !(cur->next.load() & MARK)) {
+      frameNo = cur->frameNo;
+      return;
+    }
+  }
+  throw HashNotFoundException(file->filename(), pageNo);
+}
+
+void ConcurrentPageTable::remove(const File* file, const PageId pageNo) {
+  EpochGuard guard;
+  std::atomic<std::uintptr_t>* prev;
+  Node* cur;
+  for (;;) {
+    if (!find(file, pageNo, prev, cur)) {
+      throw HashNotFoundException(file->filename(), pageNo);
+    }
+    std::uintptr_t next = cur->next.load();
+    if (next & MARK) {
+      continue;
+    }
+    // Marking the node is what removes it; unlinking can be left to others
+    if (!cur->next.compare_exchange_strong(next, next | MARK)) {
+      continue;
+    }
+    std::uintptr_t expected = reinterpret_cast<std::uintptr_t>(cur);
+    if (prev->compare_exchange_strong(expected, next)) {
+      retire(cur);
+    } else {
+      find(file, pageNo, prev, cur);
+    }
+    return;
+  }
+}
+
+void ConcurrentPageTable::retire(Node* node) {
+  node->retire_epoch = global_epoch.load();
+  node->retired_next = retired_.load();
+  while (!retired_.compare_exchange_weak(node->retired_next, node)) {
+  }
+  if (++retired_count_ % RECLAIM_INTERVAL == 0) {
+    reclaim();
+  }
+}
+
+void ConcurrentPageTable::reclaim() {
+  const std::uint64_t epoch = tryAdvanceEpoch();
+  Node* node = retired_.exchange(nullptr);
+  while (node != nullptr) {
+    Node* next = node->retired_next;
+    // Threads that could have reached the node were all in operations that
+    // started by its retire epoch, and have finished by two epochs later
+    if (node->retire_epoch + 2 <= epoch) {
+      delete node;
+    } else {
+      node->retired_next = retired_.load();
+      while (!retired_.compare_exchange_weak(node->retired_next, node)) {
+      }
+    }
+    node = next;
+  }
+}
+
+}
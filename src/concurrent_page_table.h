@@ -0,0 +1,132 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "file.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Page table mapping (file, page) to frame that threads may use without
+ * any lock, with the same interface as BufHashTbl.
+ *
+ * Each bucket is a lock-free sorted list (Michael, "High Performance Dynamic
+ * Lock-Free Hash Tables and List-Based Sets", 2002).  A node is removed by
+ * first marking its next pointer and then unlinking it with a CAS; any thread
+ * that finds a marked node on its way unlinks it.  The number of buckets is
+ * fixed, which suits a buffer pool, where the number of entries never exceeds
+ * the number of frames.
+ *
+ * Unlinked nodes are freed with epoch-based reclamation: every operation runs
+ * in an epoch announced by its thread, and a node is freed only once every
+ * thread has moved two epochs past the one it was unlinked in.
+ */
+class ConcurrentPageTable {
+ public:
+  /**
+   * Constructs an empty table.
+   *
+   * @param htSize  Number of buckets.
+   */
+  explicit ConcurrentPageTable(const int htSize);
+
+  /**
+   * Destroys the table.  No other thread may be using it.
+   */
+  ~ConcurrentPageTable();
+
+  /**
+   * Inserts an entry mapping (file, pageNo) to frameNo.
+   *
+   * @param file     File object.
+   * @param pageNo   Page number in the file.
+   * @param frameNo  Frame number assigned to that page of the file.
+   * @throws  HashAlreadyPresentException if the page already has an entry.
+   */
+  void insert(const File* file, const PageId pageNo, const FrameId frameNo);
+
+  /**
+   * Finds the frame of (file, pageNo).
+   *
+   * @param file     File object.
+   * @param pageNo   Page number in the file.
+   * @param frameNo  Frame number returned via this reference.
+   * @throws  HashNotFoundException if the page has no entry.
+   */
+  void lookup(const File* file, const PageId pageNo, FrameId& frameNo);
+
+  /**
+   * Deletes the entry of (file, pageNo).
+   *
+   * @param file     File object.
+   * @param pageNo   Page number in the file.
+   * @throws  HashNotFoundException if the page has no entry.
+   */
+  void remove(const File* file, const PageId pageNo);
+
+ private:
+  struct Node;
+
+  /**
+   * Number of nodes a thread unlinks between attempts to free old ones.
+   */
+  static const int RECLAIM_INTERVAL = 64;
+
+  /**
+   * Number of buckets.
+   */
+  int num_buckets_;
+
+  /**
+   * Heads of the bucket lists.  A pointer with its low bit set belongs to a
+   * node that has been removed.
+   */
+  std::atomic<std::uintptr_t>* buckets_;
+
+  /**
+   * Unlinked nodes waiting to be freed, a stack pushed with CAS.
+   */
+  std::atomic<Node*> retired_;
+
+  /**
+   * Number of nodes unlinked so far, to pace reclamation.
+   */
+  std::atomic<std::uint64_t> retired_count_;
+
+  /**
+   * Returns the bucket of (file, pageNo).
+   */
+  std::atomic<std::uintptr_t>& bucket(const File* file, const PageId pageNo);
+
+  /**
+   * Finds the position of (file, pageNo) in its bucket, unlinking removed
+   * nodes on the way.  Must be called within an epoch.
+   *
+   * @param prev  Set to the link that points to cur.
+   * @param cur   Set to the first node not ordered before the key, or null.
+   * @return      True if cur is the node of the key.
+   */
+  bool find(const File* file, const PageId pageNo,
+            std::atomic<std::uintptr_t>*& prev, Node*& cur);
+
+  /**
+   * Hands an unlinked node over for freeing, and every so often frees the
+   * nodes no thread can still be looking at.
+   */
+  void retire(Node* node);
+
+  /**
+   * Frees the retired nodes that are two epochs old.
+   */
+  void reclaim();
+};
+
+}
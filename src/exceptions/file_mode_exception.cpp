@@ -0,0 +1,22 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "file_mode_exception.h"
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+FileModeException::FileModeException(const std::string& name)
+    : BadgerDbException(""), filename_(name) {
+  std::stringstream ss;
+  ss << "Operation not allowed in the mode the file is open in: " << filename_;
+  message_.assign(ss.str());
+}
+
+}
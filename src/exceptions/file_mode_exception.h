@@ -0,0 +1,42 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when an operation is requested that the
+ *        mode a file was opened in does not allow, such as a write to a file
+ *        opened read-only.
+ */
+class FileModeException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a file mode exception for the given file.
+   *
+   * @param name  Name of file the operation was requested on.
+   */
+  explicit FileModeException(const std::string& name);
+
+  /**
+   * Returns the name of the file that caused this exception.
+   */
+  virtual const std::string& filename() const { return filename_; }
+
+ protected:
+  /**
+   * Name of file that caused this exception.
+   */
+  const std::string filename_;
+};
+
+}
@@ -7,14 +7,27 @@
 
 #include "file.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <new>
 #include <string>
+#include <cstddef>
 #include <cstdio>
 #include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 #include "exceptions/file_exists_exception.h"
+#include "exceptions/file_io_exception.h"
+#include "exceptions/file_mode_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/file_open_exception.h"
 #include "exceptions/invalid_page_exception.h"
@@ -23,15 +36,322 @@
 
 namespace badgerdb {
 
-File::StreamMap File::open_streams_;
+namespace {
+
+/**
+ * @brief Start of the header block of a file in the aligned format.
+ *
+ * The header block is Page::SIZE bytes long, so that every page starts at a
+ * multiple of Page::SIZE and can be read with direct I/O; the change log
+ * follows this struct within it.  Files written before the format existed
+ * have a bare FileHeader packed right in front of the first page; they are
+ * still read and written, but only in FileMode::BUFFERED.
+ *
+ * When the last File object for a file is closed, the directory is saved in
+ * the file named by directoryName() and the header is stamped to match,
+ * unless both still describe the file.  The first change after that clears
+ * the stamp on disk, so a saved directory is loaded only if the file was
+ * closed cleanly since.  Otherwise, after a crash or for a file in the old
+ * format, the directory is rebuilt by reading the header of every page, pages
+ * past the end the file header knows of included.
+ */
+struct FormatBlock {
+  FileHeader header;
+  std::uint64_t magic;
+  std::uint32_t format;
+  std::uint32_t page_size;
+  // Stamp of the saved directory, if the file was closed cleanly; else 0
+  std::uint64_t directory_stamp;
+  // Number of changes made to the directory; 0 in files written before
+  // changes were counted
+  std::uint64_t generation;
+};
+
+/**
+ * @brief A page allocated or deleted, as logged in the header block after
+ * FormatBlock; change g is entry g % File::CHANGE_LOG of the log.
+ */
+struct DirectoryChange {
+  PageId page_number;
+  std::uint32_t used;
+};
+
+/**
+ * Offset of the change log in the header block.
+ */
+const std::size_t CHANGE_LOG_OFFSET = 64;
+
+/**
+ * Length of the header block and the change log together.
+ */
+const std::size_t HEADER_BLOCK_LENGTH =
+    CHANGE_LOG_OFFSET + File::CHANGE_LOG * sizeof(DirectoryChange);
+
+/**
+ * Identifies files in the aligned format; in older files, these bytes belong
+ * to the header of page 1.
+ */
+const std::uint64_t FORMAT_MAGIC = 0x4244726567646142ULL;  // "BadgerDB"
+
+/**
+ * @brief Start of a saved directory, followed by its bitmap and then by the
+ * free space category of each page.
+ */
+struct DirectoryBlock {
+  std::uint64_t magic;
+  std::uint64_t stamp;
+  std::uint32_t num_pages;
+  std::uint32_t page_size;
+  // Generation of the directory saved; changes logged since make it stale
+  std::uint64_t generation;
+};
+
+const std::uint64_t DIRECTORY_MAGIC = 0x7244726567646142ULL;  // "BadgerDr"
+
+/**
+ * Returns the name of the file a file's directory is saved in.
+ */
+std::string directoryName(const std::string& filename) {
+  return filename + ".dir";
+}
+
+/**
+ * Returns the name of the file the change log of a file in the old format is
+ * kept in, laid out like the header block of an aligned file.
+ */
+std::string logName(const std::string& filename) {
+  return filename + ".log";
+}
+
+/**
+ * Returns the length of the longest record a page with the given header can
+ * hold.
+ */
+std::size_t recordSpace(const PageHeader& header) {
+  std::size_t free_bytes =
+      header.free_space_upper_bound - header.free_space_lower_bound;
+  if (header.num_free_slots == 0) {
+    // A new slot is needed too
+    free_bytes = free_bytes > sizeof(PageSlot) ? free_bytes - sizeof(PageSlot)
+                                               : 0;
+  }
+  return free_bytes;
+}
+
+/**
+ * Returns the file header describing a directory.
+ */
+FileHeader headerOf(const PageDirectory& directory) {
+  const FileHeader header = {directory.numPages(), directory.firstUsed(),
+                             directory.numFree(), directory.firstFree()};
+  return header;
+}
+
+static_assert(sizeof(Page) == Page::SIZE,
+              "a page must be exactly its header followed by its data");
+static_assert(Page::SIZE % File::DIRECT_ALIGNMENT == 0,
+              "pages must be whole blocks for direct I/O");
+static_assert(sizeof(FormatBlock) <= CHANGE_LOG_OFFSET,
+              "the change log must follow the format block");
+static_assert(HEADER_BLOCK_LENGTH <= File::DIRECT_ALIGNMENT,
+              "the change log must fit in the first block of the file");
+
+bool isAligned(const void* buffer, const std::size_t length) {
+  const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(buffer);
+  return address % File::DIRECT_ALIGNMENT == 0 &&
+         length % File::DIRECT_ALIGNMENT == 0;
+}
+
+/**
+ * Returns the calling thread's page-sized buffer aligned for direct I/O.
+ */
+char* alignedBuffer() {
+  struct Buffer {
+    void* data;
+
+    Buffer() : data(NULL) {
+      if (posix_memalign(&data, File::DIRECT_ALIGNMENT, Page::SIZE) != 0) {
+        throw std::bad_alloc();
+      }
+    }
+
+    ~Buffer() { free(data); }
+  };
+  thread_local Buffer buffer;
+  return static_cast<char*>(buffer.data);
+}
+
+/**
+ * Reads the buffers from offset, retrying short reads.  Returns
+ * false on an I/O error; bytes past the end of the file are left untouched.
+ */
+bool readAt(const int fd, struct iovec* iov, int iovcnt, off_t offset) {
+  while (iovcnt > 0) {
+    const ssize_t got = preadv(fd, iov, iovcnt, offset);
+    if (got < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    if (got == 0) {
+      return true;
+    }
+    offset += got;
+    for (std::size_t left = got; left > 0;) {
+      const std::size_t step = std::min(left, iov->iov_len);
+      iov->iov_base = static_cast<char*>(iov->iov_base) + step;
+      iov->iov_len -= step;
+      left -= step;
+      if (iov->iov_len == 0) {
+        ++iov;
+        --iovcnt;
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * Writes the buffers at offset, retrying short writes.  Returns false on an
+ * I/O error.
+ */
+bool writeAt(const int fd, struct iovec* iov, int iovcnt, off_t offset) {
+  while (iovcnt > 0) {
+    const ssize_t put = pwritev(fd, iov, iovcnt, offset);
+    if (put < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    offset += put;
+    for (std::size_t left = put; left > 0;) {
+      const std::size_t step = std::min(left, iov->iov_len);
+      iov->iov_base = static_cast<char*>(iov->iov_base) + step;
+      iov->iov_len -= step;
+      left -= step;
+      if (iov->iov_len == 0) {
+        ++iov;
+        --iovcnt;
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * Writes the format block of a file, or only the file header for a file in
+ * the old format, leaving the change log after it alone.  Returns false on an
+ * I/O error.
+ */
+bool writeFormatBlock(const int fd, const bool legacy, const bool direct,
+                      const FormatBlock& block) {
+  struct iovec iov = {const_cast<FormatBlock*>(&block), sizeof(block)};
+  if (legacy) {
+    iov.iov_len = sizeof(FileHeader);
+  } else if (direct) {
+    // Whole blocks only, so the log is read back and written with the block
+    char* buffer = alignedBuffer();
+    std::memset(buffer, 0, File::DIRECT_ALIGNMENT);
+    iov.iov_base = buffer;
+    iov.iov_len = File::DIRECT_ALIGNMENT;
+    if (!readAt(fd, &iov, 1, 0 /* offset */)) {
+      return false;
+    }
+    std::memcpy(buffer, &block, sizeof(block));
+    iov.iov_base = buffer;
+    iov.iov_len = File::DIRECT_ALIGNMENT;
+  }
+  return writeAt(fd, &iov, 1, 0 /* offset */);
+}
+
+/**
+ * Logs a change to the directory of a file, and records its generation in
+ * the format block along with a zero stamp, since no saved directory
+ * describes the file any more; the file header is left for the next sync.
+ * Returns false on an I/O error.
+ */
+bool writeChange(const int fd, const bool direct,
+                 const std::uint64_t generation,
+                 const DirectoryChange& change) {
+  const std::size_t log_position =
+      CHANGE_LOG_OFFSET + generation % File::CHANGE_LOG * sizeof(change);
+  static_assert(offsetof(FormatBlock, generation) ==
+                    offsetof(FormatBlock, directory_stamp) +
+                        sizeof(std::uint64_t),
+                "the stamp and the generation are written together");
+  const std::size_t stamp_position = offsetof(FormatBlock, directory_stamp);
+  const std::uint64_t stamp_and_generation[2] = {0, generation};
+  if (direct) {
+    char* buffer = alignedBuffer();
+    std::memset(buffer, 0, File::DIRECT_ALIGNMENT);
+    struct iovec iov = {buffer, File::DIRECT_ALIGNMENT};
+    if (!readAt(fd, &iov, 1, 0 /* offset */)) {
+      return false;
+    }
+    std::memcpy(buffer + log_position, &change, sizeof(change));
+    std::memcpy(buffer + stamp_position, stamp_and_generation,
+                sizeof(stamp_and_generation));
+    iov.iov_base = buffer;
+    iov.iov_len = File::DIRECT_ALIGNMENT;
+    return writeAt(fd, &iov, 1, 0 /* offset */);
+  }
+  // The entry first, so that the generation never names a change not logged
+  struct iovec entry = {const_cast<DirectoryChange*>(&change), sizeof(change)};
+  struct iovec count = {const_cast<std::uint64_t*>(stamp_and_generation),
+                        sizeof(stamp_and_generation)};
+  return writeAt(fd, &entry, 1, log_position) &&
+         writeAt(fd, &count, 1, stamp_position);
+}
+
+#ifdef F_OFD_SETLKW
+const int LOCK_WAIT = F_OFD_SETLKW;
+const int LOCK_SET = F_OFD_SETLK;
+#else
+// Without open file description locks, locks belong to the process
+const int LOCK_WAIT = F_SETLKW;
+const int LOCK_SET = F_SETLK;
+#endif
+
+/**
+ * Takes (F_WRLCK) or lets go of (F_UNLCK) the lock on the first byte of a
+ * file that serializes changes to its directory.  Returns false on an error.
+ */
+bool lockDirectory(const int fd, const short type) {
+  struct flock range;
+  std::memset(&range, 0, sizeof(range));
+  range.l_type = type;
+  range.l_whence = SEEK_SET;
+  range.l_start = 0;
+  range.l_len = 1;
+  while (fcntl(fd, type == F_UNLCK ? LOCK_SET : LOCK_WAIT, &range) != 0) {
+    if (errno != EINTR) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}
+
+const int File::ADVICE_WINDOW;
+const std::uint64_t File::CHANGE_LOG;
+File::DescriptorMap File::open_descriptors_;
 File::CountMap File::open_counts_;
+File::VersionMap File::page_versions_;
+std::uint64_t File::version_counter_ = 0;
+std::mutex File::versions_mutex_;
 
-File File::create(const std::string& filename) {
-  return File(filename, true /* create_new */);
+File File::create(const std::string& filename, const FileMode mode) {
+  if (mode == FileMode::MAPPED) {
+    throw FileModeException(filename);
+  }
+  return File(filename, true /* create_new */, mode);
 }
 
-File File::open(const std::string& filename) {
-  return File(filename, false /* create_new */);
+File File::open(const std::string& filename, const FileMode mode) {
+  return File(filename, false /* create_new */, mode);
 }
 
 void File::remove(const std::string& filename) {
@@ -42,6 +362,8 @@ void File::remove(const std::string& filename) {
     throw FileOpenException(filename);
   }
   std::remove(filename.c_str());
+  std::remove(directoryName(filename).c_str());
+  std::remove(logName(filename).c_str());
 }
 
 bool File::isOpen(const std::string& filename) {
@@ -52,19 +374,15 @@ bool File::isOpen(const std::string& filename) {
 }
 
 bool File::exists(const std::string& filename) {
-	std::fstream file(filename);
-	if(file)
-	{
-		file.close();
-		return true;
-	}
-
-	return false;
+  // Not by opening it: closing a descriptor of a file lets go of the locks
+  // the process holds on it, where open file description locks are missing
+  struct stat status;
+  return stat(filename.c_str(), &status) == 0;
 }
 
 File::File(const File& other)
   : filename_(other.filename_),
-    stream_(open_streams_[filename_]) {
+    descriptor_(open_descriptors_[filename_]) {
   ++open_counts_[filename_];
 }
 
@@ -73,7 +391,7 @@ File& File::operator=(const File& rhs) {
   // same file.
   close();	//close my file and associate me with the new one
   filename_ = rhs.filename_;
-  openIfNeeded(false /* create_new */);
+  openIfNeeded(false /* create_new */, rhs.mode());
   return *this;
 }
 
@@ -82,136 +400,258 @@ File::~File() {
 }
 
 Page File::allocatePage() {
-  FileHeader header = readHeader();
+  checkWritable();
+  DirectoryUpdate update(*this);
   Page new_page;
-  Page existing_page;
-  if (header.num_free_pages > 0) {
-    new_page = readPage(header.first_free_page, true /* allow_free */);
-    new_page.set_page_number(header.first_free_page);
-    header.first_free_page = new_page.next_page_number();
-    --header.num_free_pages;
-
-    if (header.first_used_page == Page::INVALID_NUMBER ||
-        header.first_used_page > new_page.page_number()) {
-      // Either have no pages used or the head of the used list is a page later
-      // than the one we just allocated, so add the new page to the head.
-      if (header.first_used_page > new_page.page_number()) {
-        new_page.set_next_page_number(header.first_used_page);
-      }
-      header.first_used_page = new_page.page_number();
-    } else {
-      // New page is reused from somewhere after the beginning, so we need to
-      // find where in the used list to insert it.
-      PageId next_page_number = Page::INVALID_NUMBER;
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        next_page_number = (*iter).next_page_number();
-        if (next_page_number > new_page.page_number() ||
-            next_page_number == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      existing_page.set_next_page_number(new_page.page_number());
-      new_page.set_next_page_number(next_page_number);
-    }
-
-    assert((header.num_free_pages == 0) ==
-           (header.first_free_page == Page::INVALID_NUMBER));
-  } else {
-    new_page.set_page_number(header.num_pages);
-    if (header.first_used_page == Page::INVALID_NUMBER) {
-      header.first_used_page = new_page.page_number();
-    } else {
-      // If we have pages allocated, we need to add the new page to the tail
-      // of the linked list.
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        if ((*iter).next_page_number() == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      assert(existing_page.isUsed());
-      existing_page.set_next_page_number(new_page.page_number());
-    }
-    ++header.num_pages;
+  {
+    std::lock_guard<std::mutex> lock(descriptor_->directory_mutex);
+    PageDirectory& directory = descriptor_->directory;
+    new_page.set_page_number(directory.take());
+    new_page.set_next_page_number(directory.nextUsed(new_page.page_number()));
   }
-  writePage(new_page.page_number(), new_page);
-  if (existing_page.page_number() != Page::INVALID_NUMBER) {
-    // If we updated an existing page by inserting the new page into the
-    // used list, we need to write it out.
-    writePage(existing_page.page_number(), existing_page);
+  try {
+    writePage(new_page.page_number(), new_page);
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(descriptor_->directory_mutex);
+    descriptor_->directory.release(new_page.page_number());
+    descriptor_->free_space.remove(new_page.page_number());
+    throw;
   }
-  writeHeader(header);
+  update.publish(new_page.page_number(), true /* used */);
 
   return new_page;
 }
 
 Page File::readPage(const PageId page_number) const {
-  FileHeader header = readHeader();
-  if (page_number >= header.num_pages) {
+  Page page;
+  readPage(page_number, page);
+  return page;
+}
+
+void File::readPage(const PageId page_number, Page& page) const {
+  if (page_number >= readHeader().num_pages) {
+    // Another process may have allocated the page
+    refresh();
+  }
+  if (page_number >= readHeader().num_pages) {
     throw InvalidPageException(page_number, filename_);
   }
-  return readPage(page_number, false /* allow_free */);
+  readPage(page_number, false /* allow_free */, page);
 }
 
 Page File::readPage(const PageId page_number, const bool allow_free) const {
   Page page;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(page.header_));
-  stream_->read(reinterpret_cast<char*>(&page.data_[0]), Page::DATA_SIZE);
-  if (!allow_free && !page.isUsed()) {
+  readPage(page_number, allow_free, page);
+  return page;
+}
+
+void File::readPage(const PageId page_number, const bool allow_free,
+                    Page& page) const {
+  if (descriptor_->mapping != NULL) {
+    noteMappedRead(page_number);
+  }
+  if (descriptor_->direct || descriptor_->mapping != NULL) {
+    readBytes(&page, Page::SIZE, pagePosition(page_number));
+  } else {
+    struct iovec iov[2] = {{&page.header_, sizeof(page.header_)},
+                           {&page.data_[0], Page::DATA_SIZE}};
+    if (!readAt(descriptor_->fd, iov, 2, pagePosition(page_number))) {
+      throw FileIOException(filename_);
+    }
+  }
+  if (page.isUsed()) {
+    // The pointer on disk may lag behind the directory
+    page.header_.next_page_number = nextUsedPage(page_number);
+  } else if (!allow_free) {
     throw InvalidPageException(page_number, filename_);
   }
-
-  return page;
 }
 
 void File::writePage(const Page& new_page) {
-  PageHeader header = readPageHeader(new_page.page_number());
-  if (header.current_page_number == Page::INVALID_NUMBER) {
+  writePage(new_page.page_number(), headerToWrite(new_page), new_page);
+}
+
+PageHeader File::headerToWrite(const Page& new_page) const {
+  const PageId page_number = new_page.page_number();
+  std::unique_lock<std::mutex> lock(descriptor_->directory_mutex);
+  const PageDirectory& directory = descriptor_->directory;
+  if (!directory.isUsed(page_number) && descriptor_->mapping == NULL) {
+    // Another process may have allocated the page
+    lock.unlock();
+    refresh();
+    lock.lock();
+  }
+  if (!directory.isUsed(page_number)) {
     // Page has been deleted since it was read.
-    throw InvalidPageException(new_page.page_number(), filename_);
+    throw InvalidPageException(page_number, filename_);
+  }
+  // Page may have had its successor in the used list change since it was
+  // read; we don't modify that, but we do keep all the other modifications to
+  // the page header.
+  PageHeader header = new_page.header_;
+  header.next_page_number = directory.nextUsed(page_number);
+  return header;
+}
+
+PageId File::findPageWithSpace(const std::size_t length) const {
+  std::lock_guard<std::mutex> lock(descriptor_->directory_mutex);
+  return descriptor_->free_space.find(length);
+}
+
+void File::updateFreeSpace(const Page& page) {
+  noteFreeSpace(page.page_number(), page.header_);
+}
+
+void File::noteFreeSpace(const PageId page_number, const PageHeader& header) {
+  std::lock_guard<std::mutex> lock(descriptor_->directory_mutex);
+  // A page deleted meanwhile stays out of the map
+  if (descriptor_->directory.isUsed(page_number)) {
+    const std::uint8_t category =
+        FreeSpaceMap::categoryOf(recordSpace(header));
+    const std::vector<std::uint8_t>& categories =
+        descriptor_->free_space.categories();
+    if (page_number >= categories.size() ||
+        categories[page_number] != category) {
+      descriptor_->free_space.update(page_number, category);
+      descriptor_->space_changed = true;
+    }
+  }
+}
+
+PageId File::nextUsedPage(const PageId page_number) const {
+  std::lock_guard<std::mutex> lock(descriptor_->directory_mutex);
+  return descriptor_->directory.nextUsed(page_number);
+}
+
+const Page* File::viewPage(const PageId page_number) const {
+  if (descriptor_->mapping == NULL) {
+    throw FileModeException(filename_);
   }
-  // Page on disk may have had its next page pointer updated since it was read;
-  // we don't modify that, but we do keep all the other modifications to the
-  // page header.
-  const PageId next_page_number = header.next_page_number;
-  header = new_page.header_;
-  header.next_page_number = next_page_number;
-  writePage(new_page.page_number(), header, new_page);
+  const FileHeader header = readHeader();
+  const off_t position = pagePosition(page_number);
+  // Page 0 is the file header; in legacy files it would even lie before the
+  // start of the mapping.
+  if (page_number == Page::INVALID_NUMBER || position < 0 ||
+      page_number >= header.num_pages ||
+      static_cast<std::size_t>(position) + Page::SIZE >
+          descriptor_->mapped_length) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  const Page* page =
+      reinterpret_cast<const Page*>(descriptor_->mapping + position);
+  if (!page->isUsed()) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  noteMappedRead(page_number);
+  return page;
 }
 
 void File::deletePage(const PageId page_number) {
-  FileHeader header = readHeader();
-  Page existing_page = readPage(page_number);
-  Page previous_page;
-  // If this page is the head of the used list, update the header to point to
-  // the next page in line.
-  if (page_number == header.first_used_page) {
-    header.first_used_page = existing_page.next_page_number();
-  } else {
-    // Walk the used list so we can update the page that points to this one.
-    for (FileIterator iter = begin(); iter != end(); ++iter) {
-      previous_page = *iter;
-      if (previous_page.next_page_number() == existing_page.page_number()) {
-        previous_page.set_next_page_number(existing_page.next_page_number());
-        break;
-      }
+  checkWritable();
+  DirectoryUpdate update(*this);
+  Page free_page;
+  {
+    std::lock_guard<std::mutex> lock(descriptor_->directory_mutex);
+    const PageDirectory& directory = descriptor_->directory;
+    if (!directory.isUsed(page_number)) {
+      throw InvalidPageException(page_number, filename_);
+    }
+    // Clear the page and add it to the head of the free list.
+    free_page.set_next_page_number(directory.firstFree());
+  }
+  writePage(page_number, free_page);
+  {
+    std::lock_guard<std::mutex> lock(descriptor_->directory_mutex);
+    descriptor_->directory.release(page_number);
+    descriptor_->free_space.remove(page_number);
+  }
+  update.publish(page_number, false /* used */);
+}
+
+void File::sync() {
+  if (descriptor_->mapping != NULL) {
+    return;
+  }
+  // Pages first, so that the header never describes pages not on disk
+  if (fdatasync(descriptor_->fd) != 0) {
+    throw FileIOException(filename_);
+  }
+  bool dirty;
+  {
+    std::lock_guard<std::mutex> lock(descriptor_->header_mutex);
+    dirty = descriptor_->header_dirty;
+  }
+  bool flushed = false;
+  if (dirty) {
+    DirectoryUpdate update(*this);
+    flushed = flushHeader();
+  }
+  if (flushed && fdatasync(descriptor_->fd) != 0) {
+    throw FileIOException(filename_);
+  }
+}
+
+void File::syncRange(const PageId first_page, const PageId num_pages) {
+#ifdef SYNC_FILE_RANGE_WRITE
+  if (descriptor_->mapping != NULL || num_pages == 0) {
+    return;
+  }
+  if (sync_file_range(descriptor_->fd, pagePosition(first_page),
+                      static_cast<off_t>(num_pages) * Page::SIZE,
+                      SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                          SYNC_FILE_RANGE_WAIT_AFTER) != 0) {
+    throw FileIOException(filename_);
+  }
+#else
+  sync();
+#endif
+}
+
+void File::groupSync() {
+  Descriptor& descriptor = *descriptor_;
+  std::unique_lock<std::mutex> lock(descriptor.sync_mutex);
+  const std::uint64_t request = ++descriptor.sync_requests;
+  while (descriptor.synced < request) {
+    if (descriptor.syncing) {
+      descriptor.sync_done.wait(lock);
+      continue;
+    }
+    // Everyone who has asked so far wrote before asking, so this sync covers
+    // them all
+    const std::uint64_t covered = descriptor.sync_requests;
+    descriptor.syncing = true;
+    lock.unlock();
+    std::exception_ptr error;
+    try {
+      sync();
+    } catch (...) {
+      error = std::current_exception();
+    }
+    lock.lock();
+    descriptor.syncing = false;
+    if (!error) {
+      descriptor.synced = covered;
+    }
+    // On failure, waiters try a sync of their own
+    descriptor.sync_done.notify_all();
+    if (error) {
+      std::rethrow_exception(error);
     }
   }
-  // Clear the page and add it to the head of the free list.
-  existing_page.initialize();
-  existing_page.set_next_page_number(header.first_free_page);
-  header.first_free_page = page_number;
-  ++header.num_free_pages;
-  if (previous_page.isUsed()) {
-    writePage(previous_page.page_number(), previous_page);
+}
+
+std::uint64_t File::pageVersion(const PageId page_number) const {
+  std::lock_guard<std::mutex> lock(versions_mutex_);
+  const PageVersions& versions = page_versions_[filename_];
+  if (page_number < versions.pages.size() &&
+      versions.pages[page_number] != 0) {
+    return versions.pages[page_number];
   }
-  writePage(page_number, existing_page);
-  writeHeader(header);
+  return versions.opened;
 }
 
 FileIterator File::begin() {
+  refresh();
   const FileHeader& header = readHeader();
   return FileIterator(this, header.first_used_page);
 }
@@ -220,50 +660,172 @@ FileIterator File::end() {
   return FileIterator(this, Page::INVALID_NUMBER);
 }
 
-File::File(const std::string& name, const bool create_new) : filename_(name) {
-  openIfNeeded(create_new);
+File::File(const std::string& name, const bool create_new,
+           const FileMode mode)
+    : filename_(name) {
+  openIfNeeded(create_new, mode);
 
   if (create_new) {
     // File starts with 1 page (the header).
     FileHeader header = {1 /* num_pages */, 0 /* first_used_page */,
                          0 /* num_free_pages */, 0 /* first_free_page */};
+    DirectoryUpdate update(*this, false /* catch_up */);
     writeHeader(header);
+    // The format must be on disk before any page is
+    flushHeader();
   }
 }
 
-void File::openIfNeeded(const bool create_new) {
+void File::openIfNeeded(const bool create_new, const FileMode mode) {
   if (open_counts_.find(filename_) != open_counts_.end()) {	//exists an entry already
     ++open_counts_[filename_];
-    stream_ = open_streams_[filename_];
+    descriptor_ = open_descriptors_[filename_];
   } else {
-    std::ios_base::openmode mode =
-        std::fstream::in | std::fstream::out | std::fstream::binary;
+    int flags = mode == FileMode::MAPPED ? O_RDONLY : O_RDWR;
     const bool already_exists = exists(filename_);
     if (create_new) {
       // Error if we try to overwrite an existing file.
       if (already_exists) {
         throw FileExistsException(filename_);
       }
-      // New files have to be truncated on open.
-      mode = mode | std::fstream::trunc;
+      flags |= O_CREAT | O_TRUNC;
     } else {
       // Error if we try to open a file that doesn't exist.
       if (!already_exists) {
         throw FileNotFoundException(filename_);
       }
     }
-    stream_.reset(new std::fstream(filename_, mode));
-    open_streams_[filename_] = stream_;
+    const int fd = ::open(filename_.c_str(), flags, 0644);
+    if (fd < 0) {
+      throw FileIOException(filename_);
+    }
+    std::shared_ptr<Descriptor> descriptor(new Descriptor(fd));
+    descriptor->format = FORMAT_ALIGNED;
+    if (mode != FileMode::MAPPED) {
+      descriptor->log_fd = fd;
+    }
+    if (!create_new) {
+      FormatBlock block = FormatBlock();
+      struct iovec iov = {&block, sizeof(block)};
+      if (!readAt(fd, &iov, 1, 0 /* offset */)) {
+        throw FileIOException(filename_);
+      }
+      if (block.magic != FORMAT_MAGIC) {
+        descriptor->format = FORMAT_LEGACY;
+      } else if (block.format != FORMAT_ALIGNED ||
+                 block.page_size != Page::SIZE) {
+        throw FileIOException(filename_);
+      }
+    }
+    descriptor->first_page_offset = descriptor->format == FORMAT_LEGACY
+                                        ? sizeof(FileHeader)
+                                        : Page::SIZE;
+    // Legacy pages are not aligned, and some filesystems refuse O_DIRECT;
+    // either way the file stays buffered
+    if (mode == FileMode::DIRECT && descriptor->format == FORMAT_ALIGNED) {
+      const int status = fcntl(fd, F_GETFL);
+      descriptor->direct =
+          status >= 0 && fcntl(fd, F_SETFL, status | O_DIRECT) == 0;
+    }
+    if (mode == FileMode::MAPPED) {
+      struct stat status;
+      if (fstat(fd, &status) != 0) {
+        throw FileIOException(filename_);
+      }
+      // An empty mapping is not allowed; an empty file gets a byte that is
+      // never read
+      descriptor->mapped_length = std::max<std::size_t>(status.st_size, 1);
+      void* mapping = mmap(NULL, descriptor->mapped_length, PROT_READ,
+                           MAP_SHARED, fd, 0);
+      if (mapping == MAP_FAILED) {
+        throw FileIOException(filename_);
+      }
+      descriptor->mapping = static_cast<char*>(mapping);
+      descriptor->mapped_length = status.st_size;
+    }
+    descriptor_ = descriptor;
+    if (mode == FileMode::MAPPED) {
+      FormatBlock block = FormatBlock();
+      readBytes(&block, sizeof(block), 0 /* offset */);
+      descriptor->directory_stamp =
+          descriptor->format == FORMAT_ALIGNED ? block.directory_stamp : 0;
+      loadDirectory(descriptor->directory_stamp);
+    } else if (!create_new) {
+      if (descriptor->format == FORMAT_LEGACY) {
+        descriptor->log_fd =
+            ::open(logName(filename_).c_str(), O_RDWR | O_CREAT, 0644);
+        if (descriptor->log_fd < 0) {
+          throw FileIOException(filename_);
+        }
+      }
+      // Under the lock, so that no other process is halfway through a change
+      DirectoryUpdate update(*this, false /* catch_up */);
+      FormatBlock block = FormatBlock();
+      readLog(&block, sizeof(block));
+      descriptor->generation = block.generation;
+      if (descriptor->format == FORMAT_ALIGNED) {
+        descriptor->directory_stamp = block.directory_stamp;
+        descriptor->last_stamp = block.directory_stamp;
+      }
+      loadDirectory(descriptor->directory_stamp);
+    }
+    open_descriptors_[filename_] = descriptor_;
     open_counts_[filename_] = 1;
+    std::lock_guard<std::mutex> lock(versions_mutex_);
+    page_versions_[filename_].opened = ++version_counter_;
   }
 }
 
 void File::close() {
-  --open_counts_[filename_];
-  stream_.reset();
+  if (--open_counts_[filename_] == 0 && descriptor_->mapping == NULL) {
+    // Last one out writes back the directory and the header, after the pages
+    // they describe, and after catching up with other processes so as not to
+    // undo their changes
+    try {
+      DirectoryUpdate update(*this);
+      bool dirty;
+      {
+        std::lock_guard<std::mutex> lock(descriptor_->header_mutex);
+        dirty = descriptor_->header_dirty;
+      }
+      bool space_changed;
+      {
+        std::lock_guard<std::mutex> lock(descriptor_->directory_mutex);
+        space_changed = descriptor_->space_changed;
+      }
+      if (descriptor_->format == FORMAT_ALIGNED &&
+          (dirty || space_changed || descriptor_->directory_stamp == 0)) {
+        // Otherwise the saved directory and the header on disk still
+        // describe the file
+        const std::uint64_t stamp = ++descriptor_->last_stamp;
+        if (fdatasync(descriptor_->fd) != 0) {
+          throw FileIOException(filename_);
+        }
+        saveDirectory(stamp);
+        {
+          std::lock_guard<std::mutex> lock(descriptor_->header_mutex);
+          descriptor_->header_dirty = true;
+        }
+        flushHeader(stamp);
+        if (fdatasync(descriptor_->fd) != 0) {
+          throw FileIOException(filename_);
+        }
+      } else if (descriptor_->format == FORMAT_LEGACY && dirty) {
+        if (fdatasync(descriptor_->fd) != 0) {
+          throw FileIOException(filename_);
+        }
+        flushHeader();
+      }
+    } catch (BadgerDbException& e) {
+      std::cout << e.message() << std::endl;
+    }
+  }
+  descriptor_.reset();
   if (open_counts_[filename_] == 0) {
-    open_streams_.erase(filename_);
+    open_descriptors_.erase(filename_);
     open_counts_.erase(filename_);
+    std::lock_guard<std::mutex> lock(versions_mutex_);
+    page_versions_.erase(filename_);
   }
 }
 
@@ -273,33 +835,414 @@ void File::writePage(const PageId page_number, const Page& new_page) {
 
 void File::writePage(const PageId page_number, const PageHeader& header,
                      const Page& new_page) {
-  stream_->seekp(pagePosition(page_number), std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(header));
-  stream_->write(reinterpret_cast<const char*>(&new_page.data_[0]),
-                 Page::DATA_SIZE);
-  stream_->flush();
+  checkWritable();
+  bumpVersion(page_number);
+
+  struct iovec iov[2] = {
+      {const_cast<PageHeader*>(&header), sizeof(header)},
+      {const_cast<char*>(&new_page.data_[0]), Page::DATA_SIZE}};
+  int iovcnt = 2;
+  if (descriptor_->direct) {
+    // Write straight from the page if it already holds the header to write
+    if (isAligned(&new_page, Page::SIZE) &&
+        std::memcmp(&header, &new_page.header_, sizeof(header)) == 0) {
+      iov[0].iov_base = const_cast<Page*>(&new_page);
+    } else {
+      char* buffer = alignedBuffer();
+      std::memcpy(buffer, &header, sizeof(header));
+      std::memcpy(buffer + sizeof(header), &new_page.data_[0],
+                  Page::DATA_SIZE);
+      iov[0].iov_base = buffer;
+    }
+    iov[0].iov_len = Page::SIZE;
+    iovcnt = 1;
+  }
+  if (!writeAt(descriptor_->fd, iov, iovcnt, pagePosition(page_number))) {
+    throw FileIOException(filename_);
+  }
+  noteFreeSpace(page_number, header);
 }
 
-FileHeader File::readHeader() const {
-  FileHeader header;
-  stream_->seekg(0 /* pos */, std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(header));
+void File::bumpVersion(const PageId page_number) {
+  std::lock_guard<std::mutex> lock(versions_mutex_);
+  std::vector<std::uint64_t>& versions = page_versions_[filename_].pages;
+  if (page_number >= versions.size()) {
+    versions.resize(page_number + 1, 0);
+  }
+  versions[page_number] = ++version_counter_;
+}
 
-  return header;
+FileHeader File::readHeader() const {
+  std::lock_guard<std::mutex> lock(descriptor_->header_mutex);
+  return descriptor_->header;
 }
 
 void File::writeHeader(const FileHeader& header) {
-  stream_->seekp(0 /* pos */, std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(header));
-  stream_->flush();
+  checkWritable();
+  std::lock_guard<std::mutex> lock(descriptor_->header_mutex);
+  descriptor_->header = header;
+  descriptor_->header_dirty = true;
+}
+
+void File::loadDirectory(const std::uint64_t directory_stamp) const {
+  FormatBlock block = FormatBlock();
+  readBytes(&block,
+            descriptor_->format == FORMAT_LEGACY ? sizeof(FileHeader)
+                                                 : sizeof(block),
+            0 /* offset */);
+  const FileHeader header = block.header;
+  PageDirectory directory;
+  std::vector<std::uint8_t> categories;
+  const bool saved =
+      directory_stamp != 0 &&
+      readDirectory(directory_stamp, block.generation, header.num_pages,
+                    directory, categories);
+  if (!saved) {
+    // Never saved, or changed since: each page tells whether it is used and
+    // how much room it has, pages written after the last header write before
+    // a crash included
+    struct stat status;
+    if (fstat(descriptor_->fd, &status) != 0) {
+      throw FileIOException(filename_);
+    }
+    PageId num_pages = header.num_pages;
+    if (status.st_size > descriptor_->first_page_offset) {
+      const PageId on_disk = static_cast<PageId>(
+          (status.st_size - descriptor_->first_page_offset + Page::SIZE - 1) /
+              Page::SIZE + 1);
+      num_pages = std::max(num_pages, on_disk);
+    }
+    std::vector<std::uint64_t> bitmap((num_pages + 63) / 64, 0);
+    categories.assign(num_pages, 0);
+    for (PageId page_number = 1; page_number < num_pages; ++page_number) {
+      const PageHeader page_header = readPageHeader(page_number);
+      if (page_header.current_page_number != Page::INVALID_NUMBER) {
+        bitmap[page_number / 64] |= static_cast<std::uint64_t>(1)
+                                    << (page_number % 64);
+        categories[page_number] =
+            FreeSpaceMap::categoryOf(recordSpace(page_header));
+      }
+    }
+    directory.assign(num_pages, bitmap);
+  }
+  const FileHeader loaded = headerOf(directory);
+  std::lock_guard<std::mutex> directory_lock(descriptor_->directory_mutex);
+  descriptor_->directory = directory;
+  descriptor_->free_space.clear();
+  for (PageId page_number = directory.firstUsed();
+       page_number != Page::INVALID_NUMBER;
+       page_number = directory.nextUsed(page_number)) {
+    descriptor_->free_space.update(page_number, categories[page_number]);
+  }
+  descriptor_->space_changed = false;
+  if (!saved) {
+    descriptor_->directory_stamp = 0;
+  }
+  std::lock_guard<std::mutex> header_lock(descriptor_->header_mutex);
+  descriptor_->header = loaded;
+  // The header on disk may name another free page first; it is rewritten
+  // with the saved directory, once the file changes
+  descriptor_->header_dirty = !saved && !(loaded == header);
+}
+
+bool File::readDirectory(const std::uint64_t directory_stamp,
+                         const std::uint64_t generation,
+                         const PageId num_pages, PageDirectory& directory,
+                         std::vector<std::uint8_t>& categories) const {
+  const int fd = ::open(directoryName(filename_).c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  DirectoryBlock block = DirectoryBlock();
+  std::vector<std::uint64_t> bitmap((num_pages + 63) / 64, 0);
+  categories.assign(num_pages, 0);
+  struct iovec iov[3] = {{&block, sizeof(block)},
+                         {bitmap.data(), bitmap.size() * sizeof(bitmap[0])},
+                         {categories.data(), categories.size()}};
+  struct stat status;
+  const bool valid =
+      fstat(fd, &status) == 0 &&
+      static_cast<std::size_t>(status.st_size) ==
+          sizeof(block) + bitmap.size() * sizeof(bitmap[0]) +
+              categories.size() &&
+      readAt(fd, iov, 3, 0 /* offset */) && block.magic == DIRECTORY_MAGIC &&
+      block.stamp == directory_stamp && block.generation == generation &&
+      block.num_pages == num_pages && block.page_size == Page::SIZE;
+  ::close(fd);
+  if (valid) {
+    directory.assign(num_pages, bitmap);
+  }
+  return valid;
+}
+
+void File::saveDirectory(const std::uint64_t directory_stamp) const {
+  DirectoryBlock block = DirectoryBlock();
+  std::vector<std::uint64_t> bitmap;
+  std::vector<std::uint8_t> categories;
+  {
+    std::lock_guard<std::mutex> lock(descriptor_->directory_mutex);
+    block.num_pages = descriptor_->directory.numPages();
+    bitmap = descriptor_->directory.bitmap();
+    categories = descriptor_->free_space.categories();
+    descriptor_->space_changed = false;
+  }
+  categories.resize(block.num_pages, 0);
+  block.magic = DIRECTORY_MAGIC;
+  block.stamp = directory_stamp;
+  block.page_size = Page::SIZE;
+  block.generation = descriptor_->generation;
+  const int fd = ::open(directoryName(filename_).c_str(),
+                        O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw FileIOException(filename_);
+  }
+  struct iovec iov[3] = {{&block, sizeof(block)},
+                         {bitmap.data(), bitmap.size() * sizeof(bitmap[0])},
+                         {categories.data(), categories.size()}};
+  const bool written = writeAt(fd, iov, 3, 0 /* offset */) && fdatasync(fd) == 0;
+  ::close(fd);
+  if (!written) {
+    throw FileIOException(filename_);
+  }
+}
+
+bool File::flushHeader(const std::uint64_t directory_stamp) {
+  FormatBlock block = FormatBlock();
+  {
+    std::lock_guard<std::mutex> lock(descriptor_->header_mutex);
+    if (!descriptor_->header_dirty) {
+      return false;
+    }
+    block.header = descriptor_->header;
+    descriptor_->header_dirty = false;
+  }
+  block.magic = FORMAT_MAGIC;
+  block.format = FORMAT_ALIGNED;
+  block.page_size = Page::SIZE;
+  block.directory_stamp = directory_stamp;
+  block.generation = descriptor_->generation;
+  if (!writeFormatBlock(descriptor_->fd, descriptor_->format == FORMAT_LEGACY,
+                        descriptor_->direct, block)) {
+    std::lock_guard<std::mutex> lock(descriptor_->header_mutex);
+    descriptor_->header_dirty = true;
+    throw FileIOException(filename_);
+  }
+  descriptor_->directory_stamp = directory_stamp;
+  return true;
+}
+
+// Each change bumps the generation in the format block and is logged as
+// entry generation % CHANGE_LOG after it; files in the old format have no
+// room for the log and keep it in the file named by logName().  A process
+// replays the changes it has not seen, or rebuilds its directory from the
+// pages if it has fallen further behind than the log reaches.
+void File::catchUp() const {
+  Descriptor& descriptor = *descriptor_;
+  FormatBlock block = FormatBlock();
+  readLog(&block, sizeof(block));
+  // A stamp names a directory saved at the generation on disk, since every
+  // change clears it
+  descriptor.last_stamp =
+      std::max(descriptor.last_stamp, block.directory_stamp);
+  if (block.generation == descriptor.generation) {
+    descriptor.directory_stamp = block.directory_stamp;
+    return;
+  }
+  if (block.generation < descriptor.generation ||
+      block.generation - descriptor.generation > CHANGE_LOG) {
+    // Too far behind for the log, or a change of this process's own never
+    // reached the disk
+    loadDirectory(0 /* directory_stamp */);
+  } else {
+    char bytes[HEADER_BLOCK_LENGTH];
+    readLog(bytes, sizeof(bytes));
+    std::lock_guard<std::mutex> directory_lock(descriptor.directory_mutex);
+    PageDirectory& directory = descriptor.directory;
+    for (std::uint64_t generation = descriptor.generation + 1;
+         generation <= block.generation; ++generation) {
+      DirectoryChange change;
+      std::memcpy(&change,
+                  bytes + CHANGE_LOG_OFFSET +
+                      generation % CHANGE_LOG * sizeof(change),
+                  sizeof(change));
+      if (change.used != 0) {
+        // Its room is not known until this process writes it
+        directory.claim(change.page_number);
+      } else if (directory.isUsed(change.page_number)) {
+        directory.release(change.page_number);
+        descriptor.free_space.remove(change.page_number);
+      }
+    }
+    std::lock_guard<std::mutex> header_lock(descriptor.header_mutex);
+    descriptor.header = headerOf(directory);
+    descriptor.header_dirty = true;
+  }
+  descriptor.generation = block.generation;
+  descriptor.directory_stamp = block.directory_stamp;
+}
+
+void File::readLog(void* buffer, const std::size_t length) const {
+  if (descriptor_->log_fd == descriptor_->fd) {
+    readBytes(buffer, length, 0 /* offset */);
+    return;
+  }
+  // A log just created reads as zeros
+  std::memset(buffer, 0, length);
+  struct iovec iov = {buffer, length};
+  if (!readAt(descriptor_->log_fd, &iov, 1, 0 /* offset */)) {
+    throw FileIOException(filename_);
+  }
+}
+
+void File::refresh() const {
+  if (descriptor_->mapping == NULL) {
+    DirectoryUpdate update(*this);
+  }
+}
+
+// Processes, and File objects of one process that opened the file under
+// different names, are kept apart by an open file description lock on the
+// first byte of the file, see fcntl(2).  Allocating and deleting pages,
+// syncing and closing take it, and so do reading a page past the end of the
+// file, writing back a page thought free and FileIterator, to catch up;
+// findPageWithSpace() does not, so it may name a page another process has
+// since deleted.
+File::DirectoryUpdate::DirectoryUpdate(const File& file, const bool catch_up)
+    : file_(file),
+      lock_(file.descriptor_->update_mutex) {
+  Descriptor& descriptor = *file_.descriptor_;
+  if (descriptor.owner != getpid()) {
+    // Forked: the open file description, and with it the lock, is still the
+    // parent's
+    const int fd = ::open(file_.filename_.c_str(),
+                          O_RDWR | (descriptor.direct ? O_DIRECT : 0));
+    const bool reopened = fd >= 0 && dup2(fd, descriptor.fd) >= 0;
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    if (!reopened) {
+      throw FileIOException(file_.filename_);
+    }
+    descriptor.owner = getpid();
+  }
+  if (!lockDirectory(descriptor.fd, F_WRLCK)) {
+    throw FileIOException(file_.filename_);
+  }
+  if (catch_up) {
+    try {
+      file_.catchUp();
+    } catch (...) {
+      lockDirectory(descriptor.fd, F_UNLCK);
+      throw;
+    }
+  }
+}
+
+File::DirectoryUpdate::~DirectoryUpdate() {
+  // Closing the file lets go of the lock too, so a failure does no lasting
+  // harm
+  lockDirectory(file_.descriptor_->fd, F_UNLCK);
+}
+
+void File::DirectoryUpdate::publish(const PageId page_number,
+                                    const bool used) {
+  Descriptor& descriptor = *file_.descriptor_;
+  {
+    std::lock_guard<std::mutex> directory_lock(descriptor.directory_mutex);
+    std::lock_guard<std::mutex> header_lock(descriptor.header_mutex);
+    descriptor.header = headerOf(descriptor.directory);
+    descriptor.header_dirty = true;
+  }
+  // Counted even if the write fails, so that catching up rebuilds the
+  // directory from the pages
+  const std::uint64_t generation = ++descriptor.generation;
+  const DirectoryChange change = {page_number, used ? 1u : 0u};
+  if (!writeChange(descriptor.log_fd, descriptor.direct, generation, change)) {
+    throw FileIOException(file_.filename_);
+  }
+  if (descriptor.directory_stamp != 0) {
+    // The first change after a clean close makes sure a crash rebuilds the
+    // directory rather than trusting the one saved
+    descriptor.directory_stamp = 0;
+    if (fdatasync(descriptor.fd) != 0) {
+      throw FileIOException(file_.filename_);
+    }
+  }
 }
 
 PageHeader File::readPageHeader(PageId page_number) const {
-  PageHeader header;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(header));
+  PageHeader header = PageHeader();
+  readBytes(&header, sizeof(header), pagePosition(page_number));
 
   return header;
 }
 
+void File::readBytes(void* buffer, const std::size_t length,
+                     const off_t offset) const {
+  if (descriptor_->mapping != NULL) {
+    // Bytes past the end of the mapping read as zeros
+    const std::size_t available =
+        static_cast<std::size_t>(offset) < descriptor_->mapped_length
+            ? std::min(length, descriptor_->mapped_length -
+                                   static_cast<std::size_t>(offset))
+            : 0;
+    std::memcpy(buffer, descriptor_->mapping + offset, available);
+    std::memset(static_cast<char*>(buffer) + available, 0, length - available);
+    return;
+  }
+  if (!descriptor_->direct || isAligned(buffer, length)) {
+    struct iovec iov = {buffer, length};
+    if (!readAt(descriptor_->fd, &iov, 1, offset)) {
+      throw FileIOException(filename_);
+    }
+    return;
+  }
+  // Bytes past the end of the file read as zeros
+  const std::size_t aligned_length =
+      (length + DIRECT_ALIGNMENT - 1) / DIRECT_ALIGNMENT * DIRECT_ALIGNMENT;
+  char* aligned = alignedBuffer();
+  std::memset(aligned, 0, aligned_length);
+  struct iovec iov = {aligned, aligned_length};
+  if (!readAt(descriptor_->fd, &iov, 1, offset)) {
+    throw FileIOException(filename_);
+  }
+  std::memcpy(buffer, aligned, length);
+}
+
+void File::checkWritable() const {
+  if (descriptor_->mapping != NULL) {
+    throw FileModeException(filename_);
+  }
+}
+
+void File::noteMappedRead(const PageId page_number) const {
+  Descriptor& descriptor = *descriptor_;
+  const bool next = descriptor.last_read.exchange(page_number) + 1 == page_number;
+  int score = descriptor.sequential_score.load();
+  score = next ? std::min(score + 1, ADVICE_WINDOW)
+               : std::max(score - 1, -ADVICE_WINDOW);
+  descriptor.sequential_score.store(score);
+
+  int advice = descriptor.advice.load();
+  if (score >= ADVICE_WINDOW / 2) {
+    advice = MADV_SEQUENTIAL;
+  } else if (score <= -ADVICE_WINDOW / 2) {
+    advice = MADV_RANDOM;
+  }
+  if (descriptor.advice.exchange(advice) != advice) {
+    // Advice only tunes read-ahead, so a failure is of no consequence
+    madvise(descriptor.mapping, descriptor.mapped_length, advice);
+  }
+}
+
+File::Descriptor::~Descriptor() {
+  if (mapping != NULL) {
+    munmap(mapping, std::max<std::size_t>(mapped_length, 1));
+  }
+  if (log_fd >= 0 && log_fd != fd) {
+    ::close(log_fd);
+  }
+  ::close(fd);
+}
+
 }
@@ -7,17 +7,48 @@
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
 #include <fstream>
 #include <string>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <vector>
+#include <sys/types.h>
+#include <unistd.h>
 
+#include "free_space_map.h"
 #include "page.h"
+#include "page_directory.h"
 
 namespace badgerdb {
 
 class FileIterator;
 
+/**
+ * @brief How a File reaches the disk.
+ */
+enum class FileMode {
+  /**
+   * Reads and writes go through the kernel page cache.
+   */
+  BUFFERED,
+
+  /**
+   * Reads and writes bypass the kernel page cache (O_DIRECT), so that pages
+   * cached in the buffer pool are not cached a second time by the kernel.
+   */
+  DIRECT,
+
+  /**
+   * Read-only: the file is mapped into memory, pages are read by copying them
+   * out of the mapping, and File::viewPage() hands them out in place.  Writes
+   * throw FileModeException.
+   */
+  MAPPED
+};
+
 /**
  * @brief Header metadata for files on disk which contain pages.
  */
@@ -60,15 +91,24 @@ struct FileHeader {
  * @brief Class which represents a file in the filesystem containing database
  *        pages.
  *
- * The File class wraps a stream to an underlying file on disk.  Files contain
- * fixed-sized pages, and they never deallocate space (though they do reuse
- * deleted pages if possible).  If multiple File objects refer to the same
- * underlying file, they will share the stream in memory.
+ * The File class wraps a descriptor of an underlying file on disk.  Files
+ * contain fixed-sized pages, and they never deallocate space (though they do
+ * reuse deleted pages if possible).  If multiple File objects refer to the same
+ * underlying file, they will share the descriptor.
  * If a file that has already been opened (possibly by another query), then the File class
- * detects this (by looking in the open_streams_ map) and just returns a file object with
- * the already created stream for the file without actually opening the UNIX file again. 
+ * detects this (by looking in the open_descriptors_ map) and just returns a file object with
+ * the already opened descriptor for the file without actually opening the UNIX file again. 
+ *
+ * Pages are read and written with positional I/O, so readPage() and
+ * writePage() may be called from many threads at once as long as no two write
+ * the same page; writes become durable at the next sync(), syncRange() or
+ * groupSync().  Which pages are used, and how much room each has, is kept in
+ * memory and saved next to the file when it is closed.  That directory is the
+ * authority on the used and free lists: the next page pointer on disk may lag
+ * behind until the page is read or written.  Processes sharing the file keep
+ * their directories in step, see DirectoryUpdate, but not their pages.
  *
- * @warning This class is not threadsafe.
+ * @warning Opening, closing, allocating and deleting pages are not threadsafe.
  */
 class File {
  public:
@@ -76,24 +116,35 @@ class File {
    * Creates a new file.
    *
    * @param filename  Name of the file.
+   * @param mode      How to reach the disk, see open().
    * @throws  FileExistsException     If the requested file already exists.
+   * @throws  FileModeException       If mode is FileMode::MAPPED.
    */
-  static File create(const std::string& filename);
+  static File create(const std::string& filename,
+                     const FileMode mode = FileMode::BUFFERED);
 
   /**
    * Opens the file named fileName and returns the corresponding File object.
-	 * It first checks if the file is already open. If so, then the new File object created uses the same input-output stream to read to or write fom
+	 * It first checks if the file is already open. If so, then the new File object created uses the same file descriptor to read to or write fom
 	 * that already open file. Reference count (open_counts_ static variable inside the File object) is incremented whenever an already open file is
-	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the stream associated with this File object are inserted into the
-	 * open_streams_ map.
+	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the descriptor associated with this File object are inserted into the
+	 * open_descriptors_ map.
+   *
+   * A file that is already open keeps the mode it was first opened with.
+   * FileMode::DIRECT falls back to FileMode::BUFFERED for files in the old
+   * format and on filesystems without direct I/O; mode() tells which is used.
    *
    * @param filename  Name of the file.
+   * @param mode      How to reach the disk.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
+   * @throws  FileIOException         If the file was written with another
+   *                                  page size or a newer format.
    */
-  static File open(const std::string& filename);
+  static File open(const std::string& filename,
+                   const FileMode mode = FileMode::BUFFERED);
 
   /**
-   * Deletes an existing file.
+   * Deletes an existing file, and its saved directory and change log.
    *
    * @param filename  Name of the file.
    * @throws  FileNotFoundException   If the file doesn't exist.
@@ -110,7 +161,7 @@ class File {
 
 
   /**
-   * Returns true if the file exists and is open.
+   * Returns true if the file exists.
    *
    * @param filename  Name of the file.
    */
@@ -155,6 +206,32 @@ class File {
    */
   Page readPage(const PageId page_number) const;
 
+  /**
+   * Reads an existing page from the file into the given page.  In
+   * FileMode::DIRECT, a page at an address aligned to DIRECT_ALIGNMENT, such as
+   * a buffer pool frame, is read into without an intermediate copy.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page to read into; its contents are undefined if the
+   *                      read fails.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPage(const PageId page_number, Page& page) const;
+
+  /**
+   * Returns an existing page in place, without copying it.  The page stays
+   * valid while the file is open.  Its next page pointer is the one on disk,
+   * which may lag behind; FileIterator follows the directory instead.
+   *
+   * @param page_number   Number of page to return.
+   * @return  The page, inside the file's mapping.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   * @throws  FileModeException     If the file is not in FileMode::MAPPED.
+   */
+  const Page* viewPage(const PageId page_number) const;
+
   /**
    * Writes a page into the file, replacing any existing contents.  The page
    * must have been already allocated in this file by a call to allocatePage().
@@ -171,6 +248,55 @@ class File {
    */
   void deletePage(const PageId page_number);
 
+  /**
+   * Returns a used page that had room for a record of the given length when
+   * it was last written, or last passed to updateFreeSpace().  The page may
+   * have filled up since, in the buffer pool; if the record does not fit,
+   * pass the page to updateFreeSpace() and ask again.
+   *
+   * @param length  Length of the record.
+   * @return  Number of a page, or Page::INVALID_NUMBER if no page is known to
+   *          have the room.
+   */
+  PageId findPageWithSpace(const std::size_t length) const;
+
+  /**
+   * Records how much room a page has, ahead of its write-back.
+   *
+   * @param page  Page whose room changed.
+   */
+  void updateFreeSpace(const Page& page);
+
+  /**
+   * Forces all writes made so far to this file to disk (fdatasync).  Does
+   * nothing in FileMode::MAPPED.
+   *
+   * @throws  FileIOException  If the sync fails.
+   */
+  void sync();
+
+  /**
+   * Starts writing the given pages to disk and waits until they are written
+   * (sync_file_range).  Unlike sync(), this neither flushes the disk's write
+   * cache nor writes file metadata, so it does not make the pages durable;
+   * it spreads the writing out ahead of a sync().  Falls back to sync() where
+   * sync_file_range is not available.
+   *
+   * @param first_page    Number of first page to write.
+   * @param num_pages     Number of pages to write.
+   * @throws  FileIOException  If the writing fails.
+   */
+  void syncRange(const PageId first_page, const PageId num_pages);
+
+  /**
+   * Like sync(), but callers from several threads share syncs: a caller
+   * arriving while a sync is under way waits for it to finish and then
+   * joins the next one, which covers everyone who arrived meanwhile.
+   *
+   * @throws  FileIOException  If the sync fails.
+   */
+  void groupSync();
+
   /**
    * Returns the name of the file this object represents.
    *
@@ -178,6 +304,36 @@ class File {
    */
   const std::string& filename() const { return filename_; }
 
+  /**
+   * Returns how this file reaches the disk.
+   */
+  FileMode mode() const {
+    return descriptor_->mapping != NULL
+               ? FileMode::MAPPED
+               : descriptor_->direct ? FileMode::DIRECT : FileMode::BUFFERED;
+  }
+
+  /**
+   * Alignment of memory, offsets and lengths for direct I/O.
+   */
+  static const std::size_t DIRECT_ALIGNMENT = 4096;
+
+  /**
+   * Number of changes to the directory logged in the header block.
+   */
+  static const std::uint64_t CHANGE_LOG = 256;
+
+  /**
+   * Returns a version number for the on-disk contents of a page.  The number
+   * changes whenever the page is written or deleted through any File object
+   * for this file, and whenever the file is reopened, so caches holding copies
+   * of pages outside the buffer pool can tell whether their copy is current.
+   *
+   * @param page_number   Number of page.
+   * @return  Version of the page's on-disk contents.
+   */
+  std::uint64_t pageVersion(const PageId page_number) const;
+
   /**
    * Returns an iterator at the first page in the file.
    *
@@ -201,8 +357,9 @@ class File {
    * @param page_number   Number of page.
    * @return  Position of page in file.
    */
-  static std::streampos pagePosition(const PageId page_number) {
-    return sizeof(FileHeader) + ((page_number - 1) * Page::SIZE);
+  off_t pagePosition(const PageId page_number) const {
+    return descriptor_->first_page_offset +
+        static_cast<off_t>(page_number - 1) * Page::SIZE;
   }
 
   /**
@@ -214,28 +371,32 @@ class File {
    * @see File::open()
    * @param name        Name of file.
    * @param create_new  Whether to create a new file.
+   * @param mode        How to reach the disk.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
    */
-  File(const std::string& name, const bool create_new);
+  File(const std::string& name, const bool create_new, const FileMode mode);
 
   /**
    * Opens the underlying file named in filename_.
    * This method only opens the file if no other File objects exist that access
-   * the same filesystem file; otherwise, it reuses the existing stream.
+   * the same filesystem file; otherwise, it reuses the existing descriptor.
    *
    * @param create_new  Whether to create a new file.
+   * @param mode        How to reach the disk, if the file is not open yet.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
+   * @throws  FileIOException         If the file cannot be opened, or has an
+   *                                  unsupported format.
    */
-  void openIfNeeded(const bool create_new);
+  void openIfNeeded(const bool create_new, const FileMode mode);
 
   /**
-   * Closes the underlying file stream in <stream_>.
+   * Closes the underlying file descriptor in <descriptor_>.
    * This method only closes the file if no other File objects exist that access
    * the same file.
    */
@@ -245,17 +406,24 @@ class File {
    * Reads a page from the file.  If <allow_free> is not set, an exception
    * will be thrown if the page read from disk is not currently in use.
    *
-   * No bounds checking is performed; the underlying file stream will throw
-   * an exception if the page is past the end of the file.
+   * No bounds checking is performed; a page past the end of the file reads
+   * as a free page.
    *
    * @param page_number   Number of page to read.
    * @param allow_free    Whether to allow reading a free (unused) page.
    * @return  The page.
    * @throws  InvalidPageException  If the page is free (unused) and
    *                                allow_free is false.
+   * @throws  FileIOException       If the read fails.
    */
   Page readPage(const PageId page_number, const bool allow_free) const;
 
+  /**
+   * Reads a page from the file into the given page; see readPage() above.
+   */
+  void readPage(const PageId page_number, const bool allow_free,
+                Page& page) const;
+
   /**
    * Writes a page into the file at the given page number.  This does not
    * update ensure that the number in the header equals the position on disk.
@@ -263,6 +431,7 @@ class File {
    *
    * @param page_number Number of page whose contents to replace.
    * @param new_page    Page to write.
+   * @throws  FileIOException  If the write fails.
    */
   void writePage(const PageId page_number, const Page& new_page);
 
@@ -274,59 +443,407 @@ class File {
    * @param page_number Number of page whose contents to replace.
    * @param header      Header of page to write.
    * @param new_page    Page to write.
+   * @throws  FileIOException  If the write fails.
    */
   void writePage(const PageId page_number, const PageHeader& header,
                  const Page& new_page);
 
   /**
-   * Reads the header for this file from disk.
+   * Returns the header to write a page with: the page's own header, except
+   * for the next page pointer, which is taken from the directory.
+   *
+   * @param new_page  Page about to be written.
+   * @return  Header to write.
+   * @throws  InvalidPageException  If the page has been deleted.
+   */
+  PageHeader headerToWrite(const Page& new_page) const;
+
+  /**
+   * Records in the free space map the room of a used page, as given by its
+   * header.
+   *
+   * @param page_number   Number of page.
+   * @param header        Header of the page.
+   */
+  void noteFreeSpace(const PageId page_number, const PageHeader& header);
+
+  /**
+   * Returns the first used page after the given one, or Page::INVALID_NUMBER.
+   *
+   * @param page_number   Number of page.
+   */
+  PageId nextUsedPage(const PageId page_number) const;
+
+  /**
+   * Gives a page a new version number, see pageVersion().
+   *
+   * @param page_number   Number of page being written.
+   */
+  void bumpVersion(const PageId page_number);
+
+  /**
+   * Returns the header for this file, as kept in memory.
    *
    * @return  The file header.
    */
   FileHeader readHeader() const;
 
   /**
-   * Writes the given header to the disk as the header for this file.
+   * Replaces the header for this file in memory.  It reaches the disk at the
+   * next sync, or when the file is closed.
    *
    * @param header  File header to write.
+   * @throws  FileModeException  If the file is open read-only.
    */
   void writeHeader(const FileHeader& header);
 
+  /**
+   * Writes the header for this file to disk if it changed since it was last
+   * written.  The pages it describes must have been synced, and a
+   * DirectoryUpdate must be held.
+   *
+   * @param directory_stamp   Stamp of the saved directory that describes
+   *                          the file, or 0 while the file is open.
+   * @return  True if the header was written.
+   * @throws  FileIOException  If the write fails.
+   */
+  bool flushHeader(const std::uint64_t directory_stamp = 0);
+
+  /**
+   * Reads the header for this file from disk, and loads or rebuilds the
+   * directory and the free space map.  Called when the file is opened, and
+   * by catchUp().
+   *
+   * @param directory_stamp   Stamp in the header on disk.
+   * @throws  FileIOException  If a read fails.
+   */
+  void loadDirectory(const std::uint64_t directory_stamp) const;
+
+  /**
+   * Brings the directory up to date with the changes other processes made
+   * to it, see DirectoryUpdate.  Called with a DirectoryUpdate held.
+   *
+   * @throws  FileIOException  If a read fails.
+   */
+  void catchUp() const;
+
+  /**
+   * Reads length bytes from the start of the header block, or of the log of
+   * a file in the old format.
+   *
+   * @throws  FileIOException  If the read fails.
+   */
+  void readLog(void* buffer, const std::size_t length) const;
+
+  /**
+   * Takes a DirectoryUpdate and lets it go again, just to catch up.  Does
+   * nothing in FileMode::MAPPED.
+   *
+   * @throws  FileIOException  If the lock cannot be taken or a read fails.
+   */
+  void refresh() const;
+
+  /**
+   * Reads the saved directory into the given one.
+   *
+   * @param directory_stamp   Stamp the saved directory must carry.
+   * @param generation        Generation it must have been saved at, that of
+   *                          the header block.
+   * @param num_pages         Number of pages it must describe.
+   * @param directory         Directory to fill in.
+   * @param categories        Set to the saved free space category of each
+   *                          page.
+   * @return  False if there is no saved directory with that stamp,
+   *          generation and number of pages.
+   */
+  bool readDirectory(const std::uint64_t directory_stamp,
+                     const std::uint64_t generation,
+                     const PageId num_pages, PageDirectory& directory,
+                     std::vector<std::uint8_t>& categories) const;
+
+  /**
+   * Saves the directory and the free space map, with the given stamp and the
+   * current generation, and syncs them.
+   *
+   * @throws  FileIOException  If the write fails.
+   */
+  void saveDirectory(const std::uint64_t directory_stamp) const;
+
+  /**
+   * Reads length bytes at offset into buffer.  In FileMode::DIRECT, goes
+   * through an aligned copy unless buffer and length are aligned already.
+   *
+   * @throws  FileIOException  If the read fails.
+   */
+  void readBytes(void* buffer, const std::size_t length,
+                 const off_t offset) const;
+
+  /**
+   * Throws FileModeException if the file is open read-only.
+   */
+  void checkWritable() const;
+
+  /**
+   * Records a read of a page of a mapped file, and advises the kernel to read
+   * ahead or not when the reads turn sequential or random.
+   *
+   * @param page_number   Number of page read.
+   */
+  void noteMappedRead(const PageId page_number) const;
+
   /**
    * Reads only the header of the given page from disk (not the record data
    * or slot table).  No bounds checking is performed.
    *
    * @param page_number   Number of page whose header is to be read.
    * @return  Header of page.
+   * @throws  FileIOException  If the read fails.
    */
   PageHeader readPageHeader(const PageId page_number) const;
 
+  /**
+   * @brief Lock serializing changes to the directory of a file, between the
+   * threads of a process and between processes, held while in scope.
+   *
+   * Taking it catches up with the changes other processes made; each change
+   * made while holding it must be published before letting it go.  Not
+   * available in FileMode::MAPPED.
+   */
+  class DirectoryUpdate {
+   public:
+    /**
+     * Takes the lock.
+     *
+     * @param file      File whose directory is changed.
+     * @param catch_up  Whether to catch up; false while opening the file,
+     *                  before there is a directory to bring up to date.
+     * @throws  FileIOException  If the lock cannot be taken or a read fails.
+     */
+    explicit DirectoryUpdate(const File& file, const bool catch_up = true);
+
+    /**
+     * Lets the lock go.
+     */
+    ~DirectoryUpdate();
+
+    /**
+     * Brings the header in memory up to date with the directory and logs a
+     * change to it for the other processes.
+     *
+     * @param page_number   Number of page allocated or deleted.
+     * @param used          Whether the page was allocated.
+     * @throws  FileIOException  If the write fails.
+     */
+    void publish(const PageId page_number, const bool used);
+
+   private:
+    DirectoryUpdate(const DirectoryUpdate&) = delete;
+    DirectoryUpdate& operator=(const DirectoryUpdate&) = delete;
+
+    const File& file_;
+    std::unique_lock<std::mutex> lock_;
+  };
+
+  /**
+   * @brief Descriptor of an open file, closed when the last File object using
+   * it goes away.
+   */
+  struct Descriptor {
+    /**
+     * The file descriptor.
+     */
+    int fd;
+
+    /**
+     * Descriptor of the file holding the change log: fd itself in the aligned
+     * format, a file of its own in the old format, -1 in FileMode::MAPPED.
+     */
+    int log_fd;
+
+    /**
+     * Format version of the file, FORMAT_LEGACY or FORMAT_ALIGNED.
+     */
+    std::uint32_t format;
+
+    /**
+     * Offset of page 1 in the file.
+     */
+    off_t first_page_offset;
+
+    /**
+     * Whether fd was opened with O_DIRECT.
+     */
+    bool direct;
+
+    /**
+     * The whole file mapped read-only in FileMode::MAPPED, NULL otherwise,
+     * and the length of the mapping.
+     */
+    char* mapping;
+    std::size_t mapped_length;
+
+    /**
+     * Access pattern of a mapped file: the last page read, a score that goes
+     * up with each read of the page after it and down with any other read,
+     * and the advice last given to the kernel.
+     */
+    std::atomic<PageId> last_read;
+    std::atomic<int> sequential_score;
+    std::atomic<int> advice;
+
+    /**
+     * State of groupSync(): requests numbered in order of arrival, the
+     * highest request number a finished sync covers, and whether a sync is
+     * under way.
+     */
+    std::mutex sync_mutex;
+    std::condition_variable sync_done;
+    std::uint64_t sync_requests;
+    std::uint64_t synced;
+    bool syncing;
+
+    /**
+     * The file header, whether it changed since it was last written, and the
+     * lock guarding both.
+     */
+    FileHeader header;
+    bool header_dirty;
+    std::mutex header_mutex;
+
+    /**
+     * Used and free pages, the room in the used ones, whether that room
+     * changed since the directory was loaded or saved, and the lock guarding
+     * them.  Taken before header_mutex when both are needed.
+     */
+    PageDirectory directory;
+    FreeSpaceMap free_space;
+    bool space_changed;
+    std::mutex directory_mutex;
+
+    /**
+     * Stamp in the header on disk, as last seen or written: that of a saved
+     * directory describing the file, or 0.  Stamps are never reused, so the
+     * highest one seen is kept too.
+     */
+    std::uint64_t directory_stamp;
+    std::uint64_t last_stamp;
+
+    /**
+     * Generation of the directory as last seen or published by this process,
+     * and the lock a DirectoryUpdate holds within the process; taken before
+     * directory_mutex.
+     */
+    std::uint64_t generation;
+    std::mutex update_mutex;
+
+    /**
+     * Process whose open file description fd refers to; a child process
+     * inherits the parent's until it takes its first DirectoryUpdate.
+     */
+    pid_t owner;
+
+    explicit Descriptor(const int fd)
+        : fd(fd),
+          log_fd(-1),
+          format(FORMAT_LEGACY),
+          first_page_offset(0),
+          direct(false),
+          mapping(NULL),
+          mapped_length(0),
+          last_read(Page::INVALID_NUMBER),
+          sequential_score(0),
+          advice(0),
+          sync_requests(0),
+          synced(0),
+          syncing(false),
+          header(),
+          header_dirty(false),
+          space_changed(false),
+          directory_stamp(0),
+          last_stamp(0),
+          generation(0),
+          owner(getpid()) {}
+
+    ~Descriptor();
+  };
+
+  /**
+   * Bound of the sequential score of a mapped file; the advice changes when
+   * the score reaches half of it, either way.
+   */
+  static const int ADVICE_WINDOW = 16;
+
+  /**
+   * Format of files whose header is packed in front of the first page.
+   */
+  static const std::uint32_t FORMAT_LEGACY = 1;
+
+  /**
+   * Format of files whose header has a block of its own.
+   */
+  static const std::uint32_t FORMAT_ALIGNED = 2;
+
   typedef std::map<std::string,
-                   std::shared_ptr<std::fstream> > StreamMap;
+                   std::shared_ptr<Descriptor> > DescriptorMap;
   typedef std::map<std::string, int> CountMap;
 
   /**
-   * Streams for opened files.
+   * @brief Write versions of the pages of an open file.
    */
-  static StreamMap open_streams_;
+  struct PageVersions {
+    /**
+     * Version handed out when the file was opened; the version of every page
+     * not written since.
+     */
+    std::uint64_t opened;
+
+    /**
+     * Version of the last write to each page, or 0 if not written since open.
+     */
+    std::vector<std::uint64_t> pages;
+  };
+  typedef std::map<std::string, PageVersions> VersionMap;
+
+  /**
+   * Descriptors of opened files.
+   */
+  static DescriptorMap open_descriptors_;
 
   /**
    * Counts for opened files.
    */
   static CountMap open_counts_;
 
+  /**
+   * Page write versions for opened files.
+   */
+  static VersionMap page_versions_;
+
+  /**
+   * Source of page versions, shared by all files so that versions are never
+   * reused, even across a close and reopen.
+   */
+  static std::uint64_t version_counter_;
+
+  /**
+   * Guards page_versions_ and version_counter_, so that different files can
+   * be written from different threads.
+   */
+  static std::mutex versions_mutex_;
+
   /**
    * Name of the file this object represents.
    */
   std::string filename_;
 
   /**
-   * Stream for underlying filesystem object.
+   * Descriptor of underlying filesystem object.
    */
-  std::shared_ptr<std::fstream> stream_;
+  std::shared_ptr<Descriptor> descriptor_;
 
   friend class FileIterator;
   friend class FileTest;
+  friend class IoEngine;
 };
 
 }
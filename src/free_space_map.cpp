@@ -0,0 +1,89 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "free_space_map.h"
+
+namespace badgerdb {
+
+static_assert(FreeSpaceMap::CATEGORIES % 64 == 0,
+              "the categories must fill whole mask words");
+static_assert(FreeSpaceMap::CATEGORIES <= 256,
+              "a category must fit in a byte");
+
+const std::size_t FreeSpaceMap::CATEGORIES;
+const std::size_t FreeSpaceMap::STEP;
+const std::uint32_t FreeSpaceMap::NOT_MAPPED;
+
+FreeSpaceMap::FreeSpaceMap()
+    : buckets_(CATEGORIES) {
+  clear();
+}
+
+void FreeSpaceMap::clear() {
+  categories_.clear();
+  positions_.clear();
+  for (std::size_t category = 0; category < CATEGORIES; ++category) {
+    buckets_[category].clear();
+  }
+  for (std::size_t word = 0; word < CATEGORIES / 64; ++word) {
+    filled_[word] = 0;
+  }
+}
+
+void FreeSpaceMap::update(const PageId page_number,
+                          const std::uint8_t category) {
+  if (page_number >= positions_.size()) {
+    categories_.resize(page_number + 1, 0);
+    positions_.resize(page_number + 1, NOT_MAPPED);
+  } else if (positions_[page_number] != NOT_MAPPED) {
+    if (categories_[page_number] == category) {
+      return;
+    }
+    remove(page_number);
+  }
+  std::vector<PageId>& bucket = buckets_[category];
+  positions_[page_number] = static_cast<std::uint32_t>(bucket.size());
+  categories_[page_number] = category;
+  bucket.push_back(page_number);
+  filled_[category / 64] |= static_cast<std::uint64_t>(1) << (category % 64);
+}
+
+void FreeSpaceMap::remove(const PageId page_number) {
+  if (page_number >= positions_.size() ||
+      positions_[page_number] == NOT_MAPPED) {
+    return;
+  }
+  const std::uint8_t category = categories_[page_number];
+  std::vector<PageId>& bucket = buckets_[category];
+  // Move the last page of the bucket into the hole
+  const PageId last = bucket.back();
+  bucket[positions_[page_number]] = last;
+  positions_[last] = positions_[page_number];
+  bucket.pop_back();
+  positions_[page_number] = NOT_MAPPED;
+  categories_[page_number] = 0;
+  if (bucket.empty()) {
+    filled_[category / 64] &= ~(static_cast<std::uint64_t>(1) << (category % 64));
+  }
+}
+
+PageId FreeSpaceMap::find(const std::size_t length) const {
+  // Lowest category whose every page has room
+  const std::size_t lowest = (length + STEP - 1) / STEP;
+  for (std::size_t word = lowest / 64; word < CATEGORIES / 64; ++word) {
+    std::uint64_t filled = filled_[word];
+    if (word == lowest / 64) {
+      filled &= ~static_cast<std::uint64_t>(0) << (lowest % 64);
+    }
+    if (filled != 0) {
+      return buckets_[word * 64 + __builtin_ctzll(filled)].back();
+    }
+  }
+  return Page::INVALID_NUMBER;
+}
+
+}
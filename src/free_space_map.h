@@ -0,0 +1,119 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief How much room for a record each used page of a file has, in coarse
+ *        categories, kept in memory.
+ *
+ * Category c stands for at least c * STEP bytes, so a page is only ever
+ * offered for a record that it can hold.  Each category keeps a bucket of its
+ * pages, and a mask tells which buckets are not empty, so updating a page and
+ * finding a page with room for a record take constant time.
+ *
+ * Not threadsafe; File guards each map with a lock.
+ */
+class FreeSpaceMap {
+ public:
+  /**
+   * Number of categories.
+   */
+  static const std::size_t CATEGORIES = 256;
+
+  /**
+   * Bytes each category stands for.
+   */
+  static const std::size_t STEP = (Page::DATA_SIZE + CATEGORIES - 1) / CATEGORIES;
+
+  /**
+   * Returns the category of a page with room for a record of the given
+   * length.
+   *
+   * @param free_bytes  Length of the longest record the page can hold.
+   */
+  static std::uint8_t categoryOf(const std::size_t free_bytes) {
+    return static_cast<std::uint8_t>(
+        free_bytes / STEP < CATEGORIES ? free_bytes / STEP : CATEGORIES - 1);
+  }
+
+  /**
+   * Constructs an empty map.
+   */
+  FreeSpaceMap();
+
+  /**
+   * Forgets all pages.
+   */
+  void clear();
+
+  /**
+   * Records the room a page has, adding the page if it is not in the map.
+   *
+   * @param page_number   Number of page.
+   * @param category      Category of the page, see categoryOf().
+   */
+  void update(const PageId page_number, const std::uint8_t category);
+
+  /**
+   * Takes a page out of the map.  Does nothing if the page is not in it.
+   *
+   * @param page_number   Number of page.
+   */
+  void remove(const PageId page_number);
+
+  /**
+   * Returns a page with room for a record of the given length, picking one
+   * from the lowest category that surely has room, or Page::INVALID_NUMBER if
+   * there is none.
+   *
+   * @param length  Length of the record.
+   */
+  PageId find(const std::size_t length) const;
+
+  /**
+   * Returns the category of each page, by page number; pages not in the map
+   * have category 0.
+   */
+  const std::vector<std::uint8_t>& categories() const { return categories_; }
+
+ private:
+  /**
+   * Marks where a page not in the map would be in its bucket.
+   */
+  static const std::uint32_t NOT_MAPPED = 0xFFFFFFFF;
+
+  /**
+   * Category of each page, by page number.
+   */
+  std::vector<std::uint8_t> categories_;
+
+  /**
+   * Position of each page in its bucket, or NOT_MAPPED.
+   */
+  std::vector<std::uint32_t> positions_;
+
+  /**
+   * Pages of each category.
+   */
+  std::vector<std::vector<PageId> > buckets_;
+
+  /**
+   * Bit per category, set while its bucket is not empty.
+   */
+  std::uint64_t filled_[CATEGORIES / 64];
+};
+
+}
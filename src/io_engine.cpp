@@ -0,0 +1,446 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "io_engine.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define BADGERDB_HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
+#include "exceptions/file_io_exception.h"
+#include "exceptions/invalid_page_exception.h"
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Number of worker threads when io_uring is not used.
+ */
+const std::uint32_t FALLBACK_WORKERS = 4;
+
+#ifdef BADGERDB_HAVE_IO_URING
+int ringEnter(int fd, unsigned to_submit, unsigned min_complete,
+              unsigned flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit,
+                                  min_complete, flags, NULL, 0));
+}
+#endif
+
+}
+
+/**
+ * @brief A page read or write from the time it is queued until it completes.
+ */
+struct IoEngine::Request {
+  bool write;
+  File* file;
+  PageId page_number;
+  off_t offset;
+  Page* page;
+  PageHeader header;
+  struct iovec iov[2];
+  int iovcnt;
+  // Aligned copy of the page for direct I/O, when the page itself is not
+  // aligned or its header differs from the one to write
+  void* aligned;
+  IoCallback done;
+
+  Request() : aligned(NULL) {}
+
+  ~Request() { free(aligned); }
+
+  /**
+   * Points the request at the aligned copy, allocating it.
+   */
+  void useAligned() {
+    if (posix_memalign(&aligned, File::DIRECT_ALIGNMENT, Page::SIZE) != 0) {
+      aligned = NULL;
+      throw std::bad_alloc();
+    }
+    iov[0].iov_base = aligned;
+    iov[0].iov_len = Page::SIZE;
+    iovcnt = 1;
+  }
+};
+
+IoEngine::IoEngine(const std::uint32_t depth, const bool use_uring)
+    : depth_(std::max<std::uint32_t>(depth, 1)),
+      ring_fd_(-1),
+      sq_ring_(NULL),
+      cq_ring_(NULL),
+      sqes_(NULL),
+      sq_ring_size_(0),
+      cq_ring_size_(0),
+      sqes_size_(0),
+      outstanding_(0),
+      stopping_(false) {
+  if (use_uring && setupRing()) {
+    threads_.push_back(std::thread(&IoEngine::reap, this));
+  } else {
+    for (std::uint32_t i = 0; i < std::min(depth_, FALLBACK_WORKERS); i++) {
+      threads_.push_back(std::thread(&IoEngine::work, this));
+    }
+  }
+}
+
+IoEngine::~IoEngine() {
+  drain();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+#ifdef BADGERDB_HAVE_IO_URING
+    if (ring_fd_ >= 0) {
+      // A no-op with no request attached tells the completion thread to stop
+      const std::uint32_t tail = *sq_tail_;
+      const std::uint32_t index = tail & *sq_mask_;
+      struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(sqes_) + index;
+      std::memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = IORING_OP_NOP;
+      sqe->user_data = 0;
+      sq_array_[index] = index;
+      __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+      while (ringEnter(ring_fd_, 1, 0, 0) < 0 && errno == EINTR) {
+      }
+    }
+#endif
+  }
+  changed_.notify_all();
+  for (std::size_t i = 0; i < threads_.size(); i++) {
+    threads_[i].join();
+  }
+  if (ring_fd_ >= 0) {
+    munmap(sqes_, sqes_size_);
+    if (cq_ring_ != sq_ring_) {
+      munmap(cq_ring_, cq_ring_size_);
+    }
+    munmap(sq_ring_, sq_ring_size_);
+    close(ring_fd_);
+  }
+}
+
+bool IoEngine::setupRing() {
+#ifdef BADGERDB_HAVE_IO_URING
+  struct io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  const int fd =
+      static_cast<int>(syscall(__NR_io_uring_setup, depth_, &params));
+  if (fd < 0) {
+    return false;
+  }
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(std::uint32_t);
+  cq_ring_size_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  }
+  sq_ring_ = mmap(NULL, sq_ring_size_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) {
+    close(fd);
+    return false;
+  }
+  cq_ring_ = single_mmap ? sq_ring_
+                         : mmap(NULL, cq_ring_size_, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, fd,
+                                IORING_OFF_CQ_RING);
+  sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  sqes_ = cq_ring_ == MAP_FAILED
+              ? MAP_FAILED
+              : mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (sqes_ == MAP_FAILED) {
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+      munmap(cq_ring_, cq_ring_size_);
+    }
+    munmap(sq_ring_, sq_ring_size_);
+    close(fd);
+    return false;
+  }
+
+  char* sq = static_cast<char*>(sq_ring_);
+  char* cq = static_cast<char*>(cq_ring_);
+  sq_tail_ = reinterpret_cast<std::uint32_t*>(sq + params.sq_off.tail);
+  sq_mask_ = reinterpret_cast<std::uint32_t*>(sq + params.sq_off.ring_mask);
+  sq_array_ = reinterpret_cast<std::uint32_t*>(sq + params.sq_off.array);
+  cq_head_ = reinterpret_cast<std::uint32_t*>(cq + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<std::uint32_t*>(cq + params.cq_off.tail);
+  cq_mask_ = reinterpret_cast<std::uint32_t*>(cq + params.cq_off.ring_mask);
+  cqes_ = cq + params.cq_off.cqes;
+  ring_fd_ = fd;
+  return true;
+#else
+  return false;
+#endif
+}
+
+void IoEngine::read(File* file, const PageId page_number, Page* page,
+                    const IoCallback& done) {
+  std::unique_ptr<Request> request(new Request);
+  request->write = false;
+  request->file = file;
+  request->page_number = page_number;
+  request->offset = file->pagePosition(page_number);
+  request->page = page;
+  request->iov[0].iov_base = &page->header_;
+  request->iov[0].iov_len = sizeof(page->header_);
+  request->iov[1].iov_base = &page->data_[0];
+  request->iov[1].iov_len = Page::DATA_SIZE;
+  request->iovcnt = 2;
+  if (file->mode() == FileMode::DIRECT) {
+    if (reinterpret_cast<std::uintptr_t>(page) % File::DIRECT_ALIGNMENT == 0) {
+      request->iov[0].iov_len = Page::SIZE;
+      request->iovcnt = 1;
+    } else {
+      request->useAligned();
+    }
+  }
+  request->done = done;
+  enqueue(request.release());
+}
+
+std::future<void> IoEngine::read(File* file, const PageId page_number,
+                                 Page* page) {
+  std::shared_ptr<std::promise<void> > promise(new std::promise<void>);
+  read(file, page_number, page, [promise](std::exception_ptr error) {
+    if (error) {
+      promise->set_exception(error);
+    } else {
+      promise->set_value();
+    }
+  });
+  return promise->get_future();
+}
+
+void IoEngine::write(File* file, const Page* page, const IoCallback& done) {
+  file->checkWritable();
+  std::unique_ptr<Request> request(new Request);
+  request->write = true;
+  request->file = file;
+  request->page_number = page->page_number();
+  request->offset = file->pagePosition(request->page_number);
+  request->page = NULL;
+  request->header = file->headerToWrite(*page);
+  request->iov[0].iov_base = &request->header;
+  request->iov[0].iov_len = sizeof(request->header);
+  request->iov[1].iov_base = const_cast<char*>(&page->data_[0]);
+  request->iov[1].iov_len = Page::DATA_SIZE;
+  request->iovcnt = 2;
+  if (file->mode() == FileMode::DIRECT) {
+    if (reinterpret_cast<std::uintptr_t>(page) % File::DIRECT_ALIGNMENT == 0 &&
+        std::memcmp(&request->header, &page->header_,
+                    sizeof(request->header)) == 0) {
+      request->iov[0].iov_base = const_cast<PageHeader*>(&page->header_);
+      request->iov[0].iov_len = Page::SIZE;
+      request->iovcnt = 1;
+    } else {
+      request->useAligned();
+      char* aligned = static_cast<char*>(request->aligned);
+      std::memcpy(aligned, &request->header, sizeof(request->header));
+      std::memcpy(aligned + sizeof(request->header), &page->data_[0],
+                  Page::DATA_SIZE);
+    }
+  }
+  request->done = done;
+  file->bumpVersion(request->page_number);
+  enqueue(request.release());
+}
+
+std::future<void> IoEngine::write(File* file, const Page* page) {
+  std::shared_ptr<std::promise<void> > promise(new std::promise<void>);
+  write(file, page, [promise](std::exception_ptr error) {
+    if (error) {
+      promise->set_exception(error);
+    } else {
+      promise->set_value();
+    }
+  });
+  return promise->get_future();
+}
+
+void IoEngine::enqueue(Request* request) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (outstanding_ >= depth_) {
+    // Requests of ours may be among those waiting to be submitted
+    submitLocked();
+    changed_.wait(lock, [this]() { return outstanding_ < depth_; });
+  }
+  queued_.push_back(request);
+  outstanding_++;
+}
+
+void IoEngine::submit() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  submitLocked();
+}
+
+void IoEngine::drain() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  submitLocked();
+  changed_.wait(lock, [this]() { return outstanding_ == 0; });
+}
+
+IoStats IoEngine::stats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void IoEngine::submitLocked() {
+  if (queued_.empty()) {
+    return;
+  }
+  stats_.submits++;
+  stats_.maxInFlight = std::max(stats_.maxInFlight, outstanding_);
+#ifdef BADGERDB_HAVE_IO_URING
+  if (ring_fd_ >= 0) {
+    // At most depth_ requests are outstanding and the kernel takes every
+    // submitted entry off the ring, so there is room for all of them
+    std::uint32_t tail = *sq_tail_;
+    for (std::size_t i = 0; i < queued_.size(); i++) {
+      Request* request = queued_[i];
+      const std::uint32_t index = tail & *sq_mask_;
+      struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(sqes_) + index;
+      std::memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = request->write ? IORING_OP_WRITEV : IORING_OP_READV;
+      sqe->fd = request->file->descriptor_->fd;
+      sqe->off = request->offset;
+      sqe->addr = reinterpret_cast<std::uintptr_t>(request->iov);
+      sqe->len = request->iovcnt;
+      sqe->user_data = reinterpret_cast<std::uintptr_t>(request);
+      sq_array_[index] = index;
+      tail++;
+    }
+    __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+    std::size_t left = queued_.size();
+    while (left > 0) {
+      const int submitted = ringEnter(ring_fd_, left, 0, 0);
+      if (submitted < 0) {
+        if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+          continue;
+        }
+        throw FileIOException("io_uring");
+      }
+      left -= submitted;
+    }
+    queued_.clear();
+    return;
+  }
+#endif
+  ready_.insert(ready_.end(), queued_.begin(), queued_.end());
+  queued_.clear();
+  changed_.notify_all();
+}
+
+void IoEngine::reap() {
+#ifdef BADGERDB_HAVE_IO_URING
+  for (;;) {
+    std::uint32_t head = *cq_head_;
+    const std::uint32_t tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+      ringEnter(ring_fd_, 0, 1, IORING_ENTER_GETEVENTS);
+      continue;
+    }
+    // The requests were filled in under mutex_ before being submitted; taking
+    // it orders those writes before our reads in the C++ memory model, which
+    // knows nothing of the ordering the kernel provides
+    { std::lock_guard<std::mutex> lock(mutex_); }
+    bool stop = false;
+    for (; head != tail; head++) {
+      const struct io_uring_cqe* cqe =
+          static_cast<struct io_uring_cqe*>(cqes_) + (head & *cq_mask_);
+      Request* request = reinterpret_cast<Request*>(cqe->user_data);
+      const long result = cqe->res;
+      __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+      if (request == NULL) {
+        stop = true;
+      } else {
+        complete(request, result);
+      }
+    }
+    if (stop) {
+      return;
+    }
+  }
+#endif
+}
+
+void IoEngine::work() {
+  for (;;) {
+    Request* request;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      changed_.wait(lock, [this]() { return stopping_ || !ready_.empty(); });
+      if (ready_.empty()) {
+        return;
+      }
+      request = ready_.front();
+      ready_.pop_front();
+    }
+    const int fd = request->file->descriptor_->fd;
+    ssize_t result;
+    do {
+      result = request->write
+                   ? pwritev(fd, request->iov, request->iovcnt, request->offset)
+                   : preadv(fd, request->iov, request->iovcnt, request->offset);
+    } while (result < 0 && errno == EINTR);
+    complete(request, result < 0 ? -errno : result);
+  }
+}
+
+void IoEngine::complete(Request* request, const long result) {
+  if (!request->write && request->aligned != NULL &&
+      result == static_cast<long>(Page::SIZE)) {
+    std::memcpy(request->page, request->aligned, Page::SIZE);
+  }
+  std::exception_ptr error;
+  if (result < 0 || (request->write && result != static_cast<long>(Page::SIZE))) {
+    error = std::make_exception_ptr(FileIOException(request->file->filename()));
+  } else if (!request->write &&
+             (result < static_cast<long>(Page::SIZE) || !request->page->isUsed())) {
+    // Past the end of the file, or free
+    error = std::make_exception_ptr(
+        InvalidPageException(request->page_number, request->file->filename()));
+  }
+  if (!error && !request->write) {
+    // Like File::readPage(), take the next page pointer from the directory
+    request->page->header_.next_page_number =
+        request->file->nextUsedPage(request->page_number);
+  } else if (!error) {
+    request->file->noteFreeSpace(request->page_number, request->header);
+  }
+  request->done(error);
+  const bool write = request->write;
+  delete request;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (write) {
+    stats_.writes++;
+  } else {
+    stats_.reads++;
+  }
+  outstanding_--;
+  changed_.notify_all();
+}
+
+}
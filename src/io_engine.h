@@ -0,0 +1,274 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "file.h"
+#include "page.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Called when an asynchronous page read or write has completed, with
+ * the exception it failed with, or a null pointer on success.  Calls come from
+ * the engine's completion thread.
+ */
+typedef std::function<void(std::exception_ptr error)> IoCallback;
+
+/**
+ * @brief Usage statistics of an IoEngine.
+ */
+struct IoStats {
+  /**
+   * Number of page reads completed.
+   */
+  std::uint64_t reads;
+
+  /**
+   * Number of page writes completed.
+   */
+  std::uint64_t writes;
+
+  /**
+   * Number of times requests were handed to the kernel or the workers.
+   */
+  std::uint64_t submits;
+
+  /**
+   * Largest number of requests that were in flight at once.
+   */
+  std::uint32_t maxInFlight;
+
+  /**
+   * Clear all values.
+   */
+  void clear() {
+    reads = writes = submits = 0;
+    maxInFlight = 0;
+  }
+
+  IoStats() {
+    clear();
+  }
+};
+
+/**
+ * @brief Issues page reads and writes asynchronously, many at a time.
+ *
+ * Requests are queued with read() and write() and handed over in a batch by
+ * submit().  Each one completes by calling its callback, or by making its
+ * future ready.  The engine uses an io_uring instance when the kernel offers
+ * one; otherwise, or when asked to, a small pool of threads performs the
+ * requests with pread/pwrite.  At most the queue depth of requests are in
+ * flight; queuing more waits for earlier ones to complete.
+ *
+ * Pages read are checked like File::readPage() does; a page that is not in
+ * use completes with InvalidPageException.  Writes keep the next page pointer
+ * on disk, like File::writePage(), and fail with InvalidPageException if the
+ * page has been deleted.  The Page passed to read() or write() must stay alive
+ * until the request completes.  Pages of files in FileMode::DIRECT move as one
+ * piece, through an aligned copy when the Page itself is not aligned.
+ *
+ * read(), write() and submit() may be called from several threads.
+ */
+class IoEngine {
+ public:
+  /**
+   * Creates an engine.
+   *
+   * @param depth       Largest number of requests in flight at once.
+   * @param use_uring   Whether to try io_uring; if false, or if io_uring is
+   *                    not available, worker threads are used.
+   */
+  explicit IoEngine(const std::uint32_t depth = 64, const bool use_uring = true);
+
+  /**
+   * Waits for all requests, including queued ones, to complete and shuts the
+   * engine down.
+   */
+  ~IoEngine();
+
+  /**
+   * Returns true if requests go through io_uring, false if through worker
+   * threads.
+   */
+  bool usesUring() const { return ring_fd_ >= 0; }
+
+  /**
+   * Queues a read of a page.
+   *
+   * @param file          File to read from.
+   * @param page_number   Number of page to read.
+   * @param page          Page to read into.
+   * @param done          Called when the read has completed.
+   */
+  void read(File* file, const PageId page_number, Page* page,
+            const IoCallback& done);
+
+  /**
+   * Queues a read of a page.
+   *
+   * @return  Future that is ready when the read has completed, and holds its
+   *          exception if it failed.
+   */
+  std::future<void> read(File* file, const PageId page_number, Page* page);
+
+  /**
+   * Queues a write of a page, to the page number in its header.
+   *
+   * @param file   File to write to.
+   * @param page   Page to write.
+   * @param done   Called when the write has completed.
+   * @throws  InvalidPageException  If the page has been deleted; done is not
+   *                                called then.
+   */
+  void write(File* file, const Page* page, const IoCallback& done);
+
+  /**
+   * Queues a write of a page, to the page number in its header.
+   *
+   * @return  Future that is ready when the write has completed, and holds its
+   *          exception if it failed.
+   */
+  std::future<void> write(File* file, const Page* page);
+
+  /**
+   * Hands all queued requests over to be performed.
+   */
+  void submit();
+
+  /**
+   * Submits the queued requests and waits until every request has completed.
+   */
+  void drain();
+
+  /**
+   * Returns the usage statistics.
+   */
+  IoStats stats();
+
+ private:
+  struct Request;
+
+  /**
+   * Largest number of requests in flight.
+   */
+  const std::uint32_t depth_;
+
+  /**
+   * Descriptor of the io_uring instance, or -1 when worker threads are used.
+   */
+  int ring_fd_;
+
+  /**
+   * Mapped submission and completion rings, the submission queue entries, and
+   * their sizes.
+   */
+  void* sq_ring_;
+  void* cq_ring_;
+  void* sqes_;
+  std::size_t sq_ring_size_;
+  std::size_t cq_ring_size_;
+  std::size_t sqes_size_;
+
+  /**
+   * Pointers into the mapped rings.
+   */
+  std::uint32_t* sq_tail_;
+  std::uint32_t* sq_mask_;
+  std::uint32_t* sq_array_;
+  std::uint32_t* cq_head_;
+  std::uint32_t* cq_tail_;
+  std::uint32_t* cq_mask_;
+  void* cqes_;
+
+  /**
+   * Guards everything below.
+   */
+  std::mutex mutex_;
+
+  /**
+   * Signalled when a request completes or is queued for the workers.
+   */
+  std::condition_variable changed_;
+
+  /**
+   * Requests queued and not yet submitted.
+   */
+  std::vector<Request*> queued_;
+
+  /**
+   * Requests submitted to the workers and not yet picked up by one.
+   */
+  std::deque<Request*> ready_;
+
+  /**
+   * Number of requests queued or in flight.
+   */
+  std::uint32_t outstanding_;
+
+  /**
+   * Set when the engine is shutting down.
+   */
+  bool stopping_;
+
+  /**
+   * Usage statistics.
+   */
+  IoStats stats_;
+
+  /**
+   * Thread reaping io_uring completions, or the worker threads.
+   */
+  std::vector<std::thread> threads_;
+
+  /**
+   * Sets up an io_uring instance; returns false if the kernel has none.
+   */
+  bool setupRing();
+
+  /**
+   * Queues a request, waiting while depth_ requests are outstanding.
+   */
+  void enqueue(Request* request);
+
+  /**
+   * Hands the queued requests to io_uring or the workers.  Called with
+   * mutex_ held.
+   */
+  void submitLocked();
+
+  /**
+   * Body of the io_uring completion thread.
+   */
+  void reap();
+
+  /**
+   * Body of a worker thread.
+   */
+  void work();
+
+  /**
+   * Checks the outcome of a request, runs its callback and frees it.
+   *
+   * @param request   Completed request.
+   * @param result    Bytes transferred, or a negative errno.
+   */
+  void complete(Request* request, const long result);
+};
+
+}
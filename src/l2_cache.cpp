@@ -0,0 +1,95 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "l2_cache.h"
+
+#include <cstdio>
+
+#include "exceptions/file_io_exception.h"
+
+namespace badgerdb {
+
+L2Cache::L2Cache(const std::string& path, const std::uint32_t num_slots)
+    : path_(path),
+      stream_(path, std::fstream::in | std::fstream::out |
+                    std::fstream::binary | std::fstream::trunc),
+      hand_(0) {
+  if (!stream_ || num_slots == 0) {
+    throw FileIOException(path);
+  }
+  owners_.assign(num_slots, index_.end());
+}
+
+L2Cache::~L2Cache() {
+  stream_.close();
+  std::remove(path_.c_str());
+}
+
+void L2Cache::insert(const File* file, const PageId page_no,
+                     const Page& page) {
+  const Key key(file->filename(), page_no);
+  const std::uint64_t version = file->pageVersion(page_no);
+
+  SlotMap::iterator pos = index_.find(key);
+  if (pos != index_.end() && pos->second.version == version) {
+    return;
+  }
+  if (pos == index_.end()) {
+    // Take the next slot in FIFO order, pushing out whoever is in it.
+    const std::uint32_t number = hand_;
+    hand_ = (hand_ + 1) % owners_.size();
+    if (owners_[number] != index_.end()) {
+      index_.erase(owners_[number]);
+    }
+    Slot slot = {number, 0};
+    pos = index_.insert(SlotMap::value_type(key, slot)).first;
+    owners_[number] = pos;
+  }
+
+  stream_.seekp(slotPosition(pos->second.number), std::ios::beg);
+  stream_.write(reinterpret_cast<const char*>(&page.header_),
+                sizeof(page.header_));
+  stream_.write(page.data_, Page::DATA_SIZE);
+  stream_.flush();
+  pos->second.version = version;
+  stats_.writes++;
+}
+
+bool L2Cache::fetch(const File* file, const PageId page_no, Page& page) {
+  stats_.lookups++;
+  SlotMap::iterator pos = index_.find(Key(file->filename(), page_no));
+  if (pos == index_.end()) {
+    return false;
+  }
+  if (pos->second.version != file->pageVersion(page_no)) {
+    // Rewritten or deleted in the primary file since we copied it.
+    stats_.stale++;
+    owners_[pos->second.number] = index_.end();
+    index_.erase(pos);
+    return false;
+  }
+
+  stream_.seekg(slotPosition(pos->second.number), std::ios::beg);
+  stream_.read(reinterpret_cast<char*>(&page.header_), sizeof(page.header_));
+  stream_.read(page.data_, Page::DATA_SIZE);
+  if (!stream_) {
+    stream_.clear();
+    return false;
+  }
+  stats_.hits++;
+  return true;
+}
+
+void L2Cache::invalidate(const File* file, const PageId page_no) {
+  SlotMap::iterator pos = index_.find(Key(file->filename(), page_no));
+  if (pos != index_.end()) {
+    owners_[pos->second.number] = index_.end();
+    index_.erase(pos);
+  }
+}
+
+}
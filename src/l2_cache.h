@@ -0,0 +1,179 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "file.h"
+#include "page.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Usage statistics of an L2Cache.
+ */
+struct L2CacheStats {
+  /**
+   * Number of buffer pool misses that looked in the cache.
+   */
+  std::uint64_t lookups;
+
+  /**
+   * Number of lookups served from the cache.
+   */
+  std::uint64_t hits;
+
+  /**
+   * Number of lookups that found a copy older than the page on disk.
+   */
+  std::uint64_t stale;
+
+  /**
+   * Number of pages written into the cache file.
+   */
+  std::uint64_t writes;
+
+  /**
+   * Returns the fraction of lookups served from the cache.
+   */
+  double hitRate() const {
+    return lookups == 0 ? 0.0 : static_cast<double>(hits) / lookups;
+  }
+
+  /**
+   * Clear all values.
+   */
+  void clear() {
+    lookups = hits = stale = writes = 0;
+  }
+
+  L2CacheStats() {
+    clear();
+  }
+};
+
+/**
+ * @brief Victim cache of evicted pages kept in a fixed-size local file.
+ *
+ * Meant for a fast local disk in front of database files on slow storage.
+ * The cache file holds a fixed number of page-sized slots, reused in FIFO
+ * order, and the page index lives in memory.  Each cached page remembers the
+ * File::pageVersion() it was copied at; a lookup only hits if the page has not
+ * been written or deleted in the primary file since, so File::writePage() and
+ * File::deletePage() invalidate cached copies without notifying the cache.
+ *
+ * The cache file is created (or truncated) on construction and removed on
+ * destruction; its contents do not survive a restart.
+ *
+ * @warning This class is not threadsafe.
+ */
+class L2Cache {
+ public:
+  /**
+   * Creates the cache file.
+   *
+   * @param path        Path of the cache file.
+   * @param num_slots   Number of pages the cache file holds.
+   */
+  L2Cache(const std::string& path, const std::uint32_t num_slots);
+
+  /**
+   * Closes and removes the cache file.
+   */
+  ~L2Cache();
+
+  /**
+   * Copies a page into the cache.  The page must match what is on disk in
+   * its file.  Does nothing if the same version is already cached.
+   *
+   * @param file      File the page belongs to.
+   * @param page_no   Page number in the file.
+   * @param page      Contents of the page.
+   */
+  void insert(const File* file, const PageId page_no, const Page& page);
+
+  /**
+   * Looks a page up and, if a current copy is cached, reads it.
+   *
+   * @param file      File the page belongs to.
+   * @param page_no   Page number in the file.
+   * @param page      Page to read into.
+   * @return  True if a current copy was found.
+   */
+  bool fetch(const File* file, const PageId page_no, Page& page);
+
+  /**
+   * Drops a page from the cache if present.
+   *
+   * @param file      File the page belongs to.
+   * @param page_no   Page number in the file.
+   */
+  void invalidate(const File* file, const PageId page_no);
+
+  /**
+   * Returns the cache usage statistics.
+   */
+  L2CacheStats& stats() { return stats_; }
+
+ private:
+  typedef std::pair<std::string, PageId> Key;
+
+  /**
+   * Where a cached page lives and which version of it is there.
+   */
+  struct Slot {
+    std::uint32_t number;
+    std::uint64_t version;
+  };
+
+  typedef std::map<Key, Slot> SlotMap;
+
+  /**
+   * Returns the position of a slot in the cache file.
+   */
+  static std::streampos slotPosition(const std::uint32_t slot) {
+    return static_cast<std::streamoff>(slot) * Page::SIZE;
+  }
+
+  /**
+   * Path of the cache file.
+   */
+  std::string path_;
+
+  /**
+   * Stream for the cache file.
+   */
+  std::fstream stream_;
+
+  /**
+   * Index from (file name, page) to cached slot.
+   */
+  SlotMap index_;
+
+  /**
+   * For each slot, the index entry occupying it, or index_.end() if free.
+   */
+  std::vector<SlotMap::iterator> owners_;
+
+  /**
+   * Next slot to reuse.
+   */
+  std::uint32_t hand_;
+
+  /**
+   * Usage statistics.
+   */
+  L2CacheStats stats_;
+};
+
+}
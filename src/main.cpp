@@ -1,17 +1,36 @@
 #include <iostream>
 #include <stdlib.h>
 //#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstring>
+#include <fstream>
+#include <iterator>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include "page.h"
 #include "buffer.h"
+#include "shared_buffer.h"
+#include "buf_pools.h"
+#include "concurrent_page_table.h"
+#include "io_engine.h"
 #include "file_iterator.h"
 #include "page_iterator.h"
+#include "exceptions/file_mode_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/invalid_page_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
 #include "exceptions/buffer_exceeded_exception.h"
+#include "exceptions/pool_exists_exception.h"
+#include "exceptions/pool_not_found_exception.h"
+#include "exceptions/hash_not_found_exception.h"
 
 #define PRINT_ERROR(str) \
 { \
@@ -37,10 +56,82 @@ void test4();
 void test5();
 void test6();
 void test7();
+void test8();
+void test9();
+void test10();
+void test11();
+void test12();
+void test13();
+void test14();
+void test15();
+void test16();
+void test17();
+void test18();
+void test19();
+void test20();
+void test21();
+void test22();
+void test23();
+void test24();
+void test25();
+void test26();
+void test27();
+void test28();
+void test29();
+void test30();
 void testBufMgr();
+void benchWriteBack();
+void benchScan();
+void benchStartup();
+void benchPrefetch();
+void benchSweep();
+void benchPageTable();
+void benchAlloc();
+void benchPlacement();
 
-int main() 
+int main(int argc, char* argv[])
 {
+	if (argc > 1 && std::strcmp(argv[1], "--bench-writeback") == 0)
+	{
+		benchWriteBack();
+		return 0;
+	}
+	if (argc > 1 && std::strcmp(argv[1], "--bench-scan") == 0)
+	{
+		benchScan();
+		return 0;
+	}
+	if (argc > 1 && std::strcmp(argv[1], "--bench-startup") == 0)
+	{
+		benchStartup();
+		return 0;
+	}
+	if (argc > 1 && std::strcmp(argv[1], "--bench-prefetch") == 0)
+	{
+		benchPrefetch();
+		return 0;
+	}
+	if (argc > 1 && std::strcmp(argv[1], "--bench-sweep") == 0)
+	{
+		benchSweep();
+		return 0;
+	}
+	if (argc > 1 && std::strcmp(argv[1], "--bench-page-table") == 0)
+	{
+		benchPageTable();
+		return 0;
+	}
+	if (argc > 1 && std::strcmp(argv[1], "--bench-alloc") == 0)
+	{
+		benchAlloc();
+		return 0;
+	}
+	if (argc > 1 && std::strcmp(argv[1], "--bench-placement") == 0)
+	{
+		benchPlacement();
+		return 0;
+	}
+
 	//Following code shows how to you File and Page classes
 
   const std::string& filename = "test.db";
@@ -76,11 +167,13 @@ int main()
          iter != new_file.end();
          ++iter) {
       // Iterate through all records on the page.
-      for (PageIterator page_iter = (*iter).begin();
-           page_iter != (*iter).end();
+      // Keep a copy of the page alive while iterating over its records.
+      Page curr_page = *iter;
+      for (PageIterator page_iter = curr_page.begin();
+           page_iter != curr_page.end();
            ++page_iter) {
         std::cout << "Found record: " << *page_iter
-            << " on page " << (*iter).page_number() << "\n";
+            << " on page " << curr_page.page_number() << "\n";
       }
     }
 
@@ -148,6 +241,29 @@ void testBufMgr()
 	test5();
 	test6();
 	test7();
+	test8();
+	test9();
+	test10();
+	test11();
+	test12();
+	test13();
+	test14();
+	test15();
+	test16();
+	test17();
+	test18();
+	test19();
+	test20();
+	test21();
+	test22();
+	test23();
+	test24();
+	test25();
+	test26();
+	test27();
+	test28();
+	test29();
+	test30();
 
 	//Close files before deleting them
 	file1.~File();
@@ -327,7 +443,2213 @@ void test7(){
 		bufMgr->readPage(file1ptr,i,page);
 	}
 	bufMgr->disposePage(file1ptr, 1);
-	bufMgr->readPage(file1ptr, 1, page);
+	try
+	{
+		bufMgr->readPage(file1ptr, 1, page);
+		PRINT_ERROR("ERROR :: Page was disposed. Exception should have been thrown before execution reaches this point.");
+	}
+	catch(InvalidPageException e)
+	{
+	}
+
+	std::cout << "Test 7 passed" << "\n";
+
+	for (i = 2; i <= num; i++)
+		bufMgr->unPinPage(file1ptr, i, false);
+}
+
+void test8()
+{
+	//Resident pages must survive a scan larger than the buffer pool
+	for (i = 1; i <= 5; i++) {
+		bufMgr->readPage(file2ptr, i, page, BufHint::RESIDENT);
+		bufMgr->unPinPage(file2ptr, i, false);
+	}
+	for (i = 2; i <= num; i++) {
+		bufMgr->readPage(file1ptr, i, page);
+		bufMgr->unPinPage(file1ptr, i, false);
+	}
+	for (i = 1; i <= num/3; i++) {
+		bufMgr->readPage(file3ptr, i, page);
+		bufMgr->unPinPage(file3ptr, i, false);
+	}
+	bufMgr->clearBufStats();
+	for (i = 1; i <= 5; i++) {
+		bufMgr->readPage(file2ptr, i, page);
+		bufMgr->unPinPage(file2ptr, i, false);
+	}
+	if (bufMgr->getBufStats().diskreads != 0)
+	{
+		PRINT_ERROR("ERROR :: Resident pages were evicted.");
+	}
+
+	//A released use-once page is the first victim
+	bufMgr->readPage(file5ptr, 1, page, BufHint::USE_ONCE);
+	bufMgr->unPinPage(file5ptr, 1, false);
+	bufMgr->readPage(file5ptr, 2, page);
+	bufMgr->unPinPage(file5ptr, 2, false);
+	bufMgr->clearBufStats();
+	bufMgr->readPage(file5ptr, 1, page);
+	bufMgr->unPinPage(file5ptr, 1, false);
+	if (bufMgr->getBufStats().diskreads != 1)
+	{
+		PRINT_ERROR("ERROR :: Use-once page should have been evicted first.");
+	}
+
+	//Resident holds are capped by the configured share of the pool
+	bufMgr->setResidentShare(0.1);
+	for (i = 6; i <= 15; i++) {
+		bufMgr->readPage(file2ptr, i, page, BufHint::RESIDENT);
+		bufMgr->unPinPage(file2ptr, i, false);
+	}
+	if (bufMgr->getBufStats().residentDenied != 5)
+	{
+		PRINT_ERROR("ERROR :: Resident share was not enforced.");
+	}
+
+	for (i = 1; i <= 15; i++)
+		bufMgr->releaseResident(file2ptr, i);
+	bufMgr->setResidentShare(0.25);
+
+	//An unpinned KEEP_HOT page is evicted once its sweeps run out, even with every other frame pinned
+	{
+		BufMgr* small = new BufMgr(4);
+		Page* pinned[3];
+		small->readPage(file5ptr, 1, page, BufHint::KEEP_HOT);
+		small->unPinPage(file5ptr, 1, false);
+		for (i = 0; i < 3; i++)
+			small->readPage(file5ptr, i + 2, pinned[i]);
+		try
+		{
+			small->readPage(file5ptr, 5, page);
+			small->unPinPage(file5ptr, 5, false);
+		}
+		catch (BufferExceededException& e)
+		{
+			PRINT_ERROR("ERROR :: KEEP_HOT page should have been evicted when no other frame was free.");
+		}
+		for (i = 0; i < 3; i++)
+			small->unPinPage(file5ptr, i + 2, false);
+		delete small;
+	}
+
+	std::cout << "Test 8 passed" << "\n";
+}
+
+void test9()
+{
+	//With the compressed tier, pages evicted by a scan larger than the pool come back without disk reads
+	bufMgr->enableCompressedTier(1 << 20);
+	for (int pass = 0; pass < 2; pass++) {
+		if (pass == 1)
+			bufMgr->clearBufStats();
+		for (i = 2; i <= num; i++) {
+			bufMgr->readPage(file1ptr, i, page);
+			bufMgr->unPinPage(file1ptr, i, false);
+		}
+		for (i = 1; i <= num/3; i++) {
+			bufMgr->readPage(file3ptr, i, page);
+			sprintf((char*)&tmpbuf, "test.3 Page %d %7.1f", i, (float)i);
+			if(strncmp(page->getRecord({i, 1}).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+			}
+			bufMgr->unPinPage(file3ptr, i, false);
+		}
+	}
+
+	CompressedTierStats tierStats = bufMgr->getCompressedTierStats();
+	if (bufMgr->getBufStats().diskreads != 0 || tierStats.hits == 0)
+	{
+		PRINT_ERROR("ERROR :: Evicted pages should have been served from the compressed tier.");
+	}
+	if (tierStats.compressionRatio() < 4)
+	{
+		PRINT_ERROR("ERROR :: Mostly empty pages should compress well.");
+	}
+	bufMgr->enableCompressedTier(0);
+
+	//A page written to the file after it was compressed is not served from the tier
+	{
+		CompressedTier tier(1 << 20);
+		Page copy = file3ptr->readPage(1);
+		tier.insert(file3ptr, 1, copy);
+		tier.insert(file3ptr, 2, file3ptr->readPage(2));
+		file3ptr->writePage(copy);
+		Page fetched;
+		if (tier.fetch(file3ptr, 1, fetched) || tier.stats().stale != 1 || !tier.fetch(file3ptr, 2, fetched))
+		{
+			PRINT_ERROR("ERROR :: A rewritten page should have been found stale in the compressed tier.");
+		}
+	}
+
+	std::cout << "Test 9 passed" << "\n";
+}
+
+void test10()
+{
+	//With the L2 cache, pages evicted by a scan larger than the pool are read from the cache file
+	bufMgr->enableL2Cache("test.l2", 2 * num);
+	for (int pass = 0; pass < 2; pass++) {
+		if (pass == 1)
+			bufMgr->clearBufStats();
+		for (i = 2; i <= num; i++) {
+			bufMgr->readPage(file1ptr, i, page);
+			bufMgr->unPinPage(file1ptr, i, false);
+		}
+		for (i = 1; i <= num/3; i++) {
+			bufMgr->readPage(file3ptr, i, page);
+			bufMgr->unPinPage(file3ptr, i, false);
+		}
+	}
+	if (bufMgr->getBufStats().diskreads != 0 || bufMgr->getL2CacheStats().hits == 0)
+	{
+		PRINT_ERROR("ERROR :: Evicted pages should have been served from the L2 cache.");
+	}
+
+	//Pages rewritten behind the buffer manager's back must not be served stale from the L2 cache
+	bufMgr->flushFile(file3ptr);
+	for (i = 1; i <= num/3; i++) {
+		Page rewritten = file3ptr->readPage(i);
+		rewritten.insertRecord("rewritten");
+		file3ptr->writePage(rewritten);
+	}
+	for (i = 1; i <= num/3; i++) {
+		bufMgr->readPage(file3ptr, i, page);
+		if (page->getRecord({i, 2}) != "rewritten")
+		{
+			PRINT_ERROR("ERROR :: Stale page served from the L2 cache.");
+		}
+		bufMgr->unPinPage(file3ptr, i, false);
+	}
+	if (bufMgr->getL2CacheStats().stale == 0)
+	{
+		PRINT_ERROR("ERROR :: Rewritten pages should have been found stale in the L2 cache.");
+	}
+	bufMgr->enableL2Cache("", 0);
+
+	std::cout << "Test 10 passed" << "\n";
+}
+
+void test11()
+{
+	//With an allocation timeout, a request that finds every frame pinned waits for an unpin
+	bufMgr->setAllocTimeout(std::chrono::milliseconds(5000));
+	bufMgr->clearBufStats();
+	for (i = 1; i <= num; i++) {
+		bufMgr->readPage(file5ptr, i, page);
+	}
+
+	Page *waitedPage = NULL;
+	std::thread waiter([&waitedPage]() {
+		bufMgr->readPage(file1ptr, 2, waitedPage);
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	bufMgr->unPinPage(file5ptr, 1, false);
+	waiter.join();
+
+	sprintf((char*)tmpbuf, "test.1 Page %d %7.1f", 2, (float)2);
+	if (waitedPage == NULL || strncmp(waitedPage->getRecord({2, 1}).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+	{
+		PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+	}
+	if (bufMgr->getBufStats().waits != 1 || bufMgr->getBufStats().waitMicros == 0)
+	{
+		PRINT_ERROR("ERROR :: Waiting for a frame should show up in the stats.");
+	}
+
+	//If no frame frees up before the timeout, the request fails
+	bufMgr->setAllocTimeout(std::chrono::milliseconds(20));
+	try
+	{
+		bufMgr->readPage(file1ptr, 3, page);
+		PRINT_ERROR("ERROR :: No more frames left for allocation. Exception should have been thrown before execution reaches this point.");
+	}
+	catch(BufferExceededException e)
+	{
+	}
+	if (bufMgr->getBufStats().waitTimeouts != 1)
+	{
+		PRINT_ERROR("ERROR :: Timed out wait should show up in the stats.");
+	}
+	bufMgr->setAllocTimeout(std::chrono::milliseconds(0));
+
+	bufMgr->unPinPage(file1ptr, 2, false);
+	for (i = 2; i <= num; i++)
+		bufMgr->unPinPage(file5ptr, i, false);
+
+	//A request that waited for a frame does not install the copy it read before waiting, which
+	//may have been changed and written back in the meantime
+	{
+		BufMgr* small = new BufMgr(2);
+		small->setAllocTimeout(std::chrono::milliseconds(5000));
+		Page* held[2];
+		small->readPage(file5ptr, 1, held[0]);
+		small->readPage(file5ptr, 2, held[1]);
+		Page* second = NULL;
+		std::thread first([small]() {
+			Page* changed;
+			small->readPage(file5ptr, 3, changed);
+			changed->insertRecord("changed while others waited");
+			small->unPinPage(file5ptr, 3, true);
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		std::thread queued([small, &second]() {
+			small->readPage(file5ptr, 3, second);
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		small->unPinPage(file5ptr, 1, false);
+		first.join();
+		queued.join();
+		bool found = false;
+		for (PageIterator record = second->begin(); record != second->end(); ++record)
+			found = found || *record == "changed while others waited";
+		if (!found)
+		{
+			PRINT_ERROR("ERROR :: A stale copy read before waiting for a frame was installed.");
+		}
+		small->unPinPage(file5ptr, 3, false);
+		small->unPinPage(file5ptr, 2, false);
+		delete small;
+	}
+
+	//A page is not allocated in the file when no frame can be found for it
+	{
+		BufMgr* small = new BufMgr(1);
+		small->readPage(file5ptr, 1, page);
+		int pagesBefore = 0;
+		for (FileIterator iter = file5ptr->begin(); iter != file5ptr->end(); ++iter)
+			pagesBefore++;
+		PageId allocated;
+		try
+		{
+			small->allocPage(file5ptr, allocated, page);
+			PRINT_ERROR("ERROR :: No more frames left for allocation. Exception should have been thrown before execution reaches this point.");
+		}
+		catch(BufferExceededException e)
+		{
+		}
+		int pagesAfter = 0;
+		for (FileIterator iter = file5ptr->begin(); iter != file5ptr->end(); ++iter)
+			pagesAfter++;
+		if (pagesAfter != pagesBefore)
+		{
+			PRINT_ERROR("ERROR :: A page was allocated that the buffer pool could not hold.");
+		}
+		small->unPinPage(file5ptr, 1, false);
+		delete small;
+	}
+
+	std::cout << "Test 11 passed" << "\n";
+}
+
+void test12()
+{
+	//A repeating access pattern across two files is learned and prefetched, in the background; waiting after
+	//each page stands in for the work done with it
+	bufMgr->enablePrefetcher(1024);
+	for (int round = 0; round < 6; round++) {
+		//The last rounds read ahead through the asynchronous I/O engine
+		if (round == 4)
+			bufMgr->enableAsyncIo(8);
+		for (i = 1; i <= num/3; i++) {
+			bufMgr->readPage(file1ptr, i + 1, page);
+			bufMgr->unPinPage(file1ptr, i + 1, false);
+			bufMgr->waitPrefetch();
+			bufMgr->readPage(file3ptr, i, page);
+			bufMgr->unPinPage(file3ptr, i, false);
+			bufMgr->waitPrefetch();
+		}
+		//Push everything out of the pool before the next round
+		for (i = 1; i <= num; i++) {
+			bufMgr->readPage(file5ptr, i, page);
+			bufMgr->unPinPage(file5ptr, i, false);
+			bufMgr->waitPrefetch();
+		}
+	}
+	if (bufMgr->getIoStats().reads == 0)
+	{
+		PRINT_ERROR("ERROR :: Pages should have been read ahead through the asynchronous I/O engine.");
+	}
+	bufMgr->enableAsyncIo(0);
+	PrefetchStats prefetchStats = bufMgr->getPrefetchStats();
+	if (prefetchStats.useful == 0 || prefetchStats.precision() < 0.5 || prefetchStats.recall() < 0.5)
+	{
+		PRINT_ERROR("ERROR :: Repeating pattern should have been prefetched.");
+	}
+
+	//Nothing is prefetched for files it is turned off for
+	bufMgr->setPrefetch(file1ptr, false);
+	bufMgr->setPrefetch(file3ptr, false);
+	bufMgr->setPrefetch(file5ptr, false);
+	for (i = 1; i <= num/3; i++) {
+		bufMgr->readPage(file1ptr, i + 1, page);
+		bufMgr->unPinPage(file1ptr, i + 1, false);
+		bufMgr->readPage(file3ptr, i, page);
+		bufMgr->unPinPage(file3ptr, i, false);
+	}
+	if (bufMgr->getPrefetchStats().issued != prefetchStats.issued)
+	{
+		PRINT_ERROR("ERROR :: Pages were prefetched for disabled files.");
+	}
+	bufMgr->enablePrefetcher(0);
+
+	std::cout << "Test 12 passed" << "\n";
+}
+
+
+void test13()
+{
+	//A page cached by one process is served to another from shared memory
+	const std::string segment = "/badgerdb_test13";
+	SharedBufMgr::remove(segment);
+	SharedBufMgr* shared = new SharedBufMgr(segment, 10);
+	PageId sharedPageNo;
+	shared->allocPage(file4ptr, sharedPageNo, page);
+	rid2 = page->insertRecord("shared page");
+	shared->unPinPage(file4ptr, sharedPageNo, true);
+
+	pid_t child = fork();
+	if (child == 0) {
+		//The child pins every frame and dies without unpinning
+		SharedBufMgr attached(segment, 0);
+		Page* childPage;
+		attached.readPage(file4ptr, sharedPageNo, childPage);
+		if (childPage->getRecord(rid2) != "shared page" || attached.getBufStats().diskreads != 0)
+		{
+			_exit(1);
+		}
+		for (PageId j = 1; j <= 9; j++) {
+			attached.readPage(file5ptr, j, childPage);
+		}
+		_exit(0);
+	}
+	int status;
+	waitpid(child, &status, 0);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	{
+		PRINT_ERROR("ERROR :: Page should have been shared with the child process.");
+	}
+
+	//The dead child's pins are released when a frame is needed
+	shared->readPage(file5ptr, 10, page);
+	shared->unPinPage(file5ptr, 10, false);
+	shared->readPage(file4ptr, sharedPageNo, page);
+	if (page->getRecord(rid2) != "shared page")
+	{
+		PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+	}
+	shared->unPinPage(file4ptr, sharedPageNo, false);
+
+	//Children killed by a timer, most likely while holding the mutex, must not leave the page table broken
+	for (int round = 1; round <= 5; round++) {
+		child = fork();
+		if (child == 0) {
+			SharedBufMgr attached(segment, 0);
+			Page* childPage;
+			struct itimerval timer = {{0, 0}, {0, round * 1000}};
+			setitimer(ITIMER_REAL, &timer, NULL);
+			for (;;) {
+				for (PageId j = 11; j <= 40; j++) {
+					attached.readPage(file5ptr, j, childPage);
+					attached.unPinPage(file5ptr, j, false);
+				}
+			}
+		}
+		waitpid(child, &status, 0);
+		for (int pass = 0; pass < 2; pass++) {
+			shared->clearBufStats();
+			for (PageId j = 11; j <= 15; j++) {
+				shared->readPage(file5ptr, j, page);
+				if (page->page_number() != j)
+				{
+					PRINT_ERROR("ERROR :: Page table maps a page to the wrong frame after a process died.");
+				}
+				shared->unPinPage(file5ptr, j, false);
+			}
+		}
+		if (shared->getBufStats().diskreads != 0)
+		{
+			PRINT_ERROR("ERROR :: Cached pages were not found after a process died.");
+		}
+	}
+
+	shared->flushFile(file4ptr);
+	shared->flushFile(file5ptr);
+	delete shared;
+	SharedBufMgr::remove(segment);
+
+	std::cout << "Test 13 passed" << "\n";
+}
+
+void test14()
+{
+	//The resident set is saved hottest first when a buffer manager goes away
+	const std::string warmFile = "test.warm";
+	BufMgr* before = new BufMgr(10);
+	before->enableWarmRestart(warmFile);
+	for (i = 1; i <= 5; i++) {
+		before->readPage(file5ptr, i, page, i == 3 ? BufHint::KEEP_HOT : BufHint::NORMAL);
+		before->unPinPage(file5ptr, i, false);
+	}
+	before->readPage(file5ptr, 6, page, BufHint::USE_ONCE);
+	before->unPinPage(file5ptr, 6, false);
+	delete before;
+
+	std::ifstream saved(warmFile.c_str());
+	std::string header;
+	PageId hottest;
+	std::getline(saved, header);
+	if (!(saved >> hottest) || hottest != 3)
+	{
+		PRINT_ERROR("ERROR :: KEEP_HOT page should have been saved first.");
+	}
+	saved.close();
+
+	//A new buffer manager preloads it, without the USE_ONCE page and without files it was not given
+	BufMgr* after = new BufMgr(10);
+	if (after->warmStart(warmFile, std::vector<File*>()) != 0)
+	{
+		PRINT_ERROR("ERROR :: Pages of unknown files should have been skipped.");
+	}
+	after->waitWarmStart();
+	if (after->warmStart(warmFile, std::vector<File*>(1, file5ptr)) != 5)
+	{
+		PRINT_ERROR("ERROR :: Wrong number of pages queued for warm start.");
+	}
+	after->waitWarmStart();
+	if (after->getBufStats().warmLoaded != 5)
+	{
+		PRINT_ERROR("ERROR :: Saved pages should have been preloaded.");
+	}
+	after->clearBufStats();
+	for (i = 1; i <= 5; i++) {
+		after->readPage(file5ptr, i, page);
+		after->unPinPage(file5ptr, i, false);
+	}
+	if (after->getBufStats().diskreads != 0)
+	{
+		PRINT_ERROR("ERROR :: Preloaded pages should not be read again.");
+	}
+	delete after;
+	std::remove(warmFile.c_str());
+
+	std::cout << "Test 14 passed" << "\n";
+}
+
+void test15()
+{
+	//flushAll writes back the dirty pages of every file and keeps them cached
+	BufMgr* flushing = new BufMgr(20);
+	for (i = 1; i <= 6; i++) {
+		flushing->readPage(file5ptr, i, page);
+		flushing->unPinPage(file5ptr, i, true);
+		flushing->readPage(file3ptr, i, page);
+		flushing->unPinPage(file3ptr, i, true);
+	}
+	//A pinned page is left alone
+	flushing->readPage(file5ptr, 7, page);
+	flushing->unPinPage(file5ptr, 7, true);
+	flushing->readPage(file5ptr, 7, page);
+
+	std::uint32_t lastWritten = 0, lastTotal = 0;
+	bool ordered = true;
+	flushing->clearBufStats();
+	FlushStats flushed = flushing->flushAll([&](std::uint32_t written, std::uint32_t total) {
+		ordered = ordered && written == lastWritten + 1;
+		lastWritten = written;
+		lastTotal = total;
+	});
+	if (flushed.pages != 12 || flushed.files != 2 || !ordered || lastWritten != 12 || lastTotal != 12 ||
+			flushing->getBufStats().diskwrites != 12)
+	{
+		PRINT_ERROR("ERROR :: flushAll should have written the 12 unpinned dirty pages of both files.");
+	}
+	if (flushing->flushAll().pages != 0)
+	{
+		PRINT_ERROR("ERROR :: Flushed pages should be clean.");
+	}
+	flushing->clearBufStats();
+	for (i = 1; i <= 6; i++) {
+		flushing->readPage(file5ptr, i, page);
+		flushing->unPinPage(file5ptr, i, false);
+	}
+	if (flushing->getBufStats().diskreads != 0)
+	{
+		PRINT_ERROR("ERROR :: Flushed pages should have stayed in the buffer pool.");
+	}
+
+	//The pinned page is written on destruction
+	delete flushing;
+
+	std::cout << "Test 15 passed" << "\n";
+}
+
+void test16()
+{
+	//Files assigned to different pools do not compete for frames
+	BufPools pools(5);
+	pools.addPool("keep", 3, BufHint::KEEP_HOT);
+	pools.addPool("recycle", 4, BufHint::USE_ONCE);
+	pools.assignFile(file5ptr, "keep");
+	pools.assignFile(file3ptr, "recycle");
+	for (i = 1; i <= 3; i++) {
+		pools.readPage(file5ptr, i, page);
+		pools.unPinPage(file5ptr, i, false);
+	}
+	for (i = 1; i <= num/3; i++) {
+		pools.readPage(file3ptr, i, page);
+		pools.unPinPage(file3ptr, i, false);
+	}
+	for (i = 1; i <= 3; i++) {
+		pools.readPage(file5ptr, i, page);
+		pools.unPinPage(file5ptr, i, false);
+	}
+	if (pools.getBufStats("keep").diskreads != 3 || pools.getBufStats("recycle").diskreads != (int)(num/3) ||
+			pools.getBufStats(BufPools::DEFAULT_POOL).accesses != 0)
+	{
+		PRINT_ERROR("ERROR :: Scan in the recycle pool should not have evicted pages of the keep pool.");
+	}
+
+	try
+	{
+		pools.addPool("keep", 10);
+		PRINT_ERROR("ERROR :: Pool should not have been added twice.");
+	}
+	catch(PoolExistsException &e)
+	{
+	}
+	try
+	{
+		pools.assignFile(file1ptr, "missing");
+		PRINT_ERROR("ERROR :: File should not have been assigned to a missing pool.");
+	}
+	catch(PoolNotFoundException &e)
+	{
+	}
+
+	//Reassigning a file moves it out of its old pool
+	pools.assignFile(file5ptr, BufPools::DEFAULT_POOL);
+	pools.readPage(file5ptr, 1, page);
+	pools.unPinPage(file5ptr, 1, false);
+	if (pools.getBufStats(BufPools::DEFAULT_POOL).diskreads != 1 || &pools.poolOf(file5ptr) != &pools.pool(BufPools::DEFAULT_POOL))
+	{
+		PRINT_ERROR("ERROR :: File should have been served by the default pool.");
+	}
+
+	std::cout << "Test 16 passed" << "\n";
+}
+
+void test17()
+{
+	//A tenant at its maximum replaces its own pages
+	BufMgr* shared = new BufMgr(10);
+	shared->setTenant(file3ptr, 1);
+	shared->setTenant(file5ptr, 2);
+	shared->setTenantQuota(1, 0, 4);
+	shared->setTenantQuota(2, 3, 10);
+	for (i = 1; i <= 3; i++) {
+		shared->readPage(file5ptr, i, page);
+		shared->unPinPage(file5ptr, i, false);
+	}
+	for (i = 1; i <= 20; i++) {
+		shared->readPage(file3ptr, i, page);
+		shared->unPinPage(file3ptr, i, false);
+	}
+	if (shared->getTenantStats(1).frames != 4 || shared->getTenantStats(2).frames != 3)
+	{
+		PRINT_ERROR("ERROR :: Tenant 1 should have stayed within its maximum.");
+	}
+
+	//Other tenants cannot take a tenant below its minimum
+	shared->setTenantQuota(1, 0, 10);
+	for (i = 1; i <= num/3; i++) {
+		shared->readPage(file3ptr, i, page);
+		shared->unPinPage(file3ptr, i, false);
+	}
+	if (shared->getTenantStats(1).frames != 7 || shared->getTenantStats(2).frames != 3)
+	{
+		PRINT_ERROR("ERROR :: Tenant 2 should have kept its minimum.");
+	}
+	for (i = 1; i <= 3; i++) {
+		shared->readPage(file5ptr, i, page);
+		shared->unPinPage(file5ptr, i, false);
+	}
+	if (shared->getTenantStats(2).accesses != 6 || shared->getTenantStats(2).hitRate() != 0.5)
+	{
+		PRINT_ERROR("ERROR :: Tenant 2 should have hit on its second pass.");
+	}
+	delete shared;
+
+	std::cout << "Test 17 passed" << "\n";
+}
+
+void test18()
+{
+	//Repeated reads by a thread are answered by its frame hints
+	BufMgr* hinted = new BufMgr(10);
+	for (int round = 0; round < 5; round++) {
+		for (i = 1; i <= 3; i++) {
+			hinted->readPage(file5ptr, i, page);
+			hinted->unPinPage(file5ptr, i, false);
+		}
+	}
+	if (hinted->getBufStats().hintMisses != 3 || hinted->getBufStats().hintHits != 27)
+	{
+		PRINT_ERROR("ERROR :: Repeated reads should have skipped the hash table.");
+	}
+
+	//A hint goes stale once its frame is given another page
+	hinted->flushFile(file5ptr);
+	for (i = 1; i <= 10; i++) {
+		hinted->readPage(file3ptr, i, page);
+		hinted->unPinPage(file3ptr, i, false);
+	}
+	hinted->clearBufStats();
+	hinted->readPage(file5ptr, 1, page);
+	if (hinted->getBufStats().hintHits != 0 || page->page_number() != 1)
+	{
+		PRINT_ERROR("ERROR :: A stale frame hint was used.");
+	}
+	hinted->unPinPage(file5ptr, 1, false);
+
+	//Hints of one buffer manager are not taken by another
+	BufMgr* other = new BufMgr(10);
+	other->readPage(file5ptr, 1, page);
+	if (other->getBufStats().hintHits != 0)
+	{
+		PRINT_ERROR("ERROR :: A frame hint of another buffer manager was used.");
+	}
+	other->unPinPage(file5ptr, 1, false);
+	delete other;
+	delete hinted;
+
+	std::cout << "Test 18 passed" << "\n";
+}
+
+void test19()
+{
+	//Threads insert, look up and remove pages in one lock-free page table while
+	//others look up pages that stay in it the whole time
+	ConcurrentPageTable table(64);
+	const PageId stable = 16;
+	for (PageId p = 1; p <= stable; p++) {
+		table.insert(file1ptr, p, p * 7);
+	}
+	bool failed[6] = {false, false, false, false, false, false};
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++) {
+		threads.push_back(std::thread([&table, &failed, t]() {
+			File* file = t % 2 == 0 ? file2ptr : file3ptr;
+			for (int round = 0; round < 2000; round++) {
+				const PageId p = 1000 * (t + 1) + round % 50;
+				FrameId frame = 0;
+				table.insert(file, p, round);
+				table.lookup(file, p, frame);
+				if (frame != (FrameId) round) {
+					failed[t] = true;
+				}
+				table.remove(file, p);
+				try {
+					table.lookup(file, p, frame);
+					failed[t] = true;
+				} catch (HashNotFoundException &e) {
+				}
+			}
+		}));
+	}
+	for (int t = 4; t < 6; t++) {
+		threads.push_back(std::thread([&table, &failed, stable, t]() {
+			for (int round = 0; round < 20000; round++) {
+				const PageId p = 1 + round % stable;
+				FrameId frame = 0;
+				table.lookup(file1ptr, p, frame);
+				if (frame != p * 7) {
+					failed[t] = true;
+				}
+			}
+		}));
+	}
+	for (std::size_t t = 0; t < threads.size(); t++) {
+		threads[t].join();
+	}
+	for (int t = 0; t < 6; t++) {
+		if (failed[t])
+		{
+			PRINT_ERROR("ERROR :: The page table returned a wrong frame under concurrent use.");
+		}
+	}
+	for (PageId p = 1; p <= stable; p++) {
+		table.remove(file1ptr, p);
+	}
 
+	std::cout << "Test 19 passed" << "\n";
 }
 
+void test20()
+{
+	//Walk the chain of used pages of a file through the buffer pool, three times
+	BufMgr* chained = new BufMgr(1000);
+	PageId walked[3] = {0, 0, 0};
+	for (int pass = 0; pass < 3; pass++) {
+		if (pass == 2) {
+			//Evicting the pages unswizzles the links to them
+			chained->flushFile(file5ptr);
+		}
+		chained->clearBufStats();
+		PageId pageNo = (*file5ptr->begin()).page_number();
+		chained->readPage(file5ptr, pageNo, page);
+		for (;;) {
+			walked[pass]++;
+			if (!chained->readNextPage(file5ptr, page, page2)) {
+				break;
+			}
+			if (page2->page_number() <= pageNo)
+			{
+				PRINT_ERROR("ERROR :: readNextPage returned a page out of chain order.");
+			}
+			chained->unPinPage(file5ptr, pageNo, false);
+			pageNo = page2->page_number();
+			page = page2;
+		}
+		chained->unPinPage(file5ptr, pageNo, false);
+		const int expected = pass == 1 ? walked[pass] - 1 : 0;
+		if (walked[pass] < 2 || walked[pass] != walked[0] || chained->getBufStats().swizzleHits != expected)
+		{
+			PRINT_ERROR("ERROR :: Only the walk over cached pages should have followed swizzled links.");
+		}
+	}
+	delete chained;
+
+	std::cout << "Test 20 passed" << "\n";
+}
+
+void test21()
+{
+	//Threads read pages of one file at once, while another rewrites a page of it
+	std::vector<PageId> used;
+	for (FileIterator iter = file5ptr->begin(); iter != file5ptr->end(); ++iter) {
+		used.push_back((*iter).page_number());
+	}
+	const Page rewritten = file5ptr->readPage(used[0]);
+	bool failed[5] = {false, false, false, false, false};
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++) {
+		threads.push_back(std::thread([&used, &failed, t]() {
+			for (int round = 0; round < 20; round++) {
+				for (std::size_t k = t; k < used.size(); k += 2) {
+					if (file5ptr->readPage(used[k]).page_number() != used[k]) {
+						failed[t] = true;
+					}
+				}
+			}
+		}));
+	}
+	threads.push_back(std::thread([&rewritten, &failed]() {
+		for (int round = 0; round < 200; round++) {
+			file5ptr->writePage(rewritten);
+		}
+		const Page reread = file5ptr->readPage(rewritten.page_number());
+		if (std::memcmp(&reread, &rewritten, sizeof(Page)) != 0) {
+			failed[4] = true;
+		}
+	}));
+	for (std::size_t t = 0; t < threads.size(); t++) {
+		threads[t].join();
+	}
+	for (int t = 0; t < 5; t++) {
+		if (failed[t])
+		{
+			PRINT_ERROR("ERROR :: Concurrent page reads and writes of one file interfered.");
+		}
+	}
+
+	std::cout << "Test 21 passed" << "\n";
+}
+
+void test22()
+{
+	std::vector<PageId> used;
+	for (FileIterator iter = file5ptr->begin(); iter != file5ptr->end() && used.size() < 20; ++iter) {
+		used.push_back((*iter).page_number());
+	}
+	//Once through io_uring, if the kernel has it, and once through worker threads
+	for (int uring = 1; uring >= 0; uring--) {
+		//Pages come back through callbacks and futures
+		IoEngine engine(4, uring == 1);
+		std::vector<Page> pages(used.size());
+		std::vector<std::future<void> > reads;
+		for (std::size_t k = 0; k < used.size(); k++) {
+			reads.push_back(engine.read(file5ptr, used[k], &pages[k]));
+		}
+		Page beyond;
+		bool beyondFailed = false;
+		engine.read(file5ptr, 100000, &beyond, [&beyondFailed](std::exception_ptr error) {
+			beyondFailed = error != NULL;
+		});
+		engine.submit();
+		for (std::size_t k = 0; k < used.size(); k++) {
+			reads[k].get();
+			if (pages[k].page_number() != used[k])
+			{
+				PRINT_ERROR("ERROR :: The I/O engine read the wrong page.");
+			}
+		}
+		engine.drain();
+		if (!beyondFailed || engine.stats().reads != used.size() + 1 || engine.stats().maxInFlight > 4)
+		{
+			PRINT_ERROR("ERROR :: The I/O engine did not keep to its depth or missed a failed read.");
+		}
+
+		//Misses of a batch are read asynchronously, and write-backs go through the engine
+		BufMgr* async = new BufMgr(50);
+		async->enableAsyncIo(8, uring == 1);
+		std::vector<Page*> frames;
+		async->readPages(file5ptr, used, frames);
+		for (std::size_t k = 0; k < used.size(); k++) {
+			if (frames[k]->page_number() != used[k])
+			{
+				PRINT_ERROR("ERROR :: readPages returned the wrong page.");
+			}
+			async->unPinPage(file5ptr, used[k], k % 2 == 0);
+		}
+		if (async->getIoStats().reads != used.size() || async->getBufStats().diskreads != (int) used.size())
+		{
+			PRINT_ERROR("ERROR :: readPages should have read every miss through the engine.");
+		}
+		//All or nothing when one page cannot be read
+		std::vector<PageId> withBad(used);
+		withBad.push_back(100000);
+		try
+		{
+			async->readPages(file5ptr, withBad, frames);
+			PRINT_ERROR("ERROR :: No such page in file. Exception should have been thrown before execution reaches this point.");
+		}
+		catch (InvalidPageException &e)
+		{
+		}
+		if (async->flushAll().pages != (used.size() + 1) / 2 || async->getIoStats().writes != (used.size() + 1) / 2)
+		{
+			PRINT_ERROR("ERROR :: flushAll should have written the dirty pages through the engine.");
+		}
+		async->flushFile(file5ptr);
+		delete async;
+	}
+
+	std::cout << "Test 22 passed" << "\n";
+}
+
+void test23()
+{
+	const std::string directName = "test.6";
+	const std::string legacyName = "test.7";
+	try
+	{
+		File::remove(directName);
+		File::remove(legacyName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	//A file in direct mode works through a small pool, so most pages are written back and read again
+	std::vector<RecordId> rids;
+	{
+		File direct = File::create(directName, FileMode::DIRECT);
+		if (File::open(directName).mode() != direct.mode())
+		{
+			PRINT_ERROR("ERROR :: A file opened again should keep the mode it was opened with.");
+		}
+		BufMgr* small = new BufMgr(5);
+		for (int k = 0; k < 20; k++)
+		{
+			PageId pageNo;
+			small->allocPage(&direct, pageNo, page);
+			sprintf((char*)tmpbuf, "direct.6 Page %d %7.1f", pageNo, (float)pageNo);
+			rids.push_back(page->insertRecord(tmpbuf));
+			small->unPinPage(&direct, pageNo, true);
+		}
+		for (i = 1; i <= 20; i++)
+		{
+			small->readPage(&direct, i, page);
+			sprintf((char*)tmpbuf, "direct.6 Page %d %7.1f", i, (float)i);
+			if (strncmp(page->getRecord(rids[i - 1]).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+			}
+			small->unPinPage(&direct, i, false);
+		}
+
+		//Asynchronous reads and writes of unaligned pages go through an aligned copy
+		BufMgr* async = new BufMgr(50);
+		async->enableAsyncIo(8);
+		std::vector<PageId> pageNos;
+		for (i = 1; i <= 20; i++)
+		{
+			pageNos.push_back(i);
+		}
+		std::vector<Page*> pages;
+		async->readPages(&direct, pageNos, pages);
+		for (i = 1; i <= 20; i++)
+		{
+			sprintf((char*)tmpbuf, "direct.6 Page %d %7.1f", i, (float)i);
+			if (strncmp(pages[i - 1]->getRecord(rids[i - 1]).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+			}
+			async->unPinPage(&direct, i, true);
+		}
+		delete async;
+		delete small;
+	}
+
+	//Every page starts at a multiple of the page size, after the header block
+	std::ifstream raw(directName, std::ios::binary);
+	PageHeader header;
+	raw.seekg(7 * Page::SIZE);
+	raw.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!raw || header.current_page_number != 7)
+	{
+		PRINT_ERROR("ERROR :: Pages should start at page size boundaries.");
+	}
+
+	//A file from before the header block existed: header right in front of page 1
+	raw.seekg(0);
+	std::string bytes((std::istreambuf_iterator<char>(raw)), std::istreambuf_iterator<char>());
+	raw.close();
+	{
+		std::ofstream out(legacyName, std::ios::binary);
+		out << bytes.substr(0, sizeof(FileHeader)) << bytes.substr(Page::SIZE);
+	}
+	RecordId addedRid;
+	{
+		File legacy = File::open(legacyName, FileMode::DIRECT);
+		if (legacy.mode() != FileMode::BUFFERED)
+		{
+			PRINT_ERROR("ERROR :: A file in the old format cannot use direct I/O.");
+		}
+		PageId expected = 1;
+		for (FileIterator iter = legacy.begin(); iter != legacy.end(); ++iter, ++expected)
+		{
+			Page legacyPage = *iter;
+			sprintf((char*)tmpbuf, "direct.6 Page %d %7.1f", expected, (float)expected);
+			if (legacyPage.page_number() != expected ||
+					strncmp(legacyPage.getRecord(rids[expected - 1]).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+			}
+		}
+		Page added = legacy.allocatePage();
+		addedRid = added.insertRecord("legacy");
+		legacy.writePage(added);
+	}
+	{
+		File legacy = File::open(legacyName);
+		if (addedRid.page_number != 21 || legacy.readPage(21).getRecord(addedRid) != "legacy")
+		{
+			PRINT_ERROR("ERROR :: A page added to a file in the old format was not read back.");
+		}
+
+		//Another File for it catches up from the change log, without reading the pages again
+		File other = File::open("./" + legacyName);
+		{
+			const PageHeader cleared = PageHeader();
+			std::fstream rawLegacy(legacyName, std::ios::binary | std::ios::in | std::ios::out);
+			rawLegacy.seekp(sizeof(FileHeader) + 4 * Page::SIZE);
+			rawLegacy.write(reinterpret_cast<const char*>(&cleared), sizeof(cleared));
+		}
+		legacy.deletePage(21);
+		if (other.allocatePage().page_number() != 21)
+		{
+			PRINT_ERROR("ERROR :: The deleted page should have been reused from the log.");
+		}
+	}
+	{
+		//Page 0 would lie before the start of the mapping
+		File legacy = File::open(legacyName, FileMode::MAPPED);
+		try
+		{
+			legacy.viewPage(Page::INVALID_NUMBER);
+			PRINT_ERROR("ERROR :: Page 0 holds the file header. Exception should have been thrown before execution reaches this point.");
+		}
+		catch (InvalidPageException &e)
+		{
+		}
+	}
+	std::ifstream legacyRaw(legacyName, std::ios::binary | std::ios::ate);
+	if (static_cast<std::size_t>(legacyRaw.tellg()) != sizeof(FileHeader) + 21 * Page::SIZE)
+	{
+		PRINT_ERROR("ERROR :: A file in the old format should keep its layout.");
+	}
+	legacyRaw.close();
+
+	File::remove(directName);
+	File::remove(legacyName);
+
+	std::cout << "Test 23 passed" << "\n";
+}
+
+void test24()
+{
+	const std::string mappedName = "test.6";
+	try
+	{
+		File::remove(mappedName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	//Pages written through a buffered file are read in place through a mapped one
+	std::vector<RecordId> rids;
+	{
+		File writer = File::create(mappedName);
+		for (int k = 0; k < 30; k++)
+		{
+			Page written = writer.allocatePage();
+			sprintf((char*)tmpbuf, "mapped.6 Page %d", written.page_number());
+			rids.push_back(written.insertRecord(tmpbuf));
+			writer.writePage(written);
+		}
+	}
+	{
+		File mapped = File::open(mappedName, FileMode::MAPPED);
+		if (mapped.mode() != FileMode::MAPPED)
+		{
+			PRINT_ERROR("ERROR :: The file should have been mapped.");
+		}
+		PageId expected = 1;
+		for (FileIterator iter = mapped.begin(); iter != mapped.end(); ++iter, ++expected)
+		{
+			const Page* view = iter.view();
+			const RecordView record = view->begin().view();
+			sprintf((char*)tmpbuf, "mapped.6 Page %d", expected);
+			if (view->page_number() != expected || record.length != strlen(tmpbuf) ||
+					std::memcmp(record.data, tmpbuf, record.length) != 0)
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+			}
+		}
+		if (expected != 31)
+		{
+			PRINT_ERROR("ERROR :: A scan of the mapped file missed pages.");
+		}
+
+		//Copies, and the buffer pool, work as with any other file
+		if (mapped.readPage(5).getRecord(rids[4]) != "mapped.6 Page 5")
+		{
+			PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+		}
+		BufMgr* reader = new BufMgr(10);
+		reader->readPage(&mapped, 7, page);
+		if (page->getRecord(rids[6]) != "mapped.6 Page 7")
+		{
+			PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+		}
+		reader->unPinPage(&mapped, 7, false);
+		delete reader;
+
+		//Nothing is written to a mapped file
+		try
+		{
+			mapped.allocatePage();
+			PRINT_ERROR("ERROR :: A mapped file is read-only. Exception should have been thrown before execution reaches this point.");
+		}
+		catch (FileModeException &e)
+		{
+		}
+		try
+		{
+			mapped.writePage(mapped.readPage(3));
+			PRINT_ERROR("ERROR :: A mapped file is read-only. Exception should have been thrown before execution reaches this point.");
+		}
+		catch (FileModeException &e)
+		{
+		}
+		try
+		{
+			mapped.viewPage(31);
+			PRINT_ERROR("ERROR :: No such page in file. Exception should have been thrown before execution reaches this point.");
+		}
+		catch (InvalidPageException &e)
+		{
+		}
+		try
+		{
+			mapped.viewPage(Page::INVALID_NUMBER);
+			PRINT_ERROR("ERROR :: Page 0 holds the file header. Exception should have been thrown before execution reaches this point.");
+		}
+		catch (InvalidPageException &e)
+		{
+		}
+	}
+
+	//Only mapped files have pages to view, and there is nothing to map in a new file
+	try
+	{
+		file1ptr->viewPage(1);
+		PRINT_ERROR("ERROR :: File 1 is not mapped. Exception should have been thrown before execution reaches this point.");
+	}
+	catch (FileModeException &e)
+	{
+	}
+	try
+	{
+		File::create("test.7", FileMode::MAPPED);
+		PRINT_ERROR("ERROR :: A mapped file cannot be created. Exception should have been thrown before execution reaches this point.");
+	}
+	catch (FileModeException &e)
+	{
+	}
+	File::remove(mappedName);
+
+	std::cout << "Test 24 passed" << "\n";
+}
+
+void test25()
+{
+	//Threads each write a page and sync, sharing syncs; every one of them returns with its page on disk
+	std::vector<PageId> used;
+	for (FileIterator iter = file5ptr->begin(); iter != file5ptr->end() && used.size() < 8; ++iter) {
+		used.push_back((*iter).page_number());
+	}
+	bool failed[8] = {false, false, false, false, false, false, false, false};
+	std::vector<std::thread> threads;
+	for (std::size_t t = 0; t < used.size(); t++) {
+		threads.push_back(std::thread([&used, &failed, t]() {
+			try {
+				for (int round = 0; round < 10; round++) {
+					file5ptr->writePage(file5ptr->readPage(used[t]));
+					file5ptr->groupSync();
+				}
+			} catch (BadgerDbException &e) {
+				failed[t] = true;
+			}
+		}));
+	}
+	for (std::size_t t = 0; t < threads.size(); t++) {
+		threads[t].join();
+	}
+	for (std::size_t t = 0; t < used.size(); t++) {
+		if (failed[t])
+		{
+			PRINT_ERROR("ERROR :: A group sync failed.");
+		}
+	}
+
+	//Ranges and whole files, and the checkpoint of the buffer manager
+	file5ptr->syncRange(used.front(), used.back() - used.front() + 1);
+	file5ptr->sync();
+	bufMgr->readPage(file5ptr, used[0], page);
+	bufMgr->unPinPage(file5ptr, used[0], true);
+	if (bufMgr->flushAll().pages != 1)
+	{
+		PRINT_ERROR("ERROR :: flushAll should have written and synced the dirty page.");
+	}
+
+	std::cout << "Test 25 passed" << "\n";
+}
+
+void test26()
+{
+	const std::string headerName = "test.6";
+	try
+	{
+		File::remove(headerName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	//The header lives in memory, shared by every File object of the file, and reaches the disk at a sync
+	{
+		File writer = File::create(headerName);
+		File reader = File::open(headerName);
+		for (int k = 0; k < 5; k++)
+		{
+			writer.allocatePage();
+		}
+		reader.readPage(5);
+		FileHeader onDisk;
+		std::ifstream raw(headerName, std::ios::binary);
+		raw.read(reinterpret_cast<char*>(&onDisk), sizeof(onDisk));
+		if (!raw || onDisk.num_pages != 1)
+		{
+			PRINT_ERROR("ERROR :: The header should not have been written before a sync.");
+		}
+		writer.sync();
+		raw.seekg(0);
+		raw.read(reinterpret_cast<char*>(&onDisk), sizeof(onDisk));
+		if (!raw || onDisk.num_pages != 6 || onDisk.first_used_page != 1)
+		{
+			PRINT_ERROR("ERROR :: The header should have been written by the sync.");
+		}
+	}
+
+	//A process dies after allocating pages and reusing a deleted one, without a sync
+	pid_t child = fork();
+	if (child == 0) {
+		File crashed = File::open(headerName);
+		crashed.deletePage(3);
+		crashed.sync();
+		Page reused = crashed.allocatePage();
+		reused.insertRecord("reused");
+		crashed.writePage(reused);
+		for (int k = 0; k < 3; k++)
+		{
+			crashed.allocatePage();
+		}
+		_exit(reused.page_number() == 3 ? 0 : 1);
+	}
+	int status;
+	waitpid(child, &status, 0);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	{
+		PRINT_ERROR("ERROR :: The child should have reused the deleted page.");
+	}
+
+	//Neither the reused page nor the pages past the old end are handed out again
+	{
+		File recovered = File::open(headerName);
+		const RecordId reusedRid = {3, 1};
+		if (recovered.readPage(3).getRecord(reusedRid) != "reused")
+		{
+			PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+		}
+		if (recovered.allocatePage().page_number() != 9)
+		{
+			PRINT_ERROR("ERROR :: A page that may be in use was allocated again.");
+		}
+	}
+	File::remove(headerName);
+
+	std::cout << "Test 26 passed" << "\n";
+}
+
+void test27()
+{
+	const std::string linkName = "test.7";
+	try
+	{
+		File::remove(linkName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		File writer = File::create(linkName);
+		File deleter = File::open(linkName);
+		for (int k = 0; k < 4; k++)
+		{
+			writer.allocatePage();
+		}
+		Page stale2 = writer.readPage(2);
+		Page stale3 = writer.readPage(3);
+
+		//Another File object unlinks page 3; writing back a stale copy of page 2 keeps the new link
+		deleter.deletePage(3);
+		stale2.insertRecord("stale");
+		writer.writePage(stale2);
+		PageId pages = 0;
+		for (FileIterator iter = deleter.begin(); iter != deleter.end(); ++iter)
+		{
+			pages++;
+		}
+		if (pages != 3 || writer.readPage(2).next_page_number() != 4)
+		{
+			PRINT_ERROR("ERROR :: Writing a page back should keep its link on disk.");
+		}
+		try
+		{
+			writer.writePage(stale3);
+			PRINT_ERROR("ERROR :: Deleted page written back. Exception should have been thrown before execution reaches this point.");
+		}
+		catch(InvalidPageException e)
+		{
+		}
+
+		//Write-backs go by the links kept in memory, not by the headers on disk
+		Page page4 = writer.readPage(4);
+		{
+			const PageHeader cleared = PageHeader();
+			std::fstream raw(linkName, std::ios::binary | std::ios::in | std::ios::out);
+			raw.seekp(4 * Page::SIZE);
+			raw.write(reinterpret_cast<const char*>(&cleared), sizeof(cleared));
+		}
+		IoEngine engine(4);
+		std::future<void> written = engine.write(&writer, &page4);
+		engine.submit();
+		written.get();
+		const Page rewritten = writer.readPage(4);
+		if (rewritten.page_number() != 4 || rewritten.next_page_number() != Page::INVALID_NUMBER)
+		{
+			PRINT_ERROR("ERROR :: The page should have been written with its header from memory.");
+		}
+	}
+	File::remove(linkName);
+
+	std::cout << "Test 27 passed" << "\n";
+}
+
+void test28()
+{
+	const std::string directoryName = "test.8";
+	try
+	{
+		File::remove(directoryName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		File bulk = File::create(directoryName);
+		for (int k = 0; k < 300; k++)
+		{
+			bulk.allocatePage();
+		}
+		bulk.deletePage(10);
+		bulk.deletePage(20);
+		bulk.deletePage(30);
+	}
+	if (!File::exists(directoryName + ".dir"))
+	{
+		PRINT_ERROR("ERROR :: The directory should have been saved at close.");
+	}
+
+	//Page 50 looks free on disk, but the saved directory knows better
+	{
+		const PageHeader cleared = PageHeader();
+		std::fstream raw(directoryName, std::ios::binary | std::ios::in | std::ios::out);
+		raw.seekp(50 * Page::SIZE);
+		raw.write(reinterpret_cast<const char*>(&cleared), sizeof(cleared));
+	}
+	{
+		File reopened = File::open(directoryName);
+		PageId pages = 0;
+		for (FileIterator iter = reopened.begin(); iter != reopened.end(); ++iter)
+		{
+			pages++;
+		}
+		if (pages != 297)
+		{
+			PRINT_ERROR("ERROR :: The used pages should have come from the saved directory.");
+		}
+		//The lowest free page goes first, and the page before it links to it when read
+		if (reopened.allocatePage().page_number() != 10 || reopened.readPage(9).next_page_number() != 10)
+		{
+			PRINT_ERROR("ERROR :: The free page should have been reused and linked in.");
+		}
+	}
+
+	//A process dies with the file open; the directory is rebuilt from the pages themselves
+	pid_t child = fork();
+	if (child == 0) {
+		File crashed = File::open(directoryName);
+		crashed.deletePage(60);
+		_exit(0);
+	}
+	int status;
+	waitpid(child, &status, 0);
+	{
+		File recovered = File::open(directoryName);
+		PageId pages = 0;
+		for (FileIterator iter = recovered.begin(); iter != recovered.end(); ++iter)
+		{
+			pages++;
+		}
+		if (pages != 296 || recovered.allocatePage().page_number() != 20)
+		{
+			PRINT_ERROR("ERROR :: The directory should have been rebuilt from the pages.");
+		}
+	}
+
+	//Processes see each other's allocations and deletions, whether they opened the file on their own or inherited it
+	{
+		File parentFile = File::open(directoryName);
+		child = fork();
+		if (child == 0) {
+			bool seen;
+			{
+				File childFile = File::open("./" + directoryName);
+				Page first = childFile.allocatePage();
+				first.insertRecord("child");
+				childFile.writePage(first);
+				const PageId second = parentFile.allocatePage().page_number();
+				childFile.deletePage(100);
+				seen = first.page_number() == 30 && second == 50;
+			}
+			_exit(seen ? 0 : 1);
+		}
+		waitpid(child, &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		{
+			PRINT_ERROR("ERROR :: The child's two files should have allocated different pages.");
+		}
+		const RecordId childRid = {30, 1};
+		if (parentFile.allocatePage().page_number() != 100 || parentFile.readPage(30).getRecord(childRid) != "child")
+		{
+			PRINT_ERROR("ERROR :: The parent should have caught up with the child's changes.");
+		}
+	}
+	{
+		File reopened = File::open(directoryName);
+		PageId pages = 0;
+		for (FileIterator iter = reopened.begin(); iter != reopened.end(); ++iter)
+		{
+			pages++;
+		}
+		if (pages != 299 || reopened.allocatePage().page_number() != 60)
+		{
+			PRINT_ERROR("ERROR :: The last close should have saved every process's changes.");
+		}
+	}
+
+	//Opening the file and reading it rewrites neither the file nor its saved directory
+	{
+		std::ifstream savedFile(directoryName, std::ios::binary);
+		std::ifstream savedDirectory(directoryName + ".dir", std::ios::binary);
+		const std::string before((std::istreambuf_iterator<char>(savedFile)), std::istreambuf_iterator<char>());
+		const std::string directoryBefore((std::istreambuf_iterator<char>(savedDirectory)), std::istreambuf_iterator<char>());
+		{
+			File reading = File::open(directoryName);
+			for (FileIterator iter = reading.begin(); iter != reading.end(); ++iter)
+			{
+				(*iter).getFreeSpace();
+			}
+		}
+		std::ifstream closedFile(directoryName, std::ios::binary);
+		std::ifstream closedDirectory(directoryName + ".dir", std::ios::binary);
+		const std::string after((std::istreambuf_iterator<char>(closedFile)), std::istreambuf_iterator<char>());
+		const std::string directoryAfter((std::istreambuf_iterator<char>(closedDirectory)), std::istreambuf_iterator<char>());
+		if (before.empty() || after != before || directoryAfter != directoryBefore)
+		{
+			PRINT_ERROR("ERROR :: A file left unchanged should not have been written back at close.");
+		}
+	}
+
+	//A directory saved while the file is open elsewhere goes stale with the next change made there
+	{
+		File other = File::open("./" + directoryName);
+		{
+			File closing = File::open(directoryName);
+			other.deletePage(70);
+		}
+		const PageId taken = other.allocatePage().page_number();
+		File opened = File::open(directoryName);
+		if (taken != 70 || opened.allocatePage().page_number() == 70)
+		{
+			PRINT_ERROR("ERROR :: A stale saved directory should not have been loaded.");
+		}
+	}
+	File::remove(directoryName);
+	if (File::exists(directoryName + ".dir"))
+	{
+		PRINT_ERROR("ERROR :: The saved directory should have been removed with the file.");
+	}
+
+	std::cout << "Test 28 passed" << "\n";
+}
+
+void test29()
+{
+	const std::string spaceName = "test.9";
+	try
+	{
+		File::remove(spaceName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	//Full pages keep under 1000 bytes free; empty ones have room for the large record
+	const std::string filler(Page::DATA_SIZE - 1000, 'f');
+	const std::size_t large = 2000;
+
+	{
+		File spaceFile = File::create(spaceName);
+		for (int k = 0; k < 20; k++)
+		{
+			Page added = spaceFile.allocatePage();
+			if (k < 15)
+			{
+				added.insertRecord(filler);
+				spaceFile.writePage(added);
+			}
+		}
+		const PageId roomy = spaceFile.findPageWithSpace(large);
+		const PageId small = spaceFile.findPageWithSpace(500);
+		if (roomy < 16 || roomy > 20 || small > 15 || !spaceFile.readPage(small).hasSpaceForRecord(std::string(500, 's')))
+		{
+			PRINT_ERROR("ERROR :: The free space map offered the wrong pages.");
+		}
+
+		//Deleted pages are never offered; pages filled in memory stop being offered once noted
+		for (PageId k = 16; k <= 20; k++)
+		{
+			if (k != 18)
+			{
+				spaceFile.deletePage(k);
+			}
+		}
+		if (spaceFile.findPageWithSpace(large) != 18)
+		{
+			PRINT_ERROR("ERROR :: Only page 18 should have room left.");
+		}
+		Page filled = spaceFile.readPage(18);
+		filled.insertRecord(filler);
+		spaceFile.updateFreeSpace(filled);
+		if (spaceFile.findPageWithSpace(large) != Page::INVALID_NUMBER)
+		{
+			PRINT_ERROR("ERROR :: No page should have room left.");
+		}
+		spaceFile.writePage(filled);
+	}
+
+	//The map is saved at close; write-backs through the engine update it too
+	{
+		File reopened = File::open(spaceName);
+		if (reopened.findPageWithSpace(large) != Page::INVALID_NUMBER || reopened.findPageWithSpace(500) == Page::INVALID_NUMBER)
+		{
+			PRINT_ERROR("ERROR :: The free space map should have been saved.");
+		}
+		Page fresh = reopened.allocatePage();
+		if (reopened.findPageWithSpace(large) != fresh.page_number())
+		{
+			PRINT_ERROR("ERROR :: A new page should have room.");
+		}
+		fresh.insertRecord(filler);
+		IoEngine engine(4);
+		std::future<void> written = engine.write(&reopened, &fresh);
+		engine.submit();
+		written.get();
+		if (reopened.findPageWithSpace(large) != Page::INVALID_NUMBER)
+		{
+			PRINT_ERROR("ERROR :: The write-back should have updated the free space map.");
+		}
+	}
+
+	//After a crash, the map is rebuilt from the page headers
+	pid_t child = fork();
+	if (child == 0) {
+		File crashed = File::open(spaceName);
+		_exit(crashed.allocatePage().page_number() == 17 ? 0 : 1);
+	}
+	int status;
+	waitpid(child, &status, 0);
+	{
+		File recovered = File::open(spaceName);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || recovered.findPageWithSpace(large) != 17)
+		{
+			PRINT_ERROR("ERROR :: The free space map should have been rebuilt.");
+		}
+	}
+	File::remove(spaceName);
+
+	std::cout << "Test 29 passed" << "\n";
+}
+
+void test30()
+{
+	//The clock sweeps 64 frames at a time; a pool of 200 frames ends in a partial word
+	const std::string sweepName = "test.10";
+	const std::string otherName = "test.11";
+	try
+	{
+		File::remove(sweepName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	try
+	{
+		File::remove(otherName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	{
+		File sweepFile = File::create(sweepName);
+		File otherFile = File::create(otherName);
+		for (int k = 0; k < 250; k++)
+		{
+			sweepFile.allocatePage();
+			if (k < 100)
+				otherFile.allocatePage();
+		}
+	}
+	{
+		File sweepFile = File::open(sweepName);
+		File otherFile = File::open(otherName);
+
+		//With every frame pinned but one in the first word and one in the third, the hand passes both, wraps
+		//around and takes the one in the first word, then the other, then gives up
+		{
+			BufMgr* pinnedPool = new BufMgr(200);
+			for (i = 1; i <= 200; i++)
+				pinnedPool->readPage(&sweepFile, i, page);
+			pinnedPool->unPinPage(&sweepFile, 6, false);
+			pinnedPool->unPinPage(&sweepFile, 131, false);
+			pinnedPool->readPage(&sweepFile, 201, page);
+			const std::uint32_t reads = pinnedPool->getBufStats().diskreads;
+			pinnedPool->readPage(&sweepFile, 131, page);
+			if (pinnedPool->getBufStats().diskreads != reads)
+			{
+				PRINT_ERROR("ERROR :: The unpinned frame in the first word should have been taken first.");
+			}
+			pinnedPool->unPinPage(&sweepFile, 131, false);
+			pinnedPool->readPage(&sweepFile, 6, page);
+			try
+			{
+				pinnedPool->readPage(&sweepFile, 202, page);
+				PRINT_ERROR("ERROR :: A pool with every frame pinned should have refused the page.");
+			}
+			catch (BufferExceededException& e)
+			{
+			}
+			for (i = 1; i <= 200; i++)
+				pinnedPool->unPinPage(&sweepFile, i == 131 ? 201 : i, false);
+			delete pinnedPool;
+		}
+
+		//A tenant at its maximum sweeps its own frames, which straddle the last two words, and another tenant
+		//sweeping past them leaves it its minimum
+		{
+			BufMgr* quotaPool = new BufMgr(200);
+			quotaPool->setTenant(&otherFile, 1);
+			quotaPool->setTenant(&sweepFile, 2);
+			quotaPool->setTenantQuota(1, 0, 70);
+			for (i = 1; i <= 130; i++) {
+				quotaPool->readPage(&sweepFile, i, page);
+				quotaPool->unPinPage(&sweepFile, i, false);
+			}
+			for (i = 1; i <= 100; i++) {
+				quotaPool->readPage(&otherFile, i, page);
+				quotaPool->unPinPage(&otherFile, i, false);
+			}
+			if (quotaPool->getTenantStats(1).frames != 70 || quotaPool->getTenantStats(2).frames != 130)
+			{
+				PRINT_ERROR("ERROR :: Tenant 1 should have replaced its own pages at its maximum.");
+			}
+			quotaPool->setTenantQuota(1, 60, 70);
+			for (int pass = 0; pass < 2; pass++) {
+				for (i = 131; i <= 250; i++) {
+					quotaPool->readPage(&sweepFile, i, page);
+					quotaPool->unPinPage(&sweepFile, i, false);
+					if (quotaPool->getTenantStats(1).frames < 60)
+					{
+						PRINT_ERROR("ERROR :: Tenant 1 should have kept its minimum.");
+					}
+				}
+			}
+			if (quotaPool->getTenantStats(1).frames != 60 || quotaPool->getTenantStats(2).frames != 140)
+			{
+				PRINT_ERROR("ERROR :: Tenant 2 should have taken tenant 1 down to its minimum and no further.");
+			}
+			delete quotaPool;
+		}
+	}
+	File::remove(sweepName);
+	File::remove(otherName);
+
+	std::cout << "Test 30 passed" << "\n";
+}
+
+void benchWriteBack()
+{
+	//Dirty pages scattered over a file larger than the pool, written back by flushFile with the
+	//kernel's cache of the file dropped, the way they would be after a long run
+	const std::string benchName = "bench.db";
+	const PageId filePages = 8192;
+	const std::uint32_t poolPages = 1024;
+	const int rounds = 8;
+	try
+	{
+		File::remove(benchName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	{
+		File created = File::create(benchName);
+		for (PageId k = 0; k < filePages; k++)
+		{
+			Page filled = created.allocatePage();
+			filled.insertRecord(std::string(Page::DATA_SIZE / 2, 'x'));
+			created.writePage(filled);
+		}
+		created.sync();
+	}
+
+	const FileMode modes[2] = {FileMode::BUFFERED, FileMode::DIRECT};
+	const char* modeNames[2] = {"buffered", "direct"};
+	for (int m = 0; m < 2; m++)
+	{
+		File benchFile = File::open(benchName, modes[m]);
+		BufMgr* pool = new BufMgr(poolPages);
+		std::uint64_t seed = 12345;
+		std::chrono::steady_clock::duration spent = std::chrono::steady_clock::duration::zero();
+		for (int round = 0; round < rounds; round++)
+		{
+			for (std::uint32_t k = 0; k < poolPages; k++)
+			{
+				seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+				const PageId pageNo = 1 + static_cast<PageId>((seed >> 33) % filePages);
+				Page* dirty;
+				pool->readPage(&benchFile, pageNo, dirty);
+				pool->unPinPage(&benchFile, pageNo, true);
+			}
+			const int fd = ::open(benchName.c_str(), O_RDONLY);
+			posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+			::close(fd);
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			pool->flushFile(&benchFile);
+			spent += std::chrono::steady_clock::now() - start;
+		}
+		const double written = pool->getBufStats().diskwrites;
+		delete pool;
+
+		const double seconds = std::chrono::duration<double>(spent).count();
+		std::cout << modeNames[m] << ": " << written << " pages written back in " << seconds << " s, "
+				<< written / seconds << " pages/s, "
+				<< written * Page::SIZE / seconds / (1024 * 1024) << " MB/s" << "\n";
+	}
+	File::remove(benchName);
+}
+
+void benchScan()
+{
+	//Sequential scans of a 16 MB file through a 4 MB pool, reading every record, at the page size
+	//this binary was built with
+	const std::string benchName = "bench.db";
+	const PageId filePages = (16 << 20) / Page::SIZE;
+	const std::uint32_t poolPages = (4 << 20) / Page::SIZE;
+	const std::size_t recordLength = 100;
+	const int passes = 10;
+	try
+	{
+		File::remove(benchName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	{
+		File created = File::create(benchName);
+		const std::string record(recordLength, 'x');
+		for (PageId k = 0; k < filePages; k++)
+		{
+			Page filled = created.allocatePage();
+			while (filled.hasSpaceForRecord(record))
+				filled.insertRecord(record);
+			created.writePage(filled);
+		}
+		created.sync();
+	}
+
+	std::uint64_t records = 0;
+	std::size_t bytes = 0;
+	double seconds;
+	{
+		File benchFile = File::open(benchName);
+		BufMgr* pool = new BufMgr(poolPages);
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int pass = 0; pass < passes; pass++)
+		{
+			for (PageId pageNo = 1; pageNo <= filePages; pageNo++)
+			{
+				Page* scanned;
+				pool->readPage(&benchFile, pageNo, scanned);
+				for (PageIterator record = scanned->begin(); record != scanned->end(); ++record)
+				{
+					bytes += (*record).size();
+					records++;
+				}
+				pool->unPinPage(&benchFile, pageNo, false);
+			}
+		}
+		seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		delete pool;
+	}
+	File::remove(benchName);
+
+	std::cout << Page::SIZE / 1024 << " KB pages: " << records << " records (" << bytes << " bytes) in "
+			<< seconds << " s, "
+			<< (double) passes * filePages * Page::SIZE / seconds / (1024 * 1024) << " MB/s, "
+			<< records / seconds / 1e6 << " M records/s" << "\n";
+}
+
+void benchStartup()
+{
+	//Time to construct and destroy buffer managers of up to a million frames, and the memory they hold
+	//right after construction
+	const std::uint32_t sizes[3] = {65536, 262144, 1048576};
+	const long pageBytes = sysconf(_SC_PAGESIZE);
+	for (int s = 0; s < 3; s++)
+	{
+		long before = 0, after = 0, ignored;
+		std::ifstream statm("/proc/self/statm");
+		statm >> ignored >> before;
+		statm.close();
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		BufMgr* pool = new BufMgr(sizes[s]);
+		const std::chrono::steady_clock::time_point built = std::chrono::steady_clock::now();
+		statm.open("/proc/self/statm");
+		statm >> ignored >> after;
+		delete pool;
+		const std::chrono::steady_clock::time_point destroyed = std::chrono::steady_clock::now();
+		std::cout << sizes[s] << " frames: constructed in "
+				<< std::chrono::duration<double, std::milli>(built - start).count() << " ms, destroyed in "
+				<< std::chrono::duration<double, std::milli>(destroyed - built).count() << " ms, "
+				<< (after - before) * pageBytes / (1024 * 1024) << " MB resident" << "\n";
+	}
+}
+
+void benchPrefetch()
+{
+	//Latency of readPage() over a fixed random walk through a file eight times the pool, repeated so the
+	//prefetcher learns it, with the kernel's cache of the file dropped before each pass and a little work done
+	//with each page
+	const std::string benchName = "bench.db";
+	const PageId filePages = 2048;
+	const std::uint32_t poolPages = 256;
+	const int passes = 4;
+	const std::chrono::microseconds work(20);
+	try
+	{
+		File::remove(benchName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	{
+		File created = File::create(benchName);
+		for (PageId k = 0; k < filePages; k++)
+		{
+			Page filled = created.allocatePage();
+			filled.insertRecord(std::string(Page::DATA_SIZE / 2, 'x'));
+			created.writePage(filled);
+		}
+		created.sync();
+	}
+	std::vector<PageId> walk(filePages);
+	std::uint64_t seed = 12345;
+	for (PageId k = 0; k < filePages; k++)
+	{
+		walk[k] = k + 1;
+	}
+	for (PageId k = filePages - 1; k > 0; k--)
+	{
+		seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		std::swap(walk[k], walk[(seed >> 33) % (k + 1)]);
+	}
+
+	const char* modeNames[2] = {"no prefetcher", "prefetcher"};
+	for (int m = 0; m < 2; m++)
+	{
+		File benchFile = File::open(benchName);
+		BufMgr* pool = new BufMgr(poolPages);
+		if (m == 1)
+			pool->enablePrefetcher(4 * filePages);
+		std::vector<double> micros;
+		for (int pass = 0; pass < passes; pass++)
+		{
+			const int fd = ::open(benchName.c_str(), O_RDONLY);
+			posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+			::close(fd);
+			for (PageId k = 0; k < filePages; k++)
+			{
+				Page* read;
+				const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				pool->readPage(&benchFile, walk[k], read);
+				const std::chrono::steady_clock::time_point got = std::chrono::steady_clock::now();
+				//The first pass only trains the prefetcher
+				if (pass > 0)
+					micros.push_back(std::chrono::duration<double, std::micro>(got - start).count());
+				while (std::chrono::steady_clock::now() - got < work)
+				{
+				}
+				pool->unPinPage(&benchFile, walk[k], false);
+			}
+		}
+		const PrefetchStats prefetchStats = pool->getPrefetchStats();
+		delete pool;
+
+		double total = 0;
+		for (std::size_t k = 0; k < micros.size(); k++)
+			total += micros[k];
+		std::sort(micros.begin(), micros.end());
+		std::cout << modeNames[m] << ": readPage mean " << total / micros.size() << " us, median "
+				<< micros[micros.size() / 2] << " us, p99 " << micros[micros.size() * 99 / 100] << " us, "
+				<< prefetchStats.useful << " of " << prefetchStats.issued << " prefetched pages used" << "\n";
+	}
+	File::remove(benchName);
+}
+
+void benchSweep()
+{
+	//Time the clock takes to find a frame in a pool of 4096 frames with every frame pinned, with all but one
+	//frame in 64 pinned, and with three frames in four pinned; the page cache holds the file throughout
+	const std::string benchName = "bench.db";
+	const std::uint32_t poolPages = 4096;
+	const PageId filePages = 2 * poolPages;
+	const int requests = 4000;
+	try
+	{
+		File::remove(benchName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	{
+		File created = File::create(benchName);
+		for (PageId k = 0; k < filePages; k++)
+		{
+			created.allocatePage();
+		}
+	}
+
+	{
+		File benchFile = File::open(benchName);
+		BufMgr* pool = new BufMgr(poolPages);
+		for (PageId pageNo = 1; pageNo <= poolPages; pageNo++)
+		{
+			Page* pinned;
+			pool->readPage(&benchFile, pageNo, pinned);
+		}
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int k = 0; k < requests; k++)
+		{
+			try
+			{
+				Page* refused;
+				pool->readPage(&benchFile, poolPages + 1, refused);
+			}
+			catch (BufferExceededException& e)
+			{
+			}
+		}
+		std::cout << "all frames pinned: "
+				<< std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / requests
+				<< " us per refused request" << "\n";
+
+		//Pages 1 to poolPages sit in frames 0 to poolPages - 1
+		const std::uint32_t unpinnedEvery[2] = {64, 4};
+		const char* names[2] = {"63 of 64 frames pinned", "3 of 4 frames pinned"};
+		PageId next = poolPages + 1;
+		for (int m = 0; m < 2; m++)
+		{
+			for (PageId pageNo = 1; pageNo <= poolPages; pageNo += unpinnedEvery[m])
+			{
+				if (m == 0 || (pageNo - 1) % unpinnedEvery[0] != 0)
+					pool->unPinPage(&benchFile, pageNo, false);
+			}
+			start = std::chrono::steady_clock::now();
+			for (int k = 0; k < requests; k++, next = next == filePages ? poolPages + 1 : next + 1)
+			{
+				Page* read;
+				pool->readPage(&benchFile, next, read);
+				pool->unPinPage(&benchFile, next, false);
+			}
+			std::cout << names[m] << ": "
+					<< std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / requests
+					<< " us per miss" << "\n";
+		}
+		delete pool;
+	}
+	File::remove(benchName);
+}
+
+void benchPageTable()
+{
+	//Random lookups of 4096 pages in the page table by 1 to 8 threads at once: BufHashTbl behind a mutex,
+	//as BufMgr guards it, against ConcurrentPageTable without one.  Threads only run side by side on as many
+	//CPUs as the machine has
+	const std::string benchName = "bench.db";
+	const PageId entries = 4096;
+	const int lookups = 1000000;
+	const int htSize = entries * 12 / 10 + 1;
+	try
+	{
+		File::remove(benchName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	{
+		File benchFile = File::create(benchName);
+		BufHashTbl locked(htSize);
+		std::mutex tableLock;
+		ConcurrentPageTable lockFree(htSize);
+		for (PageId pageNo = 1; pageNo <= entries; pageNo++)
+		{
+			locked.insert(&benchFile, pageNo, pageNo - 1);
+			lockFree.insert(&benchFile, pageNo, pageNo - 1);
+		}
+		std::cout << std::thread::hardware_concurrency() << " CPUs" << "\n";
+		for (int threadCount = 1; threadCount <= 8; threadCount *= 2)
+		{
+			double rates[2];
+			for (int t = 0; t < 2; t++)
+			{
+				//Summed so the lookups cannot be optimized away
+				std::atomic<std::uint64_t> checksum(0);
+				std::vector<std::thread> threads;
+				const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				for (int k = 0; k < threadCount; k++)
+				{
+					threads.push_back(std::thread([&, t, k]() {
+						std::uint64_t seed = 12345 + k;
+						std::uint64_t sum = 0;
+						for (int n = 0; n < lookups; n++)
+						{
+							seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+							const PageId pageNo = 1 + static_cast<PageId>((seed >> 33) % entries);
+							FrameId frame;
+							if (t == 0)
+							{
+								std::lock_guard<std::mutex> lock(tableLock);
+								locked.lookup(&benchFile, pageNo, frame);
+							}
+							else
+							{
+								lockFree.lookup(&benchFile, pageNo, frame);
+							}
+							sum += frame;
+						}
+						checksum += sum;
+					}));
+				}
+				for (std::size_t k = 0; k < threads.size(); k++)
+					threads[k].join();
+				const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				rates[t] = (double) threadCount * lookups / seconds / 1e6;
+			}
+			std::cout << threadCount << " threads: BufHashTbl with a mutex " << rates[0]
+					<< " M lookups/s, ConcurrentPageTable " << rates[1] << " M lookups/s" << "\n";
+		}
+	}
+	File::remove(benchName);
+}
+
+void benchAlloc()
+{
+	//Allocate n pages, delete every other one, then allocate that many again, straight through File
+	const std::string benchName = "bench.db";
+	const PageId sizes[3] = {2000, 20000, 100000};
+	for (int s = 0; s < 3; s++)
+	{
+		const PageId n = sizes[s];
+		try
+		{
+			File::remove(benchName);
+		}
+		catch(FileNotFoundException e)
+		{
+		}
+		double seconds[3];
+		{
+			File benchFile = File::create(benchName);
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (PageId k = 0; k < n; k++)
+				benchFile.allocatePage();
+			std::chrono::steady_clock::time_point done = std::chrono::steady_clock::now();
+			seconds[0] = std::chrono::duration<double>(done - start).count();
+			start = done;
+			for (PageId pageNo = 1; pageNo <= n; pageNo += 2)
+				benchFile.deletePage(pageNo);
+			done = std::chrono::steady_clock::now();
+			seconds[1] = std::chrono::duration<double>(done - start).count();
+			start = done;
+			for (PageId k = 0; k < (n + 1) / 2; k++)
+				benchFile.allocatePage();
+			seconds[2] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+		File::remove(benchName);
+		std::cout << n << " pages: allocate " << seconds[0] / n * 1e6 << " us/page, delete half "
+				<< seconds[1] / ((n + 1) / 2) * 1e6 << " us/page, reallocate " << seconds[2] / ((n + 1) / 2) * 1e6
+				<< " us/page" << "\n";
+	}
+}
+
+void benchPlacement()
+{
+	//Place 2000 records of 300 to 1500 bytes in a file of 5000 pages with under 1600 bytes free each, first
+	//by reading pages through FileIterator until one has room, then by asking findPageWithSpace()
+	const std::string benchName = "bench.db";
+	const PageId filePages = 5000;
+	const int inserts = 2000;
+	const char* names[2] = {"probing pages", "findPageWithSpace"};
+	for (int m = 0; m < 2; m++)
+	{
+		try
+		{
+			File::remove(benchName);
+		}
+		catch(FileNotFoundException e)
+		{
+		}
+		std::uint64_t seed = 12345;
+		std::uint64_t reads = 0;
+		double seconds;
+		{
+			File benchFile = File::create(benchName);
+			for (PageId k = 0; k < filePages; k++)
+			{
+				seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+				Page filled = benchFile.allocatePage();
+				filled.insertRecord(std::string(Page::DATA_SIZE - 100 - (seed >> 33) % 1500, 'f'));
+				benchFile.writePage(filled);
+			}
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (int k = 0; k < inserts; k++)
+			{
+				seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+				const std::string record(300 + (seed >> 33) % 1201, 'r');
+				bool placed = false;
+				if (m == 0)
+				{
+					for (FileIterator iter = benchFile.begin(); !placed && iter != benchFile.end(); ++iter)
+					{
+						Page probed = *iter;
+						reads++;
+						if (probed.hasSpaceForRecord(record))
+						{
+							probed.insertRecord(record);
+							benchFile.writePage(probed);
+							placed = true;
+						}
+					}
+				}
+				else
+				{
+					for (PageId pageNo = benchFile.findPageWithSpace(record.size());
+					     !placed && pageNo != Page::INVALID_NUMBER; pageNo = benchFile.findPageWithSpace(record.size()))
+					{
+						Page found = benchFile.readPage(pageNo);
+						reads++;
+						if (found.hasSpaceForRecord(record))
+						{
+							found.insertRecord(record);
+							benchFile.writePage(found);
+							placed = true;
+						}
+						else
+						{
+							benchFile.updateFreeSpace(found);
+						}
+					}
+				}
+				if (!placed)
+				{
+					Page added = benchFile.allocatePage();
+					added.insertRecord(record);
+					benchFile.writePage(added);
+				}
+			}
+			seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+		File::remove(benchName);
+		std::cout << names[m] << ": " << seconds / inserts * 1e6 << " us and " << (double) reads / inserts
+				<< " page reads per insert" << "\n";
+	}
+}
@@ -68,6 +68,54 @@
  * If you want to edit what <code>badgerdb_main</code> does, edit
  * <code>src/main.cpp</code>.
  *
+ * To measure how fast the buffer manager writes dirty pages back, run:
+ * @code
+ *   $ ./src/badgerdb_main --bench-writeback
+ * @endcode
+ *
+ * To measure scan throughput at the page size the executable was built with,
+ * run the following; <code>make bench-scan</code> runs it at every supported
+ * page size:
+ * @code
+ *   $ ./src/badgerdb_main --bench-scan
+ * @endcode
+ *
+ * To measure how long buffer managers of up to a million frames take to
+ * start and stop, run:
+ * @code
+ *   $ ./src/badgerdb_main --bench-startup
+ * @endcode
+ *
+ * To measure how long readPage() takes with and without the prefetcher, which
+ * reads ahead on a thread of its own, run:
+ * @code
+ *   $ ./src/badgerdb_main --bench-prefetch
+ * @endcode
+ *
+ * To measure how long the clock takes to find a frame in a mostly pinned
+ * pool, run:
+ * @code
+ *   $ ./src/badgerdb_main --bench-sweep
+ * @endcode
+ *
+ * To compare page table lookup throughput, with one to eight threads, of
+ * BufHashTbl behind a mutex and of the ConcurrentPageTable that
+ * BADGERDB_CONCURRENT_PAGE_TABLE selects, run:
+ * @code
+ *   $ ./src/badgerdb_main --bench-page-table
+ * @endcode
+ *
+ * To measure how fast files allocate and delete pages, run:
+ * @code
+ *   $ ./src/badgerdb_main --bench-alloc
+ * @endcode
+ *
+ * To measure how fast records find a page with room, by probing pages and
+ * through the free space map, run:
+ * @code
+ *   $ ./src/badgerdb_main --bench-placement
+ * @endcode
+ *
  * @subsection documentation_sec Rebuilding the documentation
  *
  * Documentation is generated by using Doxygen.  If you have updated the
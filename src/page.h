@@ -14,6 +14,13 @@
 
 #include "types.h"
 
+/**
+ * Page size in bytes, fixed at compile time with -DBADGERDB_PAGE_SIZE.
+ */
+#ifndef BADGERDB_PAGE_SIZE
+#define BADGERDB_PAGE_SIZE 8192
+#endif
+
 namespace badgerdb {
 
 /**
@@ -92,6 +99,21 @@ struct PageSlot {
   std::uint16_t item_length;
 };
 
+/**
+ * @brief Bytes of a record, viewed where they are stored on a page.
+ */
+struct RecordView {
+  /**
+   * First byte of the record.
+   */
+  const char* data;
+
+  /**
+   * Length of the record in bytes.
+   */
+  std::size_t length;
+};
+
 class PageIterator;
 
 /**
@@ -110,7 +132,7 @@ class Page {
    * Page size in bytes.  If this is changed, database files created with a
    * different page size value will be unreadable by the resulting binaries.
    */
-  static const std::size_t SIZE = 8192;
+  static const std::size_t SIZE = BADGERDB_PAGE_SIZE;
 
   /**
    * Size of page free space area in bytes.
@@ -150,6 +172,16 @@ class Page {
    */
   std::string getRecord(const RecordId& record_id) const;
 
+  /**
+   * Returns the record with the given ID without copying it.  The view points
+   * into the page and is valid as long as the page is and the record is not
+   * changed.
+   *
+   * @param record_id  ID of the record to return.
+   * @return  View of the record.
+   */
+  RecordView viewRecord(const RecordId& record_id) const;
+
   /**
    * Updates the record with the given ID, replacing its data with a new
    * version.  This is equivalent to deleting the old record and inserting a
@@ -204,7 +236,7 @@ class Page {
    *
    * @return  Iterator at first record of page.
    */
-  PageIterator begin();
+  PageIterator begin() const;
 
   /**
    * Returns an iterator representing the record after the last record in the
@@ -212,7 +244,7 @@ class Page {
    *
    * @return  Iterator representing record after the last record in the page.
    */
-  PageIterator end();
+  PageIterator end() const;
 
  private:
   /**
@@ -327,12 +359,15 @@ class Page {
 
   /**
    * Data stored on the page.  Includes bookkeeping information about slots as
-   * well as actual content.
+   * well as actual content.  Kept inline so that a Page is exactly SIZE bytes
+   * of plain memory and can live outside the heap, e.g. in shared memory.
    */
-
-  std::string data_;
+  char data_[DATA_SIZE];
 
   friend class File;
+  friend class IoEngine;
+  friend class CompressedTier;
+  friend class L2Cache;
   friend class PageIterator;
   friend class PageTest;
   friend class BufferTest;
@@ -342,5 +377,10 @@ static_assert(Page::SIZE > sizeof(PageHeader),
               "Page size must be large enough to hold header and data.");
 static_assert(Page::DATA_SIZE > 0,
               "Page must have some space to hold data.");
+static_assert(sizeof(Page) == Page::SIZE,
+              "Page must be laid out as the header followed by its data.");
+static_assert(Page::SIZE == 4096 || Page::SIZE == 8192 ||
+              Page::SIZE == 16384 || Page::SIZE == 65536,
+              "Page size must be 4, 8, 16 or 64 KB.");
 
 }
@@ -0,0 +1,116 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "page_directory.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+#include "page.h"
+
+namespace badgerdb {
+
+PageDirectory::PageDirectory()
+    : num_pages_(1),
+      bitmap_(1, 0) {
+}
+
+void PageDirectory::assign(const PageId num_pages,
+                           const std::vector<std::uint64_t>& bitmap) {
+  num_pages_ = num_pages > 0 ? num_pages : 1;
+  bitmap_.assign((num_pages_ + 63) / 64, 0);
+  for (std::size_t word = 0; word < bitmap_.size() && word < bitmap.size();
+       ++word) {
+    bitmap_[word] = bitmap[word];
+  }
+  // The header page, and bits past the last page, are never set
+  bitmap_[0] &= ~static_cast<std::uint64_t>(1);
+  if (num_pages_ % 64 != 0) {
+    bitmap_.back() &= (static_cast<std::uint64_t>(1) << (num_pages_ % 64)) - 1;
+  }
+
+  used_pages_.clear();
+  free_pages_.clear();
+  // Highest first onto the stack, so that the lowest page is handed out first
+  for (PageId page_number = num_pages_ - 1; page_number > 0; --page_number) {
+    if (isUsed(page_number)) {
+      used_pages_.insert(used_pages_.begin(), page_number);
+    } else {
+      free_pages_.push_back(page_number);
+    }
+  }
+}
+
+PageId PageDirectory::firstUsed() const {
+  return used_pages_.empty() ? Page::INVALID_NUMBER : *used_pages_.begin();
+}
+
+PageId PageDirectory::firstFree() const {
+  return free_pages_.empty() ? Page::INVALID_NUMBER : free_pages_.back();
+}
+
+PageId PageDirectory::nextUsed(const PageId page_number) const {
+  const std::set<PageId>::const_iterator next =
+      used_pages_.upper_bound(page_number);
+  return next == used_pages_.end() ? Page::INVALID_NUMBER : *next;
+}
+
+PageId PageDirectory::take() {
+  PageId page_number;
+  if (!free_pages_.empty()) {
+    page_number = free_pages_.back();
+    free_pages_.pop_back();
+  } else {
+    page_number = num_pages_++;
+    if (num_pages_ > bitmap_.size() * 64) {
+      bitmap_.push_back(0);
+    }
+  }
+  mark(page_number, true);
+  used_pages_.insert(page_number);
+  return page_number;
+}
+
+void PageDirectory::release(const PageId page_number) {
+  assert(isUsed(page_number));
+  mark(page_number, false);
+  used_pages_.erase(page_number);
+  free_pages_.push_back(page_number);
+}
+
+void PageDirectory::claim(const PageId page_number) {
+  assert(page_number != 0);
+  if (page_number >= num_pages_) {
+    for (; num_pages_ < page_number; ++num_pages_) {
+      free_pages_.insert(free_pages_.begin(), num_pages_);
+    }
+    ++num_pages_;
+    bitmap_.resize((num_pages_ + 63) / 64, 0);
+  } else if (isUsed(page_number)) {
+    return;
+  } else {
+    // Most likely at the head of the list, where take() found it
+    const std::vector<PageId>::reverse_iterator free =
+        std::find(free_pages_.rbegin(), free_pages_.rend(), page_number);
+    assert(free != free_pages_.rend());
+    free_pages_.erase(std::next(free).base());
+  }
+  mark(page_number, true);
+  used_pages_.insert(page_number);
+}
+
+void PageDirectory::mark(const PageId page_number, const bool used) {
+  const std::uint64_t bit = static_cast<std::uint64_t>(1) << (page_number % 64);
+  if (used) {
+    bitmap_[page_number / 64] |= bit;
+  } else {
+    bitmap_[page_number / 64] &= ~bit;
+  }
+}
+
+}
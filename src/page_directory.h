@@ -0,0 +1,142 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <set>
+#include <vector>
+
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Which pages of a file are in use, and in which order the free ones
+ *        are handed out, kept in memory.
+ *
+ * A bitmap tells whether a page is in use; an ordered set of the used pages
+ * gives each one's successor in the used list, which runs in ascending page
+ * order; and a stack holds the free pages, its top being the head of the free
+ * list.  Page 0 holds the file header and is neither used nor free.
+ *
+ * The bitmap alone describes the directory: assign() rebuilds the rest from
+ * it, with the free pages handed out lowest first.
+ *
+ * Not threadsafe; File guards each directory with a lock.
+ */
+class PageDirectory {
+ public:
+  /**
+   * Constructs the directory of a new file, which has only its header page.
+   */
+  PageDirectory();
+
+  /**
+   * Replaces the contents of the directory.
+   *
+   * @param num_pages   Number of pages in the file, the header page included.
+   * @param bitmap      Bit p % 64 of word p / 64 is set if page p is in use;
+   *                    words past the end count as zero.
+   */
+  void assign(const PageId num_pages, const std::vector<std::uint64_t>& bitmap);
+
+  /**
+   * Returns the bitmap of used pages, see assign().
+   */
+  const std::vector<std::uint64_t>& bitmap() const { return bitmap_; }
+
+  /**
+   * Returns the number of pages in the file, the header page included.
+   */
+  PageId numPages() const { return num_pages_; }
+
+  /**
+   * Returns the number of free pages.
+   */
+  PageId numFree() const { return static_cast<PageId>(free_pages_.size()); }
+
+  /**
+   * Returns the first page of the used list, or Page::INVALID_NUMBER.
+   */
+  PageId firstUsed() const;
+
+  /**
+   * Returns the first page of the free list, or Page::INVALID_NUMBER.
+   */
+  PageId firstFree() const;
+
+  /**
+   * Returns true if the page is in use.
+   *
+   * @param page_number   Number of page.
+   */
+  bool isUsed(const PageId page_number) const {
+    return page_number < num_pages_ &&
+           (bitmap_[page_number / 64] >> (page_number % 64) & 1) != 0;
+  }
+
+  /**
+   * Returns the first used page after the given one, or
+   * Page::INVALID_NUMBER.  The given page need not be in use.
+   *
+   * @param page_number   Number of page.
+   */
+  PageId nextUsed(const PageId page_number) const;
+
+  /**
+   * Takes the page at the head of the free list, or a page past the end of
+   * the file if the list is empty, and marks it used.
+   *
+   * @return  Number of the page taken.
+   */
+  PageId take();
+
+  /**
+   * Marks a used page free and puts it at the head of the free list.
+   *
+   * @param page_number   Number of page; must be in use.
+   */
+  void release(const PageId page_number);
+
+  /**
+   * Marks the given page used, as take() did in another copy of the
+   * directory.  Pages it skips past the end of the file become free, behind
+   * those already on the free list.
+   *
+   * @param page_number   Number of page; must not be 0.
+   */
+  void claim(const PageId page_number);
+
+ private:
+  /**
+   * Sets or clears the bit of a page.
+   */
+  void mark(const PageId page_number, const bool used);
+
+  /**
+   * Number of pages in the file, the header page included.
+   */
+  PageId num_pages_;
+
+  /**
+   * Bit per page, set while the page is in use.
+   */
+  std::vector<std::uint64_t> bitmap_;
+
+  /**
+   * The used pages, in ascending order.
+   */
+  std::set<PageId> used_pages_;
+
+  /**
+   * The free pages; the last one is the head of the free list.
+   */
+  std::vector<PageId> free_pages_;
+};
+
+}
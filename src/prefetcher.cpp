@@ -0,0 +1,127 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "prefetcher.h"
+
+namespace badgerdb {
+
+Prefetcher::Prefetcher(const std::size_t capacity, const double threshold)
+    : capacity_(capacity),
+      threshold_(threshold),
+      last_(NULL, PageId(Page::INVALID_NUMBER)) {
+}
+
+void Prefetcher::record(File* file, const PageId page_no) {
+  if (!enabled(file)) {
+    return;
+  }
+  const PageKey key(file, page_no);
+  const PageKey previous = last_;
+  last_ = key;
+  if (previous.first == NULL || previous == key) {
+    return;
+  }
+
+  std::map<PageKey, EntryList::iterator>::iterator found =
+      index_.find(previous);
+  if (found == index_.end()) {
+    if (index_.size() >= capacity_) {
+      index_.erase(entries_.back().key);
+      entries_.pop_back();
+    }
+    Entry entry;
+    entry.key = previous;
+    entry.total = 0;
+    for (int i = 0; i < WAYS; ++i) {
+      entry.next[i].key = PageKey(NULL, PageId(Page::INVALID_NUMBER));
+      entry.next[i].count = 0;
+    }
+    entries_.push_front(entry);
+    found = index_.insert(std::make_pair(previous, entries_.begin())).first;
+  } else {
+    entries_.splice(entries_.begin(), entries_, found->second);
+  }
+
+  // Bump the successor, or replace the weakest one with it.
+  Entry& entry = *found->second;
+  int weakest = 0;
+  int slot = -1;
+  for (int i = 0; i < WAYS; ++i) {
+    if (entry.next[i].key == key) {
+      slot = i;
+      break;
+    }
+    if (entry.next[i].count < entry.next[weakest].count) {
+      weakest = i;
+    }
+  }
+  if (slot < 0) {
+    slot = weakest;
+    entry.total -= entry.next[slot].count;
+    entry.next[slot].key = key;
+    entry.next[slot].count = 0;
+  }
+  entry.next[slot].count++;
+  entry.total++;
+
+  if (entry.total >= MAX_TOTAL) {
+    entry.total = 0;
+    for (int i = 0; i < WAYS; ++i) {
+      entry.next[i].count /= 2;
+      entry.total += entry.next[i].count;
+    }
+  }
+}
+
+void Prefetcher::predict(File* file, const PageId page_no,
+                         std::vector<PageKey>& successors) const {
+  std::map<PageKey, EntryList::iterator>::const_iterator found =
+      index_.find(PageKey(file, page_no));
+  if (found == index_.end()) {
+    return;
+  }
+  const Entry& entry = *found->second;
+  for (int i = 0; i < WAYS; ++i) {
+    const Successor& next = entry.next[i];
+    if (next.count >= 2 && next.count >= threshold_ * entry.total &&
+        enabled(next.key.first)) {
+      successors.push_back(next.key);
+    }
+  }
+}
+
+void Prefetcher::forgetFile(const File* file) {
+  EntryList::iterator pos = entries_.begin();
+  while (pos != entries_.end()) {
+    if (pos->key.first == file) {
+      index_.erase(pos->key);
+      pos = entries_.erase(pos);
+      continue;
+    }
+    for (int i = 0; i < WAYS; ++i) {
+      if (pos->next[i].key.first == file) {
+        pos->total -= pos->next[i].count;
+        pos->next[i].key = PageKey(NULL, PageId(Page::INVALID_NUMBER));
+        pos->next[i].count = 0;
+      }
+    }
+    ++pos;
+  }
+  if (last_.first == file) {
+    last_ = PageKey(NULL, PageId(Page::INVALID_NUMBER));
+  }
+}
+
+void Prefetcher::setEnabled(const File* file, const bool enabled) {
+  if (enabled) {
+    disabled_.erase(file);
+  } else {
+    disabled_.insert(file);
+  }
+}
+
+}
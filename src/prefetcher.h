@@ -0,0 +1,212 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "file.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Usage statistics of a Prefetcher.
+ */
+struct PrefetchStats {
+  /**
+   * Number of pages read into the buffer pool ahead of demand.
+   */
+  std::uint64_t issued;
+
+  /**
+   * Number of prefetched pages that were read by a caller before eviction.
+   */
+  std::uint64_t useful;
+
+  /**
+   * Number of demand misses, i.e. reads that had to wait for the page.
+   */
+  std::uint64_t misses;
+
+  /**
+   * Returns the fraction of prefetched pages that were used.
+   */
+  double precision() const {
+    return issued == 0 ? 0.0 : static_cast<double>(useful) / issued;
+  }
+
+  /**
+   * Returns the fraction of would-be misses that a prefetch covered.
+   */
+  double recall() const {
+    return useful + misses == 0 ?
+        0.0 : static_cast<double>(useful) / (useful + misses);
+  }
+
+  /**
+   * Clear all values.
+   */
+  void clear() {
+    issued = useful = misses = 0;
+  }
+
+  PrefetchStats() {
+    clear();
+  }
+};
+
+/**
+ * @brief Learns which pages tend to follow each other in the buffer pool miss
+ *        stream and predicts the likely successors of a page.
+ *
+ * For every page seen in the miss stream the prefetcher keeps a few successor
+ * counters.  A successor is predicted once it has followed the page at least
+ * twice and makes up at least the confidence threshold of everything that
+ * followed it.  The table holds a bounded number of pages and forgets the
+ * least recently seen ones first.
+ *
+ * @warning This class is not threadsafe.
+ */
+class Prefetcher {
+ public:
+  /**
+   * A page of a file.
+   */
+  typedef std::pair<File*, PageId> PageKey;
+
+  /**
+   * Constructs an empty prefetcher.
+   *
+   * @param capacity    Number of pages the successor table may hold.
+   * @param threshold   Share of a page's successors a page must make up to be
+   *                    predicted, between 0 and 1.
+   */
+  Prefetcher(const std::size_t capacity, const double threshold);
+
+  /**
+   * Records the next page of the miss stream, learning that it followed the
+   * previous one.
+   *
+   * @param file      File the page belongs to.
+   * @param page_no   Page number in the file.
+   */
+  void record(File* file, const PageId page_no);
+
+  /**
+   * Returns the confidently predicted successors of a page.
+   *
+   * @param file        File the page belongs to.
+   * @param page_no     Page number in the file.
+   * @param successors  Predicted pages are appended here.
+   */
+  void predict(File* file, const PageId page_no,
+               std::vector<PageKey>& successors) const;
+
+  /**
+   * Drops everything learned about a file's pages.
+   *
+   * @param file  File to forget.
+   */
+  void forgetFile(const File* file);
+
+  /**
+   * Turns prefetching on or off for a file.  Pages of a disabled file are
+   * neither learned from nor prefetched.  All files start enabled.
+   *
+   * @param file      File object.
+   * @param enabled   Whether to prefetch for the file.
+   */
+  void setEnabled(const File* file, const bool enabled);
+
+  /**
+   * Returns whether prefetching is on for a file.
+   *
+   * @param file  File object.
+   */
+  bool enabled(const File* file) const {
+    return disabled_.find(file) == disabled_.end();
+  }
+
+  /**
+   * Returns the prefetch statistics, maintained by the buffer manager.
+   */
+  PrefetchStats& stats() { return stats_; }
+
+ private:
+  /**
+   * Number of successors tracked per page.
+   */
+  static const int WAYS = 4;
+
+  /**
+   * Counts are halved once a page has been followed this many times, so the
+   * table keeps adapting.
+   */
+  static const std::uint32_t MAX_TOTAL = 1 << 12;
+
+  /**
+   * A page that followed another, and how often.
+   */
+  struct Successor {
+    PageKey key;
+    std::uint32_t count;
+  };
+
+  /**
+   * Successor counters of one page.
+   */
+  struct Entry {
+    PageKey key;
+    std::uint32_t total;
+    Successor next[WAYS];
+  };
+
+  typedef std::list<Entry> EntryList;
+
+  /**
+   * Upper bound on the number of pages in the table.
+   */
+  std::size_t capacity_;
+
+  /**
+   * Confidence threshold for a prediction.
+   */
+  double threshold_;
+
+  /**
+   * Entries, most recently seen first.
+   */
+  EntryList entries_;
+
+  /**
+   * Index from page to entry.
+   */
+  std::map<PageKey, EntryList::iterator> index_;
+
+  /**
+   * Previous page of the miss stream.
+   */
+  PageKey last_;
+
+  /**
+   * Files prefetching is turned off for.
+   */
+  std::set<const File*> disabled_;
+
+  /**
+   * Prefetch statistics.
+   */
+  PrefetchStats stats_;
+};
+
+}
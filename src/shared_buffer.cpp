@@ -0,0 +1,515 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "shared_buffer.h"
+#include "exceptions/buffer_exceeded_exception.h"
+#include "exceptions/file_io_exception.h"
+#include "exceptions/page_not_pinned_exception.h"
+#include "exceptions/page_pinned_exception.h"
+
+namespace badgerdb {
+
+    namespace {
+        const std::uint64_t SEGMENT_MAGIC = 0x4244474253484d31ULL;   // "BDGBSHM1"
+        const std::size_t FRAME_ALIGN = 4096;
+
+        std::size_t alignUp(std::size_t n, std::size_t align) {
+            return (n + align - 1) / align * align;
+        }
+    }
+
+    /**
+     * Header at the start of the segment
+     */
+    struct SharedBufMgr::Segment {
+        std::uint64_t magic;
+        std::uint32_t pageSize;
+        std::uint32_t numBufs;
+        std::uint32_t tableSize;
+        std::atomic<std::uint32_t> ready;
+        pthread_mutex_t mutex;
+        FrameId clockHand;
+        pid_t procs[MAX_PROCS];
+        char files[MAX_FILES][MAX_NAME];
+    };
+
+    /**
+     * Shared counterpart of BufDesc, with the file identified by segment file id and pins counted per process
+     */
+    struct SharedBufMgr::FrameDesc {
+        std::int32_t fileId;
+        PageId pageNo;
+        std::uint32_t pinCnt;
+        bool dirty;
+        bool valid;
+        bool refbit;
+        std::uint16_t pins[MAX_PROCS];
+    };
+
+    /**
+     * Page table entry; fileId is -1 in empty slots
+     */
+    struct SharedBufMgr::TableSlot {
+        std::int32_t fileId;
+        PageId pageNo;
+        FrameId frame;
+    };
+
+    SharedBufMgr::SharedBufMgr(const std::string &name, std::uint32_t bufs)
+            : segName(name), base(NULL), mapSize(0), procSlot(-1) {
+        bool creator = true;
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0 && errno == EEXIST) {
+            creator = false;
+            fd = shm_open(name.c_str(), O_RDWR, 0600);
+        }
+        if (fd < 0) {
+            throw FileIOException(name);
+        }
+
+        std::uint32_t tableSize = 0;
+        if (creator) {
+            tableSize = bufs * 2 + 1;
+            mapSize = alignUp(sizeof(Segment) + sizeof(FrameDesc) * bufs + sizeof(TableSlot) * tableSize, FRAME_ALIGN)
+                      + sizeof(Page) * bufs;
+            if (bufs == 0 || ftruncate(fd, mapSize) != 0) {
+                close(fd);
+                shm_unlink(name.c_str());
+                throw FileIOException(name);
+            }
+        } else {
+            // The creator may not have sized the segment yet
+            struct stat st;
+            for (int tries = 0; fstat(fd, &st) == 0 && st.st_size == 0 && tries < 1000; tries++) {
+                usleep(1000);
+            }
+            if (fstat(fd, &st) != 0 || st.st_size == 0) {
+                close(fd);
+                throw FileIOException(name);
+            }
+            mapSize = st.st_size;
+        }
+
+        void *addr = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) {
+            throw FileIOException(name);
+        }
+        base = static_cast<char *>(addr);
+        seg = reinterpret_cast<Segment *>(base);
+
+        if (creator) {
+            // The new segment is zero-filled, which already makes every process and file slot free
+            seg->magic = SEGMENT_MAGIC;
+            seg->pageSize = Page::SIZE;
+            seg->numBufs = bufs;
+            seg->tableSize = tableSize;
+            seg->clockHand = bufs - 1;
+
+            pthread_mutexattr_t attr;
+            pthread_mutexattr_init(&attr);
+            pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+            pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+            pthread_mutex_init(&seg->mutex, &attr);
+            pthread_mutexattr_destroy(&attr);
+        } else {
+            for (int tries = 0; seg->ready.load() == 0 && tries < 1000; tries++) {
+                usleep(1000);
+            }
+            if (seg->ready.load() == 0 || seg->magic != SEGMENT_MAGIC || seg->pageSize != Page::SIZE) {
+                munmap(base, mapSize);
+                throw FileIOException(name);
+            }
+        }
+
+        descs = reinterpret_cast<FrameDesc *>(base + sizeof(Segment));
+        table = reinterpret_cast<TableSlot *>(base + sizeof(Segment) + sizeof(FrameDesc) * seg->numBufs);
+        frames = reinterpret_cast<Page *>(base + alignUp(sizeof(Segment) + sizeof(FrameDesc) * seg->numBufs
+                                                         + sizeof(TableSlot) * seg->tableSize, FRAME_ALIGN));
+
+        if (creator) {
+            for (std::uint32_t i = 0; i < seg->numBufs; i++) {
+                descs[i].fileId = -1;
+                descs[i].pageNo = Page::INVALID_NUMBER;
+                new(&frames[i]) Page();
+            }
+            for (std::uint32_t i = 0; i < seg->tableSize; i++) {
+                table[i].fileId = -1;
+            }
+            seg->ready.store(1);
+        }
+
+        lock();
+        for (int i = 0; i < MAX_PROCS && procSlot < 0; i++) {
+            if (seg->procs[i] == 0 || (kill(seg->procs[i], 0) != 0 && errno == ESRCH)) {
+                releasePins(i);
+                seg->procs[i] = getpid();
+                procSlot = i;
+            }
+        }
+        unlock();
+        if (procSlot < 0) {
+            munmap(base, mapSize);
+            throw FileIOException(name);
+        }
+    }
+
+    SharedBufMgr::~SharedBufMgr() {
+        lock();
+        releasePins(procSlot);
+        seg->procs[procSlot] = 0;
+
+        // The last process out writes back what is still dirty
+        bool others = false;
+        for (int i = 0; i < MAX_PROCS; i++) {
+            if (seg->procs[i] != 0 && !(kill(seg->procs[i], 0) != 0 && errno == ESRCH)) {
+                others = true;
+            }
+        }
+        if (!others) {
+            for (std::uint32_t i = 0; i < seg->numBufs; i++) {
+                if (descs[i].valid && descs[i].dirty) {
+                    fileFor(descs[i].fileId)->writePage(frames[i]);
+                    descs[i].dirty = false;
+                    bufStats.diskwrites++;
+                }
+            }
+        }
+        unlock();
+
+        munmap(base, mapSize);
+        for (std::map<int, File *>::iterator it = ownedFiles.begin(); it != ownedFiles.end(); ++it) {
+            delete it->second;
+        }
+    }
+
+    void SharedBufMgr::remove(const std::string &name) {
+        shm_unlink(name.c_str());
+    }
+
+    void SharedBufMgr::lock() {
+        if (pthread_mutex_lock(&seg->mutex) == EOWNERDEAD) {
+            // The owner died holding the mutex, possibly halfway through changing the table or a descriptor;
+            // take it over, release whatever it had pinned and rebuild what it may have left half-updated
+            pthread_mutex_consistent(&seg->mutex);
+            recoverDeadProcessesLocked();
+            rebuildLocked();
+        }
+    }
+
+    void SharedBufMgr::unlock() {
+        pthread_mutex_unlock(&seg->mutex);
+    }
+
+    std::uint32_t SharedBufMgr::recoverDeadProcesses() {
+        lock();
+        std::uint32_t released = recoverDeadProcessesLocked();
+        unlock();
+        return released;
+    }
+
+    std::uint32_t SharedBufMgr::recoverDeadProcessesLocked() {
+        std::uint32_t released = 0;
+        for (int i = 0; i < MAX_PROCS; i++) {
+            if (i != procSlot && seg->procs[i] != 0 && kill(seg->procs[i], 0) != 0 && errno == ESRCH) {
+                released += releasePins(i);
+                seg->procs[i] = 0;
+            }
+        }
+        return released;
+    }
+
+    void SharedBufMgr::rebuildLocked() {
+        // A descriptor is marked valid only once its frame holds the page, so valid descriptors are the truth;
+        // the table and the pin counts are derived from them
+        for (std::uint32_t i = 0; i < seg->tableSize; i++) {
+            table[i].fileId = -1;
+        }
+        for (std::uint32_t i = 0; i < seg->numBufs; i++) {
+            descs[i].pinCnt = 0;
+            for (int j = 0; j < MAX_PROCS; j++) {
+                descs[i].pinCnt += descs[i].pins[j];
+            }
+            if (descs[i].valid) {
+                insert(descs[i].fileId, descs[i].pageNo, i);
+            }
+        }
+    }
+
+    std::uint32_t SharedBufMgr::releasePins(int slot) {
+        std::uint32_t released = 0;
+        for (std::uint32_t i = 0; i < seg->numBufs; i++) {
+            released += descs[i].pins[slot];
+            descs[i].pinCnt -= descs[i].pins[slot];
+            descs[i].pins[slot] = 0;
+        }
+        return released;
+    }
+
+    int SharedBufMgr::fileId(const File *file) {
+        std::map<const File *, int>::iterator known = fileIds.find(file);
+        if (known != fileIds.end()) {
+            return known->second;
+        }
+
+        const std::string &name = file->filename();
+        int id = -1;
+        for (int i = 0; i < MAX_FILES && id < 0; i++) {
+            if (name == seg->files[i]) {
+                id = i;
+            }
+        }
+        for (int i = 0; i < MAX_FILES && id < 0; i++) {
+            if (seg->files[i][0] == '\0' && name.size() < (std::size_t) MAX_NAME) {
+                std::strcpy(seg->files[i], name.c_str());
+                id = i;
+            }
+        }
+        if (id < 0) {
+            throw FileIOException(name);
+        }
+        fileIds[file] = id;
+        idFiles[id] = const_cast<File *>(file);
+        return id;
+    }
+
+    File *SharedBufMgr::fileFor(int id) {
+        std::map<int, File *>::iterator known = idFiles.find(id);
+        if (known != idFiles.end()) {
+            return known->second;
+        }
+        File *file = new File(File::open(seg->files[id]));
+        ownedFiles[id] = file;
+        idFiles[id] = file;
+        return file;
+    }
+
+    bool SharedBufMgr::lookup(int id, PageId pageNo, FrameId &frame) {
+        std::uint32_t pos = (id * 2654435761u + pageNo) % seg->tableSize;
+        while (table[pos].fileId != -1) {
+            if (table[pos].fileId == id && table[pos].pageNo == pageNo) {
+                frame = table[pos].frame;
+                return true;
+            }
+            pos = (pos + 1) % seg->tableSize;
+        }
+        return false;
+    }
+
+    void SharedBufMgr::insert(int id, PageId pageNo, FrameId frame) {
+        std::uint32_t pos = (id * 2654435761u + pageNo) % seg->tableSize;
+        while (table[pos].fileId != -1) {
+            pos = (pos + 1) % seg->tableSize;
+        }
+        table[pos].fileId = id;
+        table[pos].pageNo = pageNo;
+        table[pos].frame = frame;
+    }
+
+    void SharedBufMgr::removeEntry(int id, PageId pageNo) {
+        const std::uint32_t size = seg->tableSize;
+        std::uint32_t pos = (id * 2654435761u + pageNo) % size;
+        while (table[pos].fileId != -1 && !(table[pos].fileId == id && table[pos].pageNo == pageNo)) {
+            pos = (pos + 1) % size;
+        }
+        if (table[pos].fileId == -1) {
+            return;
+        }
+
+        // Shift later entries of the probe run back into the hole so lookups never stop early
+        std::uint32_t hole = pos;
+        std::uint32_t next = (hole + 1) % size;
+        while (table[next].fileId != -1) {
+            const std::uint32_t home = (table[next].fileId * 2654435761u + table[next].pageNo) % size;
+            const bool movable = hole <= next ? (home <= hole || home > next) : (home <= hole && home > next);
+            if (movable) {
+                table[hole] = table[next];
+                hole = next;
+            }
+            next = (next + 1) % size;
+        }
+        table[hole].fileId = -1;
+    }
+
+    void SharedBufMgr::allocBuf(FrameId &frame) {
+        for (int attempt = 0; attempt < 2; attempt++) {
+            std::uint32_t countPinned = 0;
+            while (countPinned < seg->numBufs) {
+                seg->clockHand = (seg->clockHand + 1) % seg->numBufs;
+                FrameDesc *cur = &descs[seg->clockHand];
+                if (!cur->valid) {
+                    frame = seg->clockHand;
+                    return;
+                }
+                if (cur->refbit) {
+                    cur->refbit = false;
+                    continue;
+                }
+                if (cur->pinCnt > 0) {
+                    countPinned++;
+                    continue;
+                }
+                if (cur->dirty) {
+                    fileFor(cur->fileId)->writePage(frames[seg->clockHand]);
+                    bufStats.diskwrites++;
+                }
+                removeEntry(cur->fileId, cur->pageNo);
+                cur->valid = false;
+                // Keep the compiler from moving the caller's copy into the frame ahead of the invalidation
+                std::atomic_signal_fence(std::memory_order_seq_cst);
+                frame = seg->clockHand;
+                return;
+            }
+            // Everything is pinned; maybe some of the pins belong to processes that are gone
+            if (recoverDeadProcessesLocked() == 0) {
+                break;
+            }
+        }
+        throw BufferExceededException();
+    }
+
+    void SharedBufMgr::assignFrame(FrameId frame, int id, PageId pageNo) {
+        FrameDesc *desc = &descs[frame];
+        desc->fileId = id;
+        desc->pageNo = pageNo;
+        desc->pinCnt = 1;
+        std::memset(desc->pins, 0, sizeof(desc->pins));
+        desc->pins[procSlot] = 1;
+        desc->dirty = false;
+        desc->refbit = true;
+        // The frame and the descriptor must be complete before the descriptor is marked valid; see rebuildLocked()
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        desc->valid = true;
+        insert(id, pageNo, frame);
+    }
+
+    void SharedBufMgr::readPage(File *file, const PageId pageNo, Page *&page) {
+        lock();
+        try {
+            bufStats.accesses++;
+            const int id = fileId(file);
+            FrameId frame;
+            if (lookup(id, pageNo, frame)) {
+                descs[frame].refbit = true;
+                descs[frame].pinCnt++;
+                descs[frame].pins[procSlot]++;
+            } else {
+                Page curPage = file->readPage(pageNo);
+                bufStats.diskreads++;
+                allocBuf(frame);
+                frames[frame] = curPage;
+                assignFrame(frame, id, pageNo);
+            }
+            page = &frames[frame];
+        } catch (...) {
+            unlock();
+            throw;
+        }
+        unlock();
+    }
+
+    void SharedBufMgr::unPinPage(File *file, const PageId pageNo, const bool dirty) {
+        lock();
+        try {
+            FrameId frame;
+            if (!lookup(fileId(file), pageNo, frame) || descs[frame].pins[procSlot] == 0) {
+                throw PageNotPinnedException(file->filename(), pageNo, 0);
+            }
+            descs[frame].pinCnt--;
+            descs[frame].pins[procSlot]--;
+            if (dirty) {
+                descs[frame].dirty = true;
+            }
+        } catch (...) {
+            unlock();
+            throw;
+        }
+        unlock();
+    }
+
+    void SharedBufMgr::allocPage(File *file, PageId &pageNo, Page *&page) {
+        lock();
+        try {
+            // File serializes allocation between processes itself, and catches up with the pages others allocated
+            Page curPage = file->allocatePage();
+            bufStats.accesses++;
+            bufStats.diskreads++;
+            FrameId frame;
+            allocBuf(frame);
+            frames[frame] = curPage;
+            assignFrame(frame, fileId(file), curPage.page_number());
+            page = &frames[frame];
+            pageNo = curPage.page_number();
+        } catch (...) {
+            unlock();
+            throw;
+        }
+        unlock();
+    }
+
+    void SharedBufMgr::flushFile(const File *file) {
+        lock();
+        try {
+            const int id = fileId(file);
+            for (std::uint32_t i = 0; i < seg->numBufs; i++) {
+                if (descs[i].valid && descs[i].fileId == id && descs[i].pinCnt > 0) {
+                    throw PagePinnedException(file->filename(), descs[i].pageNo, i);
+                }
+            }
+            for (std::uint32_t i = 0; i < seg->numBufs; i++) {
+                if (!descs[i].valid || descs[i].fileId != id) {
+                    continue;
+                }
+                if (descs[i].dirty) {
+                    fileFor(id)->writePage(frames[i]);
+                    bufStats.diskwrites++;
+                }
+                removeEntry(id, descs[i].pageNo);
+                descs[i].valid = false;
+                descs[i].dirty = false;
+                descs[i].refbit = false;
+            }
+        } catch (...) {
+            unlock();
+            throw;
+        }
+        unlock();
+    }
+
+    void SharedBufMgr::disposePage(File *file, const PageId pageNo) {
+        lock();
+        try {
+            const int id = fileId(file);
+            FrameId frame;
+            if (lookup(id, pageNo, frame)) {
+                removeEntry(id, pageNo);
+                descs[frame].valid = false;
+                descs[frame].dirty = false;
+                descs[frame].refbit = false;
+                descs[frame].pinCnt = 0;
+                std::memset(descs[frame].pins, 0, sizeof(descs[frame].pins));
+            }
+            file->deletePage(pageNo);
+        } catch (...) {
+            unlock();
+            throw;
+        }
+        unlock();
+    }
+
+}
@@ -0,0 +1,287 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "file.h"
+#include "buffer.h"
+
+namespace badgerdb {
+
+/**
+* @brief Buffer manager whose buffer pool lives in a named POSIX shared-memory segment, so that cooperating
+* processes on one host share a single cache.
+*
+* The frame arena, the frame descriptors, the page table and a table of file names are all placed in the
+* segment.  Files are identified across processes by name; a process that has to write back a dirty page of
+* a file it never opened opens the file itself.  All operations are serialized by a robust, process-shared
+* mutex in the segment.
+*
+* Every attached process has a slot in the segment, and pins are counted per process.  When a process dies
+* with pages pinned, its pins are released the next time another process finds every frame pinned, or takes
+* over the mutex from it.  Taking over the mutex also rebuilds the page table and pin counts from the frame
+* descriptors, since the dead process may have been in the middle of changing them.  A process is taken for
+* dead when kill(pid, 0) fails with ESRCH, so if its pid has been reused by an unrelated process its pins
+* stay held until that process exits too.  The segment outlives the processes using it; SharedBufMgr::remove()
+* deletes it.
+*/
+class SharedBufMgr
+{
+ public:
+	/**
+   * Maximum number of processes attached to one segment at a time
+	 */
+  static const int MAX_PROCS = 32;
+
+	/**
+   * Maximum number of distinct files cached in one segment
+	 */
+  static const int MAX_FILES = 64;
+
+	/**
+   * Maximum length of a file name, including the terminating NUL
+	 */
+  static const int MAX_NAME = 256;
+
+	/**
+	 * Attach to the named segment, creating it with the given number of frames if it does not exist yet.
+	 *
+	 * @param name   	Name of the segment, "/something" as for shm_open()
+	 * @param bufs  	Number of frames; ignored when attaching to an existing segment
+	 * @throws  FileIOException If the segment cannot be created or attached, or was created with another page size
+	 */
+  SharedBufMgr(const std::string& name, std::uint32_t bufs);
+
+	/**
+   * Detach from the segment, releasing this process's pins.  The last process to detach writes back all dirty pages.
+	 */
+  ~SharedBufMgr();
+
+	/**
+	 * Reads the given page from the file into a shared frame and returns the pointer to page.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file to be read
+	 * @param page  	Reference to page pointer. Used to fetch the Page object in which requested page from file is read in.
+   * @throws  BufferExceededException If every frame is pinned by live processes
+	 */
+  void readPage(File* file, const PageId PageNo, Page*& page);
+
+	/**
+	 * Unpin a page this process has pinned.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number
+	 * @param dirty		True if the page to be unpinned needs to be marked dirty
+   * @throws  PageNotPinnedException If this process does not have the page pinned
+	 */
+  void unPinPage(File* file, const PageId PageNo, const bool dirty);
+
+	/**
+	 * Allocates a new, empty page in the file and assigns it a shared frame.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
+	 * @param page  	Reference to page pointer. The newly allocated in-memory Page object is returned via this reference.
+   * @throws  BufferExceededException If every frame is pinned by live processes
+	 */
+  void allocPage(File* file, PageId &PageNo, Page*& page);
+
+	/**
+	 * Writes out all dirty pages of the file and drops them from the shared pool.
+	 *
+	 * @param file   	File object
+   * @throws  PagePinnedException If any process has a page of the file pinned
+	 */
+  void flushFile(const File* file);
+
+	/**
+	 * Delete page from file and also from the shared pool if present.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number
+	 */
+  void disposePage(File* file, const PageId PageNo);
+
+	/**
+	 * Release the pins held by processes that have died.
+	 *
+	 * @return  			Number of pins released
+	 */
+  std::uint32_t recoverDeadProcesses();
+
+	/**
+   * Get this process's buffer pool usage statistics
+	 */
+  BufStats & getBufStats()
+  {
+		return bufStats;
+  }
+
+	/**
+   * Clear this process's buffer pool usage statistics
+	 */
+  void clearBufStats()
+  {
+		bufStats.clear();
+  }
+
+	/**
+	 * Delete a named segment.  Processes still attached keep using it.
+	 *
+	 * @param name   	Name of the segment
+	 */
+  static void remove(const std::string& name);
+
+ private:
+  struct Segment;
+  struct FrameDesc;
+  struct TableSlot;
+
+	/**
+   * Name of the segment
+	 */
+  std::string segName;
+
+	/**
+   * Start of the mapping
+	 */
+  char* base;
+
+	/**
+   * Size of the mapping in bytes
+	 */
+  std::size_t mapSize;
+
+	/**
+   * Segment header
+	 */
+  Segment* seg;
+
+	/**
+   * Frame descriptors in the segment
+	 */
+  FrameDesc* descs;
+
+	/**
+   * Page table in the segment, open addressing with linear probing
+	 */
+  TableSlot* table;
+
+	/**
+   * Frames in the segment
+	 */
+  Page* frames;
+
+	/**
+   * This process's slot in the segment
+	 */
+  int procSlot;
+
+	/**
+   * Segment file ids of the File objects used by this process
+	 */
+  std::map<const File*, int> fileIds;
+
+	/**
+   * File to write back pages of each segment file id, opened here if needed
+	 */
+  std::map<int, File*> idFiles;
+
+	/**
+   * Files this process opened itself to write back other processes' pages
+	 */
+  std::map<int, File*> ownedFiles;
+
+	/**
+   * Usage statistics of this process
+	 */
+  BufStats bufStats;
+
+	/**
+   * Take the segment mutex, recovering it if its owner died
+	 */
+  void lock();
+
+	/**
+   * Release the segment mutex
+	 */
+  void unlock();
+
+	/**
+	 * Return the segment file id of a file, registering it in the segment if needed.  Called with the mutex held.
+	 *
+	 * @param file   	File object
+	 * @throws  FileIOException If the segment's file table is full
+	 */
+  int fileId(const File* file);
+
+	/**
+	 * Return a File for a segment file id, opening the file if this process has no File for it.
+	 *
+	 * @param id   	Segment file id
+	 */
+  File* fileFor(int id);
+
+	/**
+	 * Release the pins held by processes that have died.  Called with the mutex held.
+	 *
+	 * @return  			Number of pins released
+	 */
+  std::uint32_t recoverDeadProcessesLocked();
+
+	/**
+	 * Rebuild the page table and the pin counts from the valid frame descriptors, after a process died holding
+	 * the mutex.  Called with the mutex held.
+	 */
+  void rebuildLocked();
+
+	/**
+	 * Release all pins held by a process slot.
+	 *
+	 * @param slot   	Process slot
+	 * @return  			Number of pins released
+	 */
+  std::uint32_t releasePins(int slot);
+
+	/**
+	 * Look (id, pageNo) up in the page table.
+	 *
+	 * @return  			True if found, with its frame in frame
+	 */
+  bool lookup(int id, PageId pageNo, FrameId& frame);
+
+	/**
+   * Insert (id, pageNo) -> frame into the page table
+	 */
+  void insert(int id, PageId pageNo, FrameId frame);
+
+	/**
+   * Remove (id, pageNo) from the page table, if present
+	 */
+  void removeEntry(int id, PageId pageNo);
+
+	/**
+	 * Pick a frame with CLOCK, writing back its page if dirty.  Called with the mutex held.
+	 *
+	 * @param frame   	Frame ID of allocated frame returned via this variable
+	 * @throws BufferExceededException If every frame is pinned by live processes
+	 */
+  void allocBuf(FrameId& frame);
+
+	/**
+	 * Fill a frame with a page and pin it for this process.
+	 */
+  void assignFrame(FrameId frame, int id, PageId pageNo);
+};
+
+}